@@ -0,0 +1,118 @@
+#include "shell.h"
+#include <time.h>
+#include <sys/resource.h>
+
+// Copy benchmark: `cat src > dst` done in-process with kernel-side copies
+// versus the same copy through an exec'd /bin/cat (a path, so the fast
+// path does not apply). CPU time includes the children, so the exec'd
+// cat's own copy loop is counted too.
+//
+// For large files the two are about even: a current /bin/cat uses the
+// same kernel copy calls, and on file systems without reflinks
+// copy_file_range() still copies through the page cache. What the
+// in-shell cat saves is starting a process, which is what the small-file
+// rows show.
+//
+// Usage: bin/copy_bench [size-MB] [runs]
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Write a file of size bytes. Returns 0, or -1 after reporting an error.
+static int make_file(const char* path, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    char block[1 << 16];
+    for (size_t i = 0; i < sizeof(block); i++) {
+        block[i] = 'a' + i % 26;
+    }
+    for (size_t done = 0; done < size; done += sizeof(block)) {
+        size_t n = size - done < sizeof(block) ? size - done : sizeof(block);
+        if (write(fd, block, n) < 0) {
+            perror("write");
+            close(fd);
+            unlink(path);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+// User + system CPU of the shell and its waited-for children, in ms
+static double cpu_ms() {
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    double us = self.ru_utime.tv_sec * 1e6 + self.ru_utime.tv_usec +
+                self.ru_stime.tv_sec * 1e6 + self.ru_stime.tv_usec +
+                children.ru_utime.tv_sec * 1e6 + children.ru_utime.tv_usec +
+                children.ru_stime.tv_sec * 1e6 + children.ru_stime.tv_usec;
+    return us / 1000.0;
+}
+
+// Run the copy runs times into a fresh dst (removed first, outside the
+// timing, so >> does not keep growing the file and no row pays for
+// truncating the previous run's output)
+static void run_copy(const char* label, const char* text, const char* dst, double mb,
+                     int runs) {
+    int status = 0;
+    double elapsed = 0, cpu = 0;
+    for (int i = 0; i < runs; i++) {
+        unlink(dst);
+        double start = now_ms(), cpu_start = cpu_ms();
+        execute_input(text, &status);
+        elapsed += now_ms() - start;
+        cpu += cpu_ms() - cpu_start;
+    }
+    elapsed /= runs;
+    cpu /= runs;
+    printf("%-14s %10.3f %10.3f %10.0f %s\n", label, elapsed, cpu,
+           mb / (elapsed / 1000.0), status == 0 ? "" : "(failed)");
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    const char* dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+    init_variables();
+
+    char src[512], small[512], dst[512], text[1200];
+    snprintf(src, sizeof(src), "%s/copy_bench_src.%d", dir, (int)getpid());
+    snprintf(small, sizeof(small), "%s/copy_bench_small.%d", dir, (int)getpid());
+    snprintf(dst, sizeof(dst), "%s/copy_bench_dst.%d", dir, (int)getpid());
+
+    // Source files of mb megabytes and of 4 KB
+    if (make_file(src, mb << 20) < 0 || make_file(small, 4096) < 0) {
+        unlink(src);
+        return 1;
+    }
+
+    printf("%-14s %10s %10s %10s\n", "copy", "ms/run", "cpu-ms", "MB/s");
+
+    snprintf(text, sizeof(text), "cat %s > %s", src, dst);
+    run_copy("cat (in-shell)", text, dst, mb, runs);
+    snprintf(text, sizeof(text), "/bin/cat %s > %s", src, dst);
+    run_copy("/bin/cat", text, dst, mb, runs);
+    snprintf(text, sizeof(text), "cat < %s >> %s", src, dst);
+    run_copy("cat < >>", text, dst, mb, runs);
+
+    // 4 KB copies: the cost of starting cat dominates
+    int small_runs = runs * 200;
+    snprintf(text, sizeof(text), "cat %s > %s", small, dst);
+    run_copy("4K in-shell", text, dst, 4096.0 / (1 << 20), small_runs);
+    snprintf(text, sizeof(text), "/bin/cat %s > %s", small, dst);
+    run_copy("4K /bin/cat", text, dst, 4096.0 / (1 << 20), small_runs);
+
+    unlink(src);
+    unlink(small);
+    unlink(dst);
+    return 0;
+}
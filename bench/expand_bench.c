@@ -0,0 +1,51 @@
+#include "shell.h"
+#include <time.h>
+
+// Variable expansion throughput on large inputs. Each input mixes plain
+// text, $VAR, ${VAR}, parameter operators and quoted text; the time per
+// byte should stay flat as the input grows.
+//
+// Usage: bin/expand_bench [max-MB]
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static const char* pattern =
+    "some plain text $NAME and ${NAME}/path ${UNSET:-fallback} "
+    "'no $EXPANSION here' \"$NAME quoted\" ${NAME:+alt} \\$literal ";
+
+int main(int argc, char** argv) {
+    size_t max_mb = argc > 1 ? (size_t)atol(argv[1]) : 64;
+    arena_t arena = {0};
+
+    init_variables();
+    set_variable("NAME", "value-of-name");
+
+    printf("%12s %12s %12s %10s %10s\n", "input", "output", "ms", "ns/byte", "MB/s");
+    size_t pattern_len = strlen(pattern);
+    for (size_t size = 64 * 1024; size <= max_mb << 20; size *= 4) {
+        char* input = malloc(size + pattern_len + 1);
+        size_t len = 0;
+        while (len < size) {
+            memcpy(input + len, pattern, pattern_len);
+            len += pattern_len;
+        }
+        input[len] = '\0';
+
+        double start = now_ms();
+        char* output = expand_variables(input, &arena);
+        double elapsed = now_ms() - start;
+
+        printf("%12zu %12zu %12.2f %10.2f %10.1f\n", len, output ? strlen(output) : 0,
+               elapsed, elapsed * 1e6 / len, len / 1048576.0 / (elapsed / 1000.0));
+
+        arena_reset(&arena);
+        free(input);
+    }
+
+    arena_release(&arena);
+    return 0;
+}
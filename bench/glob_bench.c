@@ -0,0 +1,88 @@
+#include "shell.h"
+#include <time.h>
+#include <glob.h>
+
+// Glob benchmark over a spool-like directory of N files (one in ten named
+// *.tmp): the shell's expansion with a cold directory cache, the same
+// pattern again on the same command line (cached listing), and libc's
+// glob(3) for comparison.
+//
+// Usage: bin/glob_bench [files] [runs]
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void run_shell(const char* label, const char* pattern, int runs, int cold) {
+    arena_t arena = {0};
+    int matches = 0;
+    double start = now_ms();
+    for (int i = 0; i < runs; i++) {
+        if (cold) glob_cache_reset();
+        wordlist_t words;
+        wordlist_init(&words, &arena, 16);
+        expand_word(pattern, &words);
+        matches = words.count;
+        arena_reset(&arena);
+    }
+    printf("%-18s %-10s %10d %10.2f\n", label, pattern, matches, (now_ms() - start) / runs);
+    arena_release(&arena);
+}
+
+static void run_libc(const char* pattern, int runs) {
+    int matches = 0;
+    double start = now_ms();
+    for (int i = 0; i < runs; i++) {
+        glob_t result;
+        if (glob(pattern, 0, NULL, &result) == 0) {
+            matches = (int)result.gl_pathc;
+        }
+        globfree(&result);
+    }
+    printf("%-18s %-10s %10d %10.2f\n", "glob(3)", pattern, matches, (now_ms() - start) / runs);
+}
+
+int main(int argc, char** argv) {
+    int files = argc > 1 ? atoi(argv[1]) : 100000;
+    int runs = argc > 2 ? atoi(argv[2]) : 10;
+    const char* tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+    init_variables();
+
+    char dir[512], name[600];
+    snprintf(dir, sizeof(dir), "%s/glob_bench.%d", tmp, (int)getpid());
+    if (mkdir(dir, 0755) < 0 || chdir(dir) < 0) {
+        perror(dir);
+        return 1;
+    }
+    for (int i = 0; i < files; i++) {
+        snprintf(name, sizeof(name), "f%07d.%s", i, i % 10 == 0 ? "tmp" : "dat");
+        int fd = open(name, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(name);
+            return 1;
+        }
+        close(fd);
+    }
+
+    printf("%-18s %-10s %10s %10s\n", "glob", "pattern", "matches", "ms/run");
+    const char* patterns[] = { "*.tmp", "f00*1.*", "*[05].dat", NULL };
+    for (int i = 0; patterns[i] != NULL; i++) {
+        run_shell("shell (cold)", patterns[i], runs, 1);
+        run_shell("shell (cached)", patterns[i], runs, 0);
+        run_libc(patterns[i], runs);
+    }
+
+    // Clean up
+    glob_cache_reset();
+    for (int i = 0; i < files; i++) {
+        snprintf(name, sizeof(name), "f%07d.%s", i, i % 10 == 0 ? "tmp" : "dat");
+        unlink(name);
+    }
+    if (chdir("/") == 0) {
+        rmdir(dir);
+    }
+    return 0;
+}
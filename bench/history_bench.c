@@ -0,0 +1,105 @@
+#include "shell.h"
+#include <time.h>
+
+// History search latency on a large history file. Times the one-off
+// index build on the first search, then prefix and substring lookups
+// against a plain backwards scan over the same entries.
+//
+// Usage: bin/history_bench [entries]
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static const char* words[] = {
+    "git", "make", "ls", "cd", "grep", "vim", "cat", "ssh", "docker", "find",
+    "status", "commit", "build", "src", "include", "-la", "--force", "main.c",
+    "deploy", "logs", "server", "config", "test", "release", "backup", NULL
+};
+
+// Newest entry containing pattern, by scanning every entry
+static int linear_find(const char* pattern) {
+    for (int n = history_count(); n > 0; n--) {
+        size_t len;
+        const char* entry = history_entry(n, &len);
+        if (memmem(entry, len, pattern, strlen(pattern)) != NULL) {
+            return n;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int entries = argc > 1 ? atoi(argv[1]) : 500000;
+    char path[] = "/tmp/history_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+
+    // Random-ish commands; the substring target appears once, early on
+    int nwords = 0;
+    while (words[nwords] != NULL) nwords++;
+    FILE* out = fdopen(fd, "w");
+    unsigned seed = 12345;
+    for (int i = 0; i < entries; i++) {
+        if (i == entries / 10) {
+            fprintf(out, "rsync -a needle-host:/srv/data .\n");
+            continue;
+        }
+        for (int w = 0; w < 4; w++) {
+            seed = seed * 1103515245 + 12345;
+            fprintf(out, "%s%s", w ? " " : "", words[(seed >> 16) % nwords]);
+        }
+        fprintf(out, " %d\n", i);
+    }
+    fclose(out);
+
+    char size[32];
+    snprintf(size, sizeof(size), "%d", entries);
+    init_variables();
+    set_variable("HISTFILE", path);
+    set_variable("HISTSIZE", size);
+    init_history();
+
+    double start = now_ms();
+    int count = history_count();
+    printf("%-28s %10.2f ms (%d entries)\n", "load + line index", now_ms() - start, count);
+
+    start = now_ms();
+    history_find("git", 3, 0, count + 1);
+    printf("%-28s %10.2f ms\n", "search index build", now_ms() - start);
+
+    struct { const char* pattern; int substring; } queries[] = {
+        { "rsync", 0 }, { "docker logs", 0 }, { "needle-host", 1 },
+        { "main.c", 1 }, { "no-such-command", 1 },
+    };
+    int rounds = 1000;
+    printf("%-28s %12s %12s\n", "query", "indexed us", "scan us");
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        const char* pattern = queries[q].pattern;
+        int found = 0;
+
+        start = now_ms();
+        for (int r = 0; r < rounds; r++) {
+            found = history_find(pattern, strlen(pattern), queries[q].substring, count + 1);
+        }
+        double indexed = (now_ms() - start) * 1000.0 / rounds;
+
+        start = now_ms();
+        int scanned = 0;
+        for (int r = 0; r < 10; r++) {
+            scanned = linear_find(pattern);
+        }
+        double scan = (now_ms() - start) * 1000.0 / 10;
+
+        printf("%s%-26s %12.2f %12.2f%s\n", queries[q].substring ? "?" : "!", pattern,
+               indexed, scan, queries[q].substring && found != scanned ? "  MISMATCH" : "");
+    }
+
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "shell.h"
+#include <time.h>
+
+// Loop benchmark. Each loop is parsed once and then run through the tree
+// walker, so the time per iteration is what the shell spends on one pass
+// over an already compiled body: evaluating the condition, expanding the
+// body's words and setting variables. No external commands are run; the
+// function call loop shows the cost of calling an already parsed function.
+// A function in $(...) runs in a forked subshell, so that row does only
+// one iteration per thousand of the others.
+//
+// Usage: bin/loop_bench [iterations]
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Parse and run one loop, printing the cost per iteration
+static void run_loop(const char* label, const char* text, long iterations) {
+    ast_t ast = {0};
+    if (parse_input(text, &ast) != PARSE_OK) {
+        fprintf(stderr, "%s: parse failed\n", label);
+        return;
+    }
+
+    arena_stats_t before = *arena_get_stats();
+    double start = now_ms();
+    int status = execute_node(ast.root);
+    double elapsed = now_ms() - start;
+    const arena_stats_t* after = arena_get_stats();
+
+    printf("%-10s %10ld %10.1f %10.1f %10lu %s\n", label, iterations, elapsed,
+           elapsed * 1e6 / iterations, after->chunk_mallocs - before.chunk_mallocs,
+           status == 0 ? "" : "(failed)");
+    release_ast(&ast);
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    char text[256];
+
+    init_variables();
+
+    printf("%-10s %10s %10s %10s %10s\n", "loop", "iterations", "ms", "ns/iter", "mallocs");
+
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do x=$i; done", iterations);
+    run_loop("for ((;;))", text, iterations);
+
+    snprintf(text, sizeof(text), "while ((n < %ld)); do n=$((n + 1)); done", iterations);
+    set_variable("n", "0");
+    run_loop("while", text, iterations);
+
+    snprintf(text, sizeof(text), "until ((n == 0)); do ((n--)); done");
+    run_loop("until", text, iterations);
+
+    // Function calls: the body is parsed once, at definition
+    ast_t def = {0};
+    if (parse_input("f() { local v=$1; y=$v; }", &def) == PARSE_OK) {
+        execute_node(def.root);
+    }
+    release_ast(&def);
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do f $i; done", iterations);
+    run_loop("call f", text, iterations);
+
+    // Built-ins run in the shell, so these loops never fork
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do test $i -ge 0; done", iterations);
+    run_loop("test", text, iterations);
+    snprintf(text, sizeof(text),
+             "for ((i = 0; i < %ld; i++)); do if [[ -d /tmp && $i == *7 ]]; then :; fi; done",
+             iterations);
+    run_loop("[[ ]]", text, iterations);
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do echo $i > /dev/null; done", iterations);
+    run_loop("echo >", text, iterations);
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do : <<< $i 2>&1; done", iterations);
+    run_loop("<<< word", text, iterations);
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do y=$(echo $i); done", iterations);
+    run_loop("$(echo)", text, iterations);
+    long fork_iterations = iterations >= 1000 ? iterations / 1000 : 1;
+    snprintf(text, sizeof(text), "for ((i = 0; i < %ld; i++)); do y=$(f $i); done",
+             fork_iterations);
+    run_loop("$(f) fork", text, fork_iterations);
+
+    // for-in over a variable holding the words (split once, at loop start)
+    strbuf_t words;
+    arena_t arena = {0};
+    strbuf_init(&words, &arena, iterations * 8);
+    for (long i = 0; i < iterations; i++) {
+        char word[24];
+        int len = snprintf(word, sizeof(word), "w%ld ", i);
+        strbuf_append(&words, word, len);
+    }
+    set_variable("WORDS", words.data);
+    arena_release(&arena);
+    run_loop("for in", "for w in $WORDS; do y=$w; done", iterations);
+
+    // for-in over a brace sequence, generated one word at a time
+    snprintf(text, sizeof(text), "for w in {1..%ld}; do y=$w; done", iterations);
+    run_loop("for {1..N}", text, iterations);
+
+    return 0;
+}
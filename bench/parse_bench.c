@@ -0,0 +1,86 @@
+#include "shell.h"
+#include <time.h>
+
+// Parser benchmark.
+// 1. Parses the same command lines repeatedly with one reused tree and
+//    reports how often the arena had to call malloc. After the first
+//    (warm-up) round the count should stay at zero.
+// 2. Parses single lines with a growing number of arguments to show that
+//    parse time scales linearly with input size.
+//
+// Usage: bin/parse_bench [iterations] [max-args]
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static const char* lines[] = {
+    "ls -la /tmp | grep log > out.txt",
+    "cat < in.txt | sort | uniq -c ; echo \"done $USER\"",
+    "echo $HOME ${SHELL} 'quoted | not a pipe' &",
+    "if test -f out.txt; then cat out.txt; elif true; then { echo a; echo b; }; else echo none; fi",
+    NULL
+};
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    ast_t ast = {0};
+
+    init_variables();
+
+    // Warm-up round sizes the arena
+    for (int j = 0; lines[j] != NULL; j++) {
+        parse_input(lines[j], &ast);
+        free_ast(&ast);
+    }
+
+    arena_stats_t before = *arena_get_stats();
+    double start = now_ms();
+
+    long parsed = 0;
+    for (long i = 0; i < iterations; i++) {
+        for (int j = 0; lines[j] != NULL; j++) {
+            parse_input(lines[j], &ast);
+            free_ast(&ast);
+            parsed++;
+        }
+    }
+
+    double elapsed = now_ms() - start;
+    const arena_stats_t* after = arena_get_stats();
+
+    printf("lines parsed:        %ld\n", parsed);
+    printf("time per line:       %.1f ns\n", elapsed * 1e6 / parsed);
+    printf("arena allocations:   %lu\n", after->allocs - before.allocs);
+    printf("arena resets:        %lu\n", after->resets - before.resets);
+    printf("mallocs (steady):    %lu\n", after->chunk_mallocs - before.chunk_mallocs);
+
+    // Scaling: time per byte should stay flat as lines grow
+    long max_args = argc > 2 ? atol(argv[2]) : 800000;
+    printf("\n%10s %12s %12s %10s\n", "args", "bytes", "ms", "ns/byte");
+    for (long nargs = 1000; nargs <= max_args; nargs *= 2) {
+        size_t cap = nargs * 16 + 64;
+        char* line = malloc(cap);
+        size_t len = snprintf(line, cap, "echo");
+        for (long i = 0; i < nargs; i++) {
+            len += snprintf(line + len, cap - len, " arg%ld", i);
+        }
+        len += snprintf(line + len, cap - len, " | wc -l > $HOME/count.txt");
+
+        start = now_ms();
+        int parsed_ok = parse_input(line, &ast) == PARSE_OK &&
+                        ast.root->type == NODE_PIPELINE &&
+                        ast.root->list.items[0]->cmd.num_words == nargs + 1;
+        elapsed = now_ms() - start;
+        free_ast(&ast);
+
+        printf("%10ld %12zu %12.2f %10.2f%s\n", nargs, len, elapsed,
+               elapsed * 1e6 / len, parsed_ok ? "" : "  (parse failed)");
+        free(line);
+    }
+
+    release_ast(&ast);
+    return 0;
+}
@@ -1,6 +1,10 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // pipe2, memfd_create and friends
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -10,6 +14,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
+#include <termios.h>
 
 // Check if readline is available by testing its existence
 #if __has_include(<readline/readline.h>) && __has_include(<readline/history.h>)
@@ -20,11 +26,12 @@
 // Fallback: define dummy functions if readline not available
 static inline char* readline(const char* prompt) {
     printf("%s", prompt);
-    char* line = malloc(512);
-    if (fgets(line, 512, stdin)) {
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len = getline(&line, &cap, stdin);
+    if (len >= 0) {
         // Remove newline
-        char* newline = strchr(line, '\n');
-        if (newline) *newline = '\0';
+        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
         return line;
     }
     free(line);
@@ -54,35 +61,18 @@ int rl_completion_query_items = 100;
 rl_completion_func_t* rl_attempted_completion_function = NULL;
 #endif
 
-#define MAX_LEN 512
-#define MAXARGS 10
-#define ARGLEN 30
 #define PROMPT "FCIT> "
-#define HISTORY_SIZE 20
-#define MAX_PIPES 10
-#define MAX_JOBS 100
-#define MAX_IF_BLOCKS 10
-#define MAX_BLOCK_LINES 20
-#define MAX_VARIABLES 100  // NEW: Maximum number of variables
-#define VAR_NAME_LEN 50    // NEW: Maximum variable name length
-#define VAR_VALUE_LEN 256  // NEW: Maximum variable value length
-
-// NEW: Structure for shell variables
+#define HISTORY_SIZE 1000  // Default for HISTSIZE
+#define CONTINUATION_PROMPT "> "
+// Structure for shell variables (a slot in the variable hash table)
 typedef struct {
-    char name[VAR_NAME_LEN];
-    char value[VAR_VALUE_LEN];
+    char* name;          // NULL for an empty slot
+    char* value;         // Heap-allocated, any length
+    size_t value_cap;    // Bytes allocated for value
+    unsigned int hash;   // Cached hash of name
+    int exported;        // Copied into the environment of child processes
 } variable_t;
 
-// Structure for if-then-else block
-typedef struct {
-    char* condition;                    // Condition command
-    char* then_commands[MAX_BLOCK_LINES]; // Commands in then block
-    char* else_commands[MAX_BLOCK_LINES]; // Commands in else block
-    int then_count;                     // Number of commands in then block
-    int else_count;                     // Number of commands in else block
-    int has_else;                       // Whether else block exists
-} if_block_t;
-
 // Job status enumeration
 typedef enum {
     JOB_RUNNING,
@@ -90,78 +80,418 @@ typedef enum {
     JOB_DONE
 } job_status_t;
 
-// Structure for background job tracking
-typedef struct {
-    pid_t pid;           // Process ID
-    char* command;       // Command string
-    job_status_t status; // Job status
-    int job_id;          // Job ID number
+struct job;
+
+// One process of a job
+typedef struct job_process {
+    pid_t pid;                       // Process ID
+    job_status_t state;              // Running, stopped or done
+    int status;                      // Raw wait status once done
+    struct job* job;                 // Job the process belongs to
+    struct job_process* hash_next;   // Next process in the same pid map bucket
+} job_process_t;
+
+// Structure for job tracking (a command or pipeline in its own process group)
+typedef struct job {
+    pid_t pgid;             // Process group ID (pid of the first process)
+    char* command;          // Command string
+    job_status_t status;    // Job status
+    int job_id;             // Job ID number (0 while in the foreground)
+    job_process_t* procs;   // Processes of the job, in pipeline order
+    int num_procs;          // Number of started processes
+    struct termios tmodes;  // Terminal modes saved when the job stopped
+    int has_tmodes;         // Whether tmodes is valid
+    struct job* prev;       // Active jobs in creation order
+    struct job* next;       // (also links the free list)
 } job_t;
 
-// Structure to hold command information with redirection
+// Block of memory owned by an arena
+typedef struct arena_chunk {
+    struct arena_chunk* next;  // Next chunk in the arena
+    size_t size;               // Usable bytes in data
+    size_t used;               // Bytes handed out so far
+    char data[];
+} arena_chunk_t;
+
+// Bump allocator for data that is freed all at once (e.g. one command line)
+typedef struct {
+    arena_chunk_t* chunks;     // All chunks, oldest first
+    arena_chunk_t* current;    // Chunk allocations are served from
+} arena_t;
+
+// Allocation counters for all arenas
+typedef struct {
+    unsigned long allocs;        // Allocations served from arenas
+    unsigned long chunk_mallocs; // Times an arena had to call malloc
+    unsigned long resets;        // Arena resets
+} arena_stats_t;
+
+// Growable string built in an arena
 typedef struct {
-    char* args[MAXARGS];     // Command arguments
-    char* input_file;        // File for input redirection (<)
-    char* output_file;       // File for output redirection (>)
+    arena_t* arena;            // Arena the buffer lives in
+    char* data;                // Always NUL-terminated
+    size_t len;                // Length without the terminator
+    size_t cap;                // Allocated bytes
+} strbuf_t;
+
+// Kinds of syntax tree nodes
+typedef enum {
+    NODE_COMMAND,    // Simple command: words and redirections
+    NODE_PIPELINE,   // Commands joined with |
+    NODE_LIST,       // Commands separated by ; & or newlines
+    NODE_GROUP,      // { list; }
+    NODE_IF,         // if / elif / else
+    NODE_WHILE,      // while list; do list; done
+    NODE_UNTIL,      // until list; do list; done
+    NODE_FOR,        // for NAME in words; do list; done
+    NODE_ARITH_FOR,  // for ((init; cond; step)); do list; done
+    NODE_ARITH,      // (( expression ))
+    NODE_FUNCTION,   // name() compound-command (a definition)
+    NODE_COND,       // [[ expression ]]
+    NODE_AND,        // left && right
+    NODE_OR          // left || right
+} node_type_t;
+
+// Parsed arithmetic expression (see arith.c)
+typedef struct arith_node {
+    int op;                          // Operator or operand kind
+    long value;                      // Number, or the operator of a compound assignment
+    char* name;                      // Variable name
+    struct arith_node* left;
+    struct arith_node* right;
+    struct arith_node* extra;        // Else part of ?:
+} arith_node_t;
+
+// Kinds of [[ ]] expression nodes
+typedef enum {
+    COND_AND,        // left && right
+    COND_OR,         // left || right
+    COND_NOT,        // ! left
+    COND_UNARY,      // test words[0], e.g. -f file
+    COND_BINARY,     // words[0] test words[1], e.g. a == b*
+    COND_WORD        // words[0] is not empty
+} cond_op_t;
+
+// Parsed [[ ]] expression. Words are raw, expanded when it runs.
+typedef struct cond_node {
+    cond_op_t op;
+    const char* test;                // Operator text for unary and binary tests
+    char* words[2];
+    struct cond_node* left;
+    struct cond_node* right;
+} cond_node_t;
+
+// Kinds of redirections
+typedef enum {
+    REDIR_INPUT,         // [n]<file
+    REDIR_OUTPUT,        // [n]>file, [n]>|file
+    REDIR_APPEND,        // [n]>>file
+    REDIR_READ_WRITE,    // [n]<>file
+    REDIR_DUP,           // [n]>&m, [n]<&m, or [n]>&- to close
+    REDIR_HEREDOC,       // [n]<<word, [n]<<-word
+    REDIR_HERESTRING     // [n]<<<word
+} redir_type_t;
+
+// One redirection of a command. In the syntax tree the target is raw
+// (for a here-document: its body); in a command_t it is expanded.
+typedef struct redir {
+    redir_type_t type;
+    int fd;                  // Descriptor being redirected
+    char* target;            // File name, descriptor number, "-", body or word
+    int quoted;              // Here-document delimiter was quoted: no expansion
+    int source_fd;           // Expanded: descriptor to copy onto fd (-1 closes it)
+    struct redir* next;      // Redirections are applied in order
+} redir_t;
+
+// Descriptor replaced by an in-process redirection, to put back later
+typedef struct saved_fd {
+    int fd;
+    int copy;                // Copy of the original, or -1 if fd was closed
+    struct saved_fd* next;
+} saved_fd_t;
+
+// Syntax tree node. Words are kept as written (quotes included) and are
+// only expanded when the node runs, so a tree can be executed repeatedly.
+typedef struct node {
+    node_type_t type;
+    int background;                  // Followed by &
+    redir_t* redirs;                 // Redirections of a command or compound command
+    union {
+        struct {                     // NODE_COMMAND
+            char** words;            // NULL-terminated raw words
+            int num_words;
+            int num_assigns;         // Leading NAME=value words
+        } cmd;
+        struct {                     // NODE_PIPELINE, NODE_LIST, NODE_GROUP
+            struct node** items;
+            int count;
+        } list;
+        struct {                     // NODE_IF, NODE_WHILE, NODE_UNTIL
+            struct node* cond;
+            struct node* body;
+            struct node* else_part;  // else list, nested NODE_IF for elif, or NULL
+        } branch;
+        struct {                     // NODE_FOR
+            char* var;
+            char** words;            // Raw words after 'in', NULL without 'in'
+            int num_words;
+            struct node* body;
+        } loop;
+        struct {                     // NODE_ARITH_FOR, NODE_ARITH (expression in cond)
+            arith_node_t* init;      // Any of the three may be NULL
+            arith_node_t* cond;
+            arith_node_t* step;
+            struct node* body;
+        } arith;
+        struct {                     // NODE_FUNCTION
+            char* name;
+            struct node* body;
+        } func;
+        cond_node_t* cond;           // NODE_COND
+        struct {                     // NODE_AND, NODE_OR
+            struct node* left;
+            struct node* right;
+        } pair;
+    };
+} node_t;
+
+// A defined function. The body is a copy of the definition's tree in the
+// function's own arena, so it outlives the input it was parsed from.
+typedef struct function {
+    char* name;
+    node_t* body;
+    arena_t arena;           // Holds name and body
+    int calls;               // Calls in progress
+    int retired;             // Replaced or unset while running; freed after the last call
+    struct function* next;   // Next function in the same hash bucket
+} function_t;
+
+// Saved positional parameters ($1..$N)
+typedef struct {
+    char** args;
+    int count;
+} positional_t;
+
+// A parsed input and the arena holding its tree
+typedef struct {
+    node_t* root;                    // NULL for blank input
+    arena_t arena;
+} ast_t;
+
+// parse_input() results
+#define PARSE_OK 0
+#define PARSE_ERROR -1          // Syntax error, already reported
+#define PARSE_INCOMPLETE 1      // Input ends inside a construct; read more
+
+// Structure to hold command information with redirection (a simple
+// command after expansion, ready to run)
+typedef struct {
+    char** args;             // NULL-terminated command arguments
+    int argc;                // Number of arguments
+    redir_t* redirs;         // Expanded redirections, in order
     int background;          // Run in background (&)
+    char** assigns;          // NAME=value for this command's environment, or NULL
+    node_t* body;            // Compound command run in a forked shell, or NULL
 } command_t;
 
-// Structure to hold pipeline information
+// Fields produced by expanding words
 typedef struct {
-    command_t commands[MAX_PIPES];  // Commands in the pipeline
-    int num_commands;               // Number of commands in pipeline
-} pipeline_t;
+    arena_t* arena;
+    char** words;            // NULL-terminated
+    int count;
+    int cap;
+} wordlist_t;
+
+// Built-in commands take the argument vector and return an exit status
+typedef int (*builtin_fn)(char** arglist);
 
 // Function prototypes
 char* read_cmd(char* prompt, FILE* fp);
-char** tokenize(char* cmdline);
-int execute(char** arglist);
 int handle_builtin(char** arglist);
+int is_builtin_command(char** arglist);
+builtin_fn find_builtin(const char* name);
+const char* builtin_name(int i);
+
+// echo / printf output and the test built-in
+int print_escaped(const char* str, size_t len);
+int format_output(const char* format, char** args);
+int builtin_test(char** arglist);
+int is_unary_test(const char* op);
+int is_binary_test(const char* op);
+int execute_cond(node_t* node);
+int builtin_parallel(char** arglist);
+
+// In-process cat over files and pipes (kernel-side copies)
+int try_fast_copy(command_t* cmd, arena_t* arena);
+
+// Process launcher (posix_spawn based)
+#define LAUNCH_REDIRECT_FAILED -2  // A redirection failed; nothing was run
+pid_t launch_command(command_t* cmd, int in_fd, int out_fd, pid_t pgid);
+int wait_for_process(pid_t pid);
+
+// Command location hash (PATH lookup cache)
+const char* hash_lookup_command(const char* name);
+int hash_remember_command(const char* name);
+void hash_forget_command(const char* name);
+void hash_reset();
+void hash_print();
+
+// Executable index for completion
+void path_index_refresh();
+char** path_index_matches(const char* prefix, int* count);
+
+// Command line processing and non-interactive (script / -c) mode
+int process_command_line(const char* line, int interactive);
+int execute_input(const char* text, int* status);
+int run_command_string(const char* commands);
+int run_script_file(const char* path);
+int run_script_fd(int fd);
 
 // History function prototypes
+void init_history();
 void add_to_history(const char* cmd);
+int history_count();
+const char* history_entry(int n, size_t* len);
+const char* history_raw_entry(size_t i, size_t* len);
+int history_find(const char* pattern, size_t len, int substring, int before);
+int print_history_matches(const char* pattern);
 void print_history();
 char* get_history_command(int n);
 int is_history_command(const char* cmdline);
 char* expand_history_command(const char* cmdline);
 
+// History search index
+void history_index_reset();
+void history_index_add(size_t id, const char* text, size_t len);
+long history_index_find_prefix(const char* prefix, size_t len, size_t lo, size_t hi);
+long history_index_find_substring(const char* pattern, size_t len, size_t lo, size_t hi);
+
 // Readline-based command reader
 char* read_cmd_readline(const char* prompt);
 void initialize_readline();
 
+// Arena allocator function prototypes
+void arena_init(arena_t* arena);
+void* arena_alloc(arena_t* arena, size_t size);
+char* arena_strndup(arena_t* arena, const char* str, size_t len);
+void* arena_extend(arena_t* arena, void* ptr, size_t old_size, size_t new_size);
+void arena_reset(arena_t* arena);
+void arena_release(arena_t* arena);
+const arena_stats_t* arena_get_stats();
+void strbuf_init(strbuf_t* sb, arena_t* arena, size_t initial);
+void strbuf_append(strbuf_t* sb, const char* str, size_t len);
+void strbuf_putc(strbuf_t* sb, char c);
+
+// Parser (syntax tree) function prototypes
+int parse_input(const char* input, ast_t* ast);
+void free_ast(ast_t* ast);
+void release_ast(ast_t* ast);
+int is_reserved_word(const char* word);
+node_t* copy_node(const node_t* node, arena_t* arena);
+
+// Tree walker
+int execute_node(node_t* node);
+int execute_compound(node_t* node);
+int execute_command_node(node_t* node);
+int execute_pipeline_node(node_t* node);
+arena_t* push_expansion_arena();
+void pop_expansion_arena();
+
 // Redirection and pipe function prototypes
-int parse_redirection_pipes(char* cmdline, pipeline_t* pipeline);
-void free_pipeline(pipeline_t* pipeline);
-int execute_redirection(command_t* cmd);
-int execute_pipeline(pipeline_t* pipeline);
-int execute_single_command(command_t* cmd);
+char* command_to_string(command_t* cmds, int count);
+int execute_piped_commands(command_t* cmds, int count);
+pid_t start_process(command_t* cmd, int in_fd, int out_fd, int other_fd, pid_t pgid);
+int expand_redirections(const redir_t* redirs, redir_t** out, arena_t* arena);
+void close_redirections(redir_t* redirs);
+int redirection_flags(redir_type_t type);
+int apply_redirections(const redir_t* redirs);
+int redirect_in_process(const redir_t* redirs, saved_fd_t** saved, arena_t* arena);
+void restore_redirections(saved_fd_t* saved);
+int report_redirection_error(const redir_t* redirs);
 
 // Job control function prototypes
-void init_jobs();
-void add_job(pid_t pid, const char* command);
-void remove_job(pid_t pid);
+void init_jobs(int interactive);
+int job_control_enabled();
+int interactive_shell();
+job_t* create_job(char* command, int num_procs);
+void job_add_process(job_t* job, pid_t pid);
+void job_add_failed(job_t* job, int status);
+void background_job(job_t* job);
+void remove_job(job_t* job);
+int wait_for_job(job_t* job);
+int wait_for_background_job(job_t* job);
+int wait_for_any_job(job_t** jobs, int count, int* status);
+job_t* first_background_job();
+int continue_job(job_t* job, int foreground);
+job_t* find_job(const char* spec);
+job_t* find_job_by_pid(pid_t pid);
 void update_jobs();
 void print_jobs();
-void cleanup_zombies();
 int execute_background(command_t* cmd);
+void give_terminal_to(pid_t pgid);
+void reclaim_terminal();
+void enter_subshell();
 
-// if-then-else function prototypes
-int parse_if_block(char** lines, int num_lines, if_block_t* if_block);
-int execute_if_block(if_block_t* if_block);
-int is_control_keyword(const char* word);
-char* read_multiline_command(const char* initial_prompt);
-void free_if_block(if_block_t* if_block);
-int parse_if_block_from_string(const char* full_command, if_block_t* if_block);
-int is_if_then_else_command(const char* cmdline);
-int parse_if_then_else(const char* cmdline, if_block_t* if_block);
+// Control structure function prototypes
+int execute_list(node_t* node);
+int execute_if(node_t* node);
+int execute_while(node_t* node);
+int execute_for(node_t* node);
+int execute_arith_for(node_t* node);
+int execute_arith(node_t* node);
+int execute_and_or(node_t* node);
+int builtin_break(char** arglist);
+int builtin_continue(char** arglist);
+int builtin_return(char** arglist);
+void enter_function(int* saved_loops);
+int leave_function(int saved_loops, int status);
+void catch_interrupts(int on);
+int interrupt_pending();
+
+// Shell functions
+int define_function(const char* name, node_t* body);
+function_t* find_function(const char* name);
+int unset_function(const char* name);
+int call_function(function_t* fn, int argc, char** args);
+
+// Arithmetic
+arith_node_t* arith_parse(const char* text, size_t len, arena_t* arena);
+arith_node_t* arith_copy(const arith_node_t* node, arena_t* arena);
+int arith_eval(arith_node_t* node, long* result);
 
 // NEW: Variable function prototypes
 void init_variables();
 void set_variable(const char* name, const char* value);
 char* get_variable(const char* name);
+char* get_variable_n(const char* name, size_t len);
+int export_variable(const char* name);
+int unset_variable(const char* name);
+void set_positional(char** args, int count, positional_t* saved);
+void restore_positional(const positional_t* saved);
+int get_positional(char*** args);
+void set_last_status(int status);
+int get_last_status();
+void set_last_background(pid_t pid);
+int push_variable_scope();
+void pop_variable_scope(int token);
+int make_local(const char* name);
 int is_variable_assignment(const char* cmdline);
-int handle_variable_assignment(const char* cmdline);
-char* expand_variables(const char* str);
 void print_variables();
 
+// Variable expansion engine
+char* expand_variables(const char* str, arena_t* arena);
+void wordlist_init(wordlist_t* list, arena_t* arena, int initial);
+int wordlist_add(wordlist_t* list, char* word);
+int expand_word(const char* word, wordlist_t* out);
+char* expand_word_string(const char* word, arena_t* arena);
+char* expand_heredoc(const char* body, arena_t* arena);
+
+// Command substitution
+int command_substitution(const char* text, size_t len, strbuf_t* out);
+unsigned long command_substitutions();
+
+// Filename generation (globbing)
+int glob_expand(const char* pattern, wordlist_t* out);
+void glob_cache_reset();
+
 #endif // SHELL_H
@@ -0,0 +1,155 @@
+#include "shell.h"
+
+#define ARENA_CHUNK_SIZE 4096  // Default chunk size; larger requests get their own
+#define ARENA_ALIGN 16
+
+// Allocation counters shared by all arenas
+static arena_stats_t stats;
+
+// Initialize an empty arena (an all-zero arena_t is also valid)
+void arena_init(arena_t* arena) {
+    arena->chunks = NULL;
+    arena->current = NULL;
+}
+
+// Allocate memory that lives until the arena is reset or released
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    stats.allocs++;
+
+    // Reuse chunks kept from before the last reset before asking malloc
+    arena_chunk_t* chunk = arena->current;
+    while (chunk != NULL && chunk->size - chunk->used < size) {
+        chunk = chunk->next;
+    }
+
+    if (chunk == NULL) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+        if (chunk == NULL) {
+            perror("malloc");
+            return NULL;
+        }
+        stats.chunk_mallocs++;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        // Append so that earlier, partly used chunks are tried first
+        chunk->next = NULL;
+        arena_chunk_t** link = &arena->chunks;
+        while (*link != NULL) link = &(*link)->next;
+        *link = chunk;
+    }
+
+    arena->current = chunk;
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+// Copy len bytes of a string into the arena and terminate it
+char* arena_strndup(arena_t* arena, const char* str, size_t len) {
+    char* copy = arena_alloc(arena, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+// Grow an allocation to new_size bytes. If it is the most recent
+// allocation and its chunk has room it grows in place; otherwise it is
+// copied to a new block (the old block is reclaimed at the next reset).
+void* arena_extend(arena_t* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL) {
+        return arena_alloc(arena, new_size);
+    }
+
+    size_t old_aligned = (old_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    size_t new_aligned = (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    arena_chunk_t* chunk = arena->current;
+    if (chunk != NULL && (char*)ptr + old_aligned == chunk->data + chunk->used &&
+        chunk->used - old_aligned + new_aligned <= chunk->size) {
+        chunk->used = chunk->used - old_aligned + new_aligned;
+        return ptr;
+    }
+
+    void* grown = arena_alloc(arena, new_size);
+    if (grown != NULL) {
+        memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return grown;
+}
+
+// Free everything allocated from the arena in one step. The chunks are
+// kept, so a steady stream of similar lines never calls malloc again.
+void arena_reset(arena_t* arena) {
+    for (arena_chunk_t* chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->chunks;
+    stats.resets++;
+}
+
+// Return all of the arena's memory to the system
+void arena_release(arena_t* arena) {
+    arena_chunk_t* chunk = arena->chunks;
+    while (chunk != NULL) {
+        arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+    arena->current = NULL;
+}
+
+// Get the allocation counters
+const arena_stats_t* arena_get_stats() {
+    return &stats;
+}
+
+// Start an empty string in the arena
+void strbuf_init(strbuf_t* sb, arena_t* arena, size_t initial) {
+    sb->arena = arena;
+    sb->cap = initial < 16 ? 16 : initial;
+    sb->len = 0;
+    sb->data = arena_alloc(arena, sb->cap);
+    if (sb->data != NULL) {
+        sb->data[0] = '\0';
+    }
+}
+
+// Make room for at least extra more bytes plus the terminator
+static int strbuf_reserve(strbuf_t* sb, size_t extra) {
+    if (sb->data == NULL) {
+        return -1;
+    }
+    if (sb->len + extra + 1 <= sb->cap) {
+        return 0;
+    }
+    size_t cap = sb->cap * 2;
+    while (cap < sb->len + extra + 1) cap *= 2;
+
+    char* grown = arena_extend(sb->arena, sb->data, sb->cap, cap);
+    if (grown == NULL) {
+        return -1;
+    }
+    sb->data = grown;
+    sb->cap = cap;
+    return 0;
+}
+
+// Append len bytes
+void strbuf_append(strbuf_t* sb, const char* str, size_t len) {
+    if (strbuf_reserve(sb, len) < 0) return;
+    memcpy(sb->data + sb->len, str, len);
+    sb->len += len;
+    sb->data[sb->len] = '\0';
+}
+
+// Append one character
+void strbuf_putc(strbuf_t* sb, char c) {
+    if (strbuf_reserve(sb, 1) < 0) return;
+    sb->data[sb->len++] = c;
+    sb->data[sb->len] = '\0';
+}
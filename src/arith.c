@@ -0,0 +1,424 @@
+#include "shell.h"
+#include <limits.h>
+
+// Shell arithmetic for (( )), $(( )) and C-style for loops. An expression
+// is parsed once into a small tree (precedence climbing) allocated in an
+// arena; evaluating the tree only looks variables up by name, so a loop
+// condition is never re-parsed.
+//
+// Supported, in order of increasing precedence:
+//   = += -= *= /= %=   ?:   ||   &&   == !=   < <= > >=   + -   * / %
+//   unary ! - + and prefix/postfix ++ --, parentheses, numbers, names
+//   (with or without a leading $, or as ${name}) and $1..$9, $#
+
+enum {
+    ARITH_NUM = 1,
+    ARITH_VAR,
+    ARITH_NEG,
+    ARITH_NOT,
+    ARITH_PRE_INC,
+    ARITH_PRE_DEC,
+    ARITH_POST_INC,
+    ARITH_POST_DEC,
+    ARITH_ADD,
+    ARITH_SUB,
+    ARITH_MUL,
+    ARITH_DIV,
+    ARITH_MOD,
+    ARITH_LT,
+    ARITH_LE,
+    ARITH_GT,
+    ARITH_GE,
+    ARITH_EQ,
+    ARITH_NE,
+    ARITH_AND,
+    ARITH_OR,
+    ARITH_COND,
+    ARITH_ASSIGN,      // value is the compound operator (0 for plain =)
+    ARITH_COMMA
+};
+
+typedef struct {
+    const char* pos;
+    const char* end;
+    arena_t* arena;
+    int error;
+} arith_parser_t;
+
+// Binary operators: text, node type and precedence (higher binds tighter)
+typedef struct {
+    const char* text;
+    int op;
+    int prec;
+} arith_binop_t;
+
+static const arith_binop_t binops[] = {
+    { "||", ARITH_OR, 1 },
+    { "&&", ARITH_AND, 2 },
+    { "==", ARITH_EQ, 3 }, { "!=", ARITH_NE, 3 },
+    { "<=", ARITH_LE, 4 }, { ">=", ARITH_GE, 4 },
+    { "<", ARITH_LT, 4 }, { ">", ARITH_GT, 4 },
+    { "+", ARITH_ADD, 5 }, { "-", ARITH_SUB, 5 },
+    { "*", ARITH_MUL, 6 }, { "/", ARITH_DIV, 6 }, { "%", ARITH_MOD, 6 },
+    { NULL, 0, 0 }
+};
+
+static arith_node_t* parse_assign(arith_parser_t* p);
+
+static void skip_space(arith_parser_t* p) {
+    while (p->pos < p->end && (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\n')) {
+        p->pos++;
+    }
+}
+
+// Consume text if it comes next
+static int accept(arith_parser_t* p, const char* text) {
+    skip_space(p);
+    size_t len = strlen(text);
+    if ((size_t)(p->end - p->pos) >= len && strncmp(p->pos, text, len) == 0) {
+        p->pos += len;
+        return 1;
+    }
+    return 0;
+}
+
+static void arith_error(arith_parser_t* p, const char* message) {
+    if (!p->error) {
+        fprintf(stderr, "arithmetic: %s (near \"%.*s\")\n", message,
+                (int)(p->end - p->pos), p->pos);
+    }
+    p->error = 1;
+}
+
+static arith_node_t* new_arith(arith_parser_t* p, int op, arith_node_t* left,
+                               arith_node_t* right) {
+    arith_node_t* node = arena_alloc(p->arena, sizeof(arith_node_t));
+    if (node == NULL) {
+        p->error = 1;
+        return NULL;
+    }
+    memset(node, 0, sizeof(arith_node_t));
+    node->op = op;
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+static int is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// Number, name, ( expr ), or a unary operator applied to one of those
+static arith_node_t* parse_unary(arith_parser_t* p) {
+    skip_space(p);
+    if (p->pos >= p->end) {
+        arith_error(p, "operand expected");
+        return NULL;
+    }
+
+    if (accept(p, "++") || accept(p, "--")) {
+        int op = p->pos[-1] == '+' ? ARITH_PRE_INC : ARITH_PRE_DEC;
+        arith_node_t* operand = parse_unary(p);
+        if (operand == NULL) return NULL;
+        if (operand->op != ARITH_VAR) {
+            arith_error(p, "variable expected");
+            return NULL;
+        }
+        return new_arith(p, op, operand, NULL);
+    }
+    if (accept(p, "!")) {
+        arith_node_t* operand = parse_unary(p);
+        return operand ? new_arith(p, ARITH_NOT, operand, NULL) : NULL;
+    }
+    if (accept(p, "-")) {
+        arith_node_t* operand = parse_unary(p);
+        return operand ? new_arith(p, ARITH_NEG, operand, NULL) : NULL;
+    }
+    if (accept(p, "+")) {
+        return parse_unary(p);
+    }
+
+    arith_node_t* node;
+    if (accept(p, "(")) {
+        node = parse_assign(p);
+        if (node == NULL) return NULL;
+        if (!accept(p, ")")) {
+            arith_error(p, "missing `)'");
+            return NULL;
+        }
+    } else if (*p->pos >= '0' && *p->pos <= '9') {
+        char* end;
+        long value = strtol(p->pos, &end, 0);
+        if (end > p->end || is_name_start(*end)) {
+            arith_error(p, "invalid number");
+            return NULL;
+        }
+        p->pos = end;
+        node = new_arith(p, ARITH_NUM, NULL, NULL);
+        if (node) node->value = value;
+    } else {
+        // name, $name, ${name}, or a parameter such as $1, $# or $?
+        const char* name = p->pos;
+        int dollar = *name == '$';
+        int braced = dollar && name + 1 < p->end && name[1] == '{';
+        name += dollar + braced;
+        const char* end = name;
+        if (end < p->end && is_name_start(*end)) {
+            while (end < p->end && (is_name_start(*end) || (*end >= '0' && *end <= '9'))) end++;
+        } else if (dollar && end < p->end && (*end == '#' || *end == '?')) {
+            end++;
+        } else if (dollar) {
+            while (end < p->end && *end >= '0' && *end <= '9' && (braced || end == name)) end++;
+        }
+        if (end == name || (braced && (end >= p->end || *end != '}'))) {
+            arith_error(p, "syntax error");
+            return NULL;
+        }
+        node = new_arith(p, ARITH_VAR, NULL, NULL);
+        if (node) node->name = arena_strndup(p->arena, name, end - name);
+        p->pos = end + braced;
+    }
+    if (node == NULL) return NULL;
+
+    // Postfix ++ / -- on a name
+    if (node->op == ARITH_VAR) {
+        if (accept(p, "++")) return new_arith(p, ARITH_POST_INC, node, NULL);
+        if (accept(p, "--")) return new_arith(p, ARITH_POST_DEC, node, NULL);
+    }
+    return node;
+}
+
+// Binary operators of at least min_prec, by precedence climbing
+static arith_node_t* parse_binary(arith_parser_t* p, int min_prec) {
+    arith_node_t* left = parse_unary(p);
+    while (left != NULL) {
+        skip_space(p);
+        const arith_binop_t* found = NULL;
+        for (const arith_binop_t* b = binops; b->text != NULL; b++) {
+            size_t len = strlen(b->text);
+            if ((size_t)(p->end - p->pos) >= len && strncmp(p->pos, b->text, len) == 0 &&
+                // "<" must not take the first half of "<=" etc. (longer
+                // operators are listed first), and "=" after it means an
+                // assignment operator such as "+="
+                !(len == 1 && p->pos + 1 < p->end && p->pos[1] == '=')) {
+                found = b;
+                break;
+            }
+        }
+        if (found == NULL || found->prec < min_prec) {
+            break;
+        }
+        p->pos += strlen(found->text);
+        arith_node_t* right = parse_binary(p, found->prec + 1);
+        if (right == NULL) return NULL;
+        left = new_arith(p, found->op, left, right);
+    }
+    return left;
+}
+
+// cond ? a : b
+static arith_node_t* parse_conditional(arith_parser_t* p) {
+    arith_node_t* cond = parse_binary(p, 1);
+    if (cond == NULL || !accept(p, "?")) {
+        return cond;
+    }
+    arith_node_t* then_part = parse_assign(p);
+    if (then_part == NULL) return NULL;
+    if (!accept(p, ":")) {
+        arith_error(p, "`:' expected");
+        return NULL;
+    }
+    arith_node_t* else_part = parse_conditional(p);
+    if (else_part == NULL) return NULL;
+    arith_node_t* node = new_arith(p, ARITH_COND, cond, then_part);
+    if (node) node->extra = else_part;
+    return node;
+}
+
+// name = expr, name += expr, ... (right associative)
+static arith_node_t* parse_assign(arith_parser_t* p) {
+    arith_node_t* left = parse_conditional(p);
+    if (left == NULL || left->op != ARITH_VAR) {
+        return left;
+    }
+
+    static const struct { const char* text; int op; } assigns[] = {
+        { "+=", ARITH_ADD }, { "-=", ARITH_SUB }, { "*=", ARITH_MUL },
+        { "/=", ARITH_DIV }, { "%=", ARITH_MOD }, { NULL, 0 }
+    };
+    int op = -1;
+    for (int i = 0; assigns[i].text != NULL; i++) {
+        if (accept(p, assigns[i].text)) {
+            op = assigns[i].op;
+            break;
+        }
+    }
+    skip_space(p);
+    if (op < 0 && p->pos < p->end && *p->pos == '=' &&
+        !(p->pos + 1 < p->end && p->pos[1] == '=')) {
+        p->pos++;
+        op = 0;
+    }
+    if (op < 0) {
+        return left;
+    }
+
+    arith_node_t* right = parse_assign(p);
+    if (right == NULL) return NULL;
+    arith_node_t* node = new_arith(p, ARITH_ASSIGN, left, right);
+    if (node) node->value = op;
+    return node;
+}
+
+// Parse the expression in text[0..len). Comma-separated expressions are
+// evaluated in order. Returns NULL after reporting a syntax error; an
+// empty expression parses to the number 0.
+arith_node_t* arith_parse(const char* text, size_t len, arena_t* arena) {
+    arith_parser_t p = { text, text + len, arena, 0 };
+
+    skip_space(&p);
+    if (p.pos == p.end) {
+        arith_node_t* zero = new_arith(&p, ARITH_NUM, NULL, NULL);
+        return zero;
+    }
+
+    arith_node_t* node = parse_assign(&p);
+    while (node != NULL && accept(&p, ",")) {
+        arith_node_t* next = parse_assign(&p);
+        node = next ? new_arith(&p, ARITH_COMMA, node, next) : NULL;
+    }
+    skip_space(&p);
+    if (node != NULL && p.pos < p.end) {
+        arith_error(&p, "syntax error");
+    }
+    return p.error ? NULL : node;
+}
+
+// Copy a parsed expression into another arena (for function bodies)
+arith_node_t* arith_copy(const arith_node_t* node, arena_t* arena) {
+    if (node == NULL) {
+        return NULL;
+    }
+    arith_node_t* copy = arena_alloc(arena, sizeof(arith_node_t));
+    if (copy == NULL) {
+        return NULL;
+    }
+    *copy = *node;
+    if (node->name != NULL) {
+        copy->name = arena_strndup(arena, node->name, strlen(node->name));
+        if (copy->name == NULL) return NULL;
+    }
+    copy->left = arith_copy(node->left, arena);
+    copy->right = arith_copy(node->right, arena);
+    copy->extra = arith_copy(node->extra, arena);
+    if ((node->left && !copy->left) || (node->right && !copy->right) ||
+        (node->extra && !copy->extra)) {
+        return NULL;
+    }
+    return copy;
+}
+
+// Value of a variable as a number (unset or empty is 0)
+static long variable_value(const char* name) {
+    const char* value = get_variable(name);
+    return value ? strtol(value, NULL, 0) : 0;
+}
+
+static void store_variable(const char* name, long value) {
+    char digits[24];
+    snprintf(digits, sizeof(digits), "%ld", value);
+    set_variable(name, digits);
+}
+
+// Evaluate a parsed expression. Returns -1 after reporting an error
+// (division by zero).
+int arith_eval(arith_node_t* node, long* result) {
+    long a = 0, b = 0;
+
+    switch (node->op) {
+        case ARITH_NUM:
+            *result = node->value;
+            return 0;
+        case ARITH_VAR:
+            *result = variable_value(node->name);
+            return 0;
+
+        case ARITH_PRE_INC:
+        case ARITH_PRE_DEC:
+        case ARITH_POST_INC:
+        case ARITH_POST_DEC: {
+            long old = variable_value(node->left->name);
+            long updated = old + ((node->op == ARITH_PRE_INC || node->op == ARITH_POST_INC) ? 1 : -1);
+            store_variable(node->left->name, updated);
+            *result = (node->op == ARITH_PRE_INC || node->op == ARITH_PRE_DEC) ? updated : old;
+            return 0;
+        }
+
+        case ARITH_AND:
+        case ARITH_OR:
+            // Short-circuit: the right side only runs when needed
+            if (arith_eval(node->left, &a) < 0) return -1;
+            if ((node->op == ARITH_AND) == (a != 0)) {
+                if (arith_eval(node->right, &b) < 0) return -1;
+                *result = b != 0;
+            } else {
+                *result = a != 0;
+            }
+            return 0;
+
+        case ARITH_COND:
+            if (arith_eval(node->left, &a) < 0) return -1;
+            return arith_eval(a ? node->right : node->extra, result);
+
+        case ARITH_ASSIGN:
+            if (arith_eval(node->right, &b) < 0) return -1;
+            if (node->value != 0) {
+                // Compound assignment: apply the operator to the old value
+                arith_node_t op = { .op = (int)node->value };
+                arith_node_t lhs = { .op = ARITH_NUM, .value = variable_value(node->left->name) };
+                arith_node_t rhs = { .op = ARITH_NUM, .value = b };
+                op.left = &lhs;
+                op.right = &rhs;
+                if (arith_eval(&op, &b) < 0) return -1;
+            }
+            store_variable(node->left->name, b);
+            *result = b;
+            return 0;
+
+        default:
+            break;
+    }
+
+    if (arith_eval(node->left, &a) < 0) return -1;
+    if (node->right != NULL && arith_eval(node->right, &b) < 0) return -1;
+
+    switch (node->op) {
+        case ARITH_NEG:   *result = -a; break;
+        case ARITH_NOT:   *result = !a; break;
+        case ARITH_ADD:   *result = a + b; break;
+        case ARITH_SUB:   *result = a - b; break;
+        case ARITH_MUL:   *result = a * b; break;
+        case ARITH_DIV:
+        case ARITH_MOD:
+            if (b == 0) {
+                fprintf(stderr, "arithmetic: division by zero\n");
+                return -1;
+            }
+            if (a == LONG_MIN && b == -1) {
+                // Overflows (and traps with SIGFPE on x86); wrap instead
+                *result = node->op == ARITH_DIV ? LONG_MIN : 0;
+                break;
+            }
+            *result = node->op == ARITH_DIV ? a / b : a % b;
+            break;
+        case ARITH_LT:    *result = a < b; break;
+        case ARITH_LE:    *result = a <= b; break;
+        case ARITH_GT:    *result = a > b; break;
+        case ARITH_GE:    *result = a >= b; break;
+        case ARITH_EQ:    *result = a == b; break;
+        case ARITH_NE:    *result = a != b; break;
+        case ARITH_COMMA: *result = b; break;
+        default:          *result = 0; break;
+    }
+    return 0;
+}
@@ -1,9 +1,24 @@
 #include "shell.h"
+#include <limits.h>
 
 // Built-in command: exit
 int builtin_exit(char** arglist) {
-    printf("Shell terminated.\n");
-    exit(0);
+    // exit [n]; without n the status is that of the last command
+    int status = get_last_status();
+    if (arglist[1] != NULL) {
+        char* end;
+        status = (int)strtol(arglist[1], &end, 10);
+        if (*end != '\0') {
+            fprintf(stderr, "exit: %s: numeric argument required\n", arglist[1]);
+            status = 2;
+        }
+    }
+    // Only a shell at the prompt says goodbye; a script's or subshell's
+    // stdout is its data
+    if (interactive_shell()) {
+        printf("Shell terminated.\n");
+    }
+    exit(status & 0xff);
 }
 
 // Built-in command: cd
@@ -40,11 +55,29 @@ int builtin_cd(char** arglist) {
 int builtin_help(char** arglist) {
     printf("Built-in commands:\n");
     printf("  cd <directory>    - Change current working directory\n");
-    printf("  exit              - Terminate the shell\n");
+    printf("  exit [n]          - Terminate the shell with status n (default $?)\n");
     printf("  help              - Display this help message\n");
-    printf("  history           - Display command history\n");
+    printf("  history [-s pat]  - Display command history, or entries containing pat\n");
     printf("  jobs              - Display background jobs\n");
     printf("  set               - Display all variables\n");  // FIXED: Added set command
+    printf("  hash [-r] [name]  - Show, reset or add remembered command paths\n");
+    printf("  export [NAME[=v]] - Export variables to child processes\n");
+    printf("  fg [%%job]         - Resume a job in the foreground\n");
+    printf("  bg [%%job]         - Resume a stopped job in the background\n");
+    printf("  kill [-sig] %%job  - Send a signal to a job or process\n");
+    printf("  disown [%%job]     - Stop tracking a job\n");
+    printf("  wait [%%job]       - Wait for background jobs to finish\n");
+    printf("  break [n]         - Leave the n innermost loops\n");
+    printf("  continue [n]      - Resume the next iteration of the n-th loop\n");
+    printf("  return [n]        - Leave the current function with status n\n");
+    printf("  local NAME[=v]    - Make a variable local to the current function\n");
+    printf("  unset [-f] name   - Remove variables (or functions with -f)\n");
+    printf("  echo [-neE] args  - Print arguments\n");
+    printf("  printf fmt args   - Print arguments under control of a format\n");
+    printf("  pwd               - Print the current directory\n");
+    printf("  test expr, [ ]    - Evaluate a file, string or integer test\n");
+    printf("  true, false, :    - Do nothing, successfully or not\n");
+    printf("  parallel [-j N] cmd [::: items] - Run cmd per item (or stdin line), N at a time\n");
     return 0;
 }
 
@@ -56,6 +89,14 @@ int builtin_jobs(char** arglist) {
 
 // Built-in command: history
 int builtin_history(char** arglist) {
+    if (arglist[1] != NULL && strcmp(arglist[1], "-s") == 0) {
+        if (arglist[2] == NULL) {
+            fprintf(stderr, "history: usage: history [-s pattern]\n");
+            return 1;
+        }
+        // Status 1 when nothing matched, like grep
+        return print_history_matches(arglist[2]) > 0 ? 0 : 1;
+    }
     print_history();
     return 0;
 }
@@ -66,31 +107,398 @@ int builtin_set(char** arglist) {
     return 0;
 }
 
-// Main built-in command handler
-int handle_builtin(char** arglist) {
-    if (arglist[0] == NULL) {
-        return 0; // No command
+// Built-in command: hash (list, reset or add remembered command paths)
+int builtin_hash(char** arglist) {
+    if (arglist[1] == NULL) {
+        hash_print();
+        return 0;
+    }
+    if (strcmp(arglist[1], "-r") == 0) {
+        hash_reset();
+        return 0;
     }
 
-    if (strcmp(arglist[0], "exit") == 0) {
-        builtin_exit(arglist);
-        return 1;
-    } else if (strcmp(arglist[0], "cd") == 0) {
-        builtin_cd(arglist);
-        return 1;
-    } else if (strcmp(arglist[0], "help") == 0) {
-        builtin_help(arglist);
-        return 1;
-    } else if (strcmp(arglist[0], "jobs") == 0) {
-        builtin_jobs(arglist);
-        return 1;
-    } else if (strcmp(arglist[0], "history") == 0) {
-        builtin_history(arglist);
+    int result = 0;
+    for (int i = 1; arglist[i] != NULL; i++) {
+        if (hash_remember_command(arglist[i]) != 0) {
+            fprintf(stderr, "hash: %s: not found\n", arglist[i]);
+            result = 1;
+        }
+    }
+    return result;
+}
+
+// Built-in command: export (NAME[=value] ...)
+int builtin_export(char** arglist) {
+    if (arglist[1] == NULL) {
+        extern char** environ;
+        for (char** env = environ; *env != NULL; env++) {
+            printf("export %s\n", *env);
+        }
+        return 0;
+    }
+
+    int result = 0;
+    for (int i = 1; arglist[i] != NULL; i++) {
+        char* equal_sign = strchr(arglist[i], '=');
+        if (equal_sign != NULL) {
+            *equal_sign = '\0';
+            set_variable(arglist[i], equal_sign + 1);
+            if (export_variable(arglist[i]) != 0) {
+                fprintf(stderr, "export: %s: cannot export\n", arglist[i]);
+                result = 1;
+            }
+            *equal_sign = '=';
+        } else if (export_variable(arglist[i]) != 0) {
+            fprintf(stderr, "export: %s: cannot export\n", arglist[i]);
+            result = 1;
+        }
+    }
+    return result;
+}
+
+// Look up the job named by a job spec argument, reporting errors
+static job_t* job_from_arg(const char* builtin, const char* spec) {
+    job_t* job = find_job(spec);
+    if (job == NULL) {
+        fprintf(stderr, "%s: %s: no such job\n", builtin, spec ? spec : "current");
+    }
+    return job;
+}
+
+// Built-in command: fg [%job] (resume a job in the foreground)
+int builtin_fg(char** arglist) {
+    job_t* job = job_from_arg("fg", arglist[1]);
+    return job ? continue_job(job, 1) : 1;
+}
+
+// Built-in command: bg [%job] (resume a stopped job in the background)
+int builtin_bg(char** arglist) {
+    job_t* job = job_from_arg("bg", arglist[1]);
+    return job ? continue_job(job, 0) : 1;
+}
+
+// Signal names understood by kill
+static const struct {
+    const char* name;
+    int number;
+} signal_names[] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}, {"CHLD", SIGCHLD}, {"CONT", SIGCONT}, {"STOP", SIGSTOP},
+    {"TSTP", SIGTSTP}, {"TTIN", SIGTTIN}, {"TTOU", SIGTTOU}, {NULL, 0}
+};
+
+// Parse a signal given as a number, NAME or SIGNAME; -1 if unknown
+static int parse_signal(const char* str) {
+    if (*str >= '0' && *str <= '9') {
+        return atoi(str);
+    }
+    if (strncmp(str, "SIG", 3) == 0) {
+        str += 3;
+    }
+    for (int i = 0; signal_names[i].name != NULL; i++) {
+        if (strcmp(str, signal_names[i].name) == 0) {
+            return signal_names[i].number;
+        }
+    }
+    return -1;
+}
+
+// Built-in command: kill [-s SIG | -SIG] %job|pid ... (or kill -l)
+int builtin_kill(char** arglist) {
+    int sig = SIGTERM;
+    int i = 1;
+
+    if (arglist[1] != NULL && strcmp(arglist[1], "-l") == 0) {
+        for (int j = 0; signal_names[j].name != NULL; j++) {
+            printf("%2d) SIG%s\n", signal_names[j].number, signal_names[j].name);
+        }
+        return 0;
+    }
+    if (arglist[1] != NULL && strcmp(arglist[1], "-s") == 0) {
+        if (arglist[2] == NULL || (sig = parse_signal(arglist[2])) < 0) {
+            fprintf(stderr, "kill: invalid signal\n");
+            return 1;
+        }
+        i = 3;
+    } else if (arglist[1] != NULL && arglist[1][0] == '-') {
+        if ((sig = parse_signal(arglist[1] + 1)) < 0) {
+            fprintf(stderr, "kill: %s: invalid signal\n", arglist[1] + 1);
+            return 1;
+        }
+        i = 2;
+    }
+
+    if (arglist[i] == NULL) {
+        fprintf(stderr, "usage: kill [-s sig | -sig] %%job | pid ...\n");
         return 1;
-    } else if (strcmp(arglist[0], "set") == 0) {
-        builtin_set(arglist);
+    }
+
+    int result = 0;
+    for (; arglist[i] != NULL; i++) {
+        if (arglist[i][0] == '%') {
+            job_t* job = job_from_arg("kill", arglist[i]);
+            if (job == NULL) {
+                result = 1;
+                continue;
+            }
+            // Signal the whole process group, falling back to the leader
+            if (kill(-job->pgid, sig) < 0 && kill(job->pgid, sig) < 0) {
+                perror("kill");
+                result = 1;
+            } else if (job->status == JOB_STOPPED && sig != SIGCONT &&
+                       sig != SIGSTOP && sig != SIGTSTP) {
+                kill(-job->pgid, SIGCONT); // So it can act on the signal
+            }
+        } else {
+            char* end;
+            long pid = strtol(arglist[i], &end, 10);
+            if (*end != '\0' || kill((pid_t)pid, sig) < 0) {
+                fprintf(stderr, "kill: %s: %s\n", arglist[i],
+                        *end != '\0' ? "arguments must be process or job IDs" : strerror(errno));
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
+
+// Built-in command: disown [-a | %job ...] (stop tracking jobs)
+int builtin_disown(char** arglist) {
+    if (arglist[1] != NULL && strcmp(arglist[1], "-a") == 0) {
+        job_t* job;
+        while ((job = find_job(NULL)) != NULL) {
+            remove_job(job);
+        }
+        return 0;
+    }
+    if (arglist[1] == NULL) {
+        job_t* job = job_from_arg("disown", NULL);
+        if (job == NULL) return 1;
+        remove_job(job);
+        return 0;
+    }
+
+    int result = 0;
+    for (int i = 1; arglist[i] != NULL; i++) {
+        job_t* job = job_from_arg("disown", arglist[i]);
+        if (job == NULL) {
+            result = 1;
+            continue;
+        }
+        remove_job(job);
+    }
+    return result;
+}
+
+// Built-in command: wait [%job | pid ...] (wait for background jobs)
+int builtin_wait(char** arglist) {
+    int result = 0;
+    if (arglist[1] == NULL) {
+        job_t* job;
+        while ((job = first_background_job()) != NULL) {
+            result = wait_for_background_job(job);
+        }
+        return result;
+    }
+
+    for (int i = 1; arglist[i] != NULL; i++) {
+        job_t* job = arglist[i][0] == '%' ? find_job(arglist[i])
+                                          : find_job_by_pid((pid_t)atol(arglist[i]));
+        if (job == NULL) {
+            fprintf(stderr, "wait: %s: no such job\n", arglist[i]);
+            result = 127;
+            continue;
+        }
+        result = wait_for_background_job(job);
+    }
+    return result;
+}
+
+// Built-in command: local NAME[=value] ...
+int builtin_local(char** arglist) {
+    int status = 0;
+    for (int i = 1; arglist[i] != NULL; i++) {
+        char* equal_sign = strchr(arglist[i], '=');
+        if (equal_sign != NULL) *equal_sign = '\0';
+
+        if (make_local(arglist[i]) < 0) {
+            fprintf(stderr, "local: can only be used in a function\n");
+            status = 1;
+        } else {
+            set_variable(arglist[i], equal_sign ? equal_sign + 1 : "");
+        }
+        if (equal_sign != NULL) *equal_sign = '=';
+        if (status != 0) break;
+    }
+    return status;
+}
+
+// Built-in command: unset [-f | -v] name ...
+int builtin_unset(char** arglist) {
+    int functions = 0;
+    int i = 1;
+    if (arglist[i] != NULL && (strcmp(arglist[i], "-f") == 0 || strcmp(arglist[i], "-v") == 0)) {
+        functions = arglist[i][1] == 'f';
+        i++;
+    }
+    for (; arglist[i] != NULL; i++) {
+        if (functions) {
+            unset_function(arglist[i]);
+        } else if (unset_variable(arglist[i]) < 0 && find_function(arglist[i]) != NULL) {
+            // Like other shells, fall back to a function of that name
+            unset_function(arglist[i]);
+        }
+    }
+    return 0;
+}
+
+// Built-in command: echo [-neE] [args...]
+int builtin_echo(char** arglist) {
+    int newline = 1, escapes = 0;
+    int i = 1;
+
+    // Options only count when every letter is one of n, e, E
+    for (; arglist[i] != NULL && arglist[i][0] == '-' && arglist[i][1] != '\0'; i++) {
+        const char* opt = arglist[i] + 1;
+        if (strspn(opt, "neE") != strlen(opt)) break;
+        for (; *opt; opt++) {
+            if (*opt == 'n') newline = 0;
+            else escapes = *opt == 'e';
+        }
+    }
+
+    for (int first = i; arglist[i] != NULL; i++) {
+        if (i > first) putchar(' ');
+        if (escapes) {
+            if (print_escaped(arglist[i], strlen(arglist[i])) > 0) {
+                return 0; // \c: stop all output
+            }
+        } else {
+            fputs(arglist[i], stdout);
+        }
+    }
+    if (newline) putchar('\n');
+    return 0;
+}
+
+// Built-in command: printf format [args...]
+int builtin_printf(char** arglist) {
+    if (arglist[1] == NULL) {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    return format_output(arglist[1], arglist + 2);
+}
+
+// Built-in commands: true and :
+int builtin_true(char** arglist) {
+    return 0;
+}
+
+// Built-in command: false
+int builtin_false(char** arglist) {
+    return 1;
+}
+
+// Built-in command: pwd
+int builtin_pwd(char** arglist) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("pwd");
         return 1;
     }
+    puts(cwd);
+    return 0;
+}
+
+// All built-ins, in the order help and completion list them
+static const struct {
+    const char* name;
+    builtin_fn fn;
+} builtins[] = {
+    { "exit", builtin_exit },
+    { "cd", builtin_cd },
+    { "help", builtin_help },
+    { "jobs", builtin_jobs },
+    { "history", builtin_history },
+    { "set", builtin_set },
+    { "hash", builtin_hash },
+    { "export", builtin_export },
+    { "fg", builtin_fg },
+    { "bg", builtin_bg },
+    { "kill", builtin_kill },
+    { "disown", builtin_disown },
+    { "wait", builtin_wait },
+    { "break", builtin_break },
+    { "continue", builtin_continue },
+    { "return", builtin_return },
+    { "local", builtin_local },
+    { "unset", builtin_unset },
+    { "echo", builtin_echo },
+    { "printf", builtin_printf },
+    { "true", builtin_true },
+    { "false", builtin_false },
+    { "pwd", builtin_pwd },
+    { "test", builtin_test },
+    { "[", builtin_test },
+    { ":", builtin_true },
+    { "parallel", builtin_parallel },
+    { NULL, NULL }
+};
 
-    return 0; // Not a built-in command
+// Perfect hash of the names above: every name gets its own slot, so a
+// lookup is one hash, one table read and one strcmp. The slot values are
+// 1-based indexes into builtins[] (0 = no built-in hashes there). They
+// were generated offline; when adding a built-in, pick new multipliers
+// if its slot collides and regenerate the table.
+#define BUILTIN_SLOTS 64
+
+static unsigned int builtin_hash_name(const char* name, size_t len) {
+    return ((unsigned char)name[0] + 17u * (unsigned char)name[len - 1] + 33u * len) &
+           (BUILTIN_SLOTS - 1);
+}
+
+static const unsigned char builtin_slots[BUILTIN_SLOTS] = {
+    [0] = 22, [6] = 16, [7] = 25, [8] = 19, [9] = 2, [10] = 6, [14] = 18,
+    [17] = 4, [20] = 7, [24] = 5, [27] = 11, [28] = 3, [29] = 1,
+    [31] = 8, [32] = 15, [34] = 14, [36] = 27, [44] = 24, [45] = 21,
+    [47] = 13, [53] = 26, [55] = 23, [56] = 12, [59] = 10, [60] = 20,
+    [61] = 17, [63] = 9,
+};
+
+// Name of the i-th built-in, or NULL past the end (for completion)
+const char* builtin_name(int i) {
+    return builtins[i].name;
+}
+
+// Look up a built-in by name. Returns its function, or NULL.
+builtin_fn find_builtin(const char* name) {
+    if (name == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    int index = builtin_slots[builtin_hash_name(name, strlen(name))];
+    if (index == 0 || strcmp(builtins[index - 1].name, name) != 0) {
+        return NULL;
+    }
+    return builtins[index - 1].fn;
+}
+
+// Check whether a command is a built-in without running it
+int is_builtin_command(char** arglist) {
+    return arglist != NULL && find_builtin(arglist[0]) != NULL;
+}
+
+// Run a built-in command. Returns its exit status, or -1 if arglist does
+// not name a built-in. Output is flushed so it lands before that of any
+// command run after it.
+int handle_builtin(char** arglist) {
+    builtin_fn fn = find_builtin(arglist[0]);
+    if (fn == NULL) {
+        return -1;
+    }
+    int status = fn(arglist);
+    fflush(stdout);
+    return status;
 }
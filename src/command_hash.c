@@ -0,0 +1,265 @@
+#include "shell.h"
+#include <time.h>
+
+// Remembered location of a command name found (or not found) on $PATH
+typedef struct cmd_entry {
+    char* name;
+    char* path;              // Absolute path, NULL for a remembered miss
+    int dir_index;           // Index of the PATH directory it was found in
+    int hits;                // Number of times the entry was used
+    struct cmd_entry* next;  // Next entry in the same bucket
+} cmd_entry_t;
+
+// A $PATH directory and the mtime it had when the table was filled
+typedef struct {
+    char* dir;
+    struct timespec mtime;
+    int exists;
+} path_dir_t;
+
+#define CMD_HASH_BUCKETS 256
+#define PATH_RECHECK_SECONDS 1  // Minimum interval between mtime checks for hits
+
+static cmd_entry_t* buckets[CMD_HASH_BUCKETS];
+static path_dir_t* path_dirs = NULL;
+static int path_dir_count = -1;      // -1 until PATH has been split
+static int path_has_relative = 0;    // Relative entries depend on the cwd
+static time_t last_check = 0;
+
+// FNV-1a string hash
+static unsigned int hash_name(const char* name) {
+    unsigned int h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h % CMD_HASH_BUCKETS;
+}
+
+// Drop entries matching the filter: all, misses, or those found at or
+// after a given PATH directory (a new binary earlier on PATH shadows them)
+static void flush_entries(int from_dir, int all) {
+    for (int b = 0; b < CMD_HASH_BUCKETS; b++) {
+        cmd_entry_t** link = &buckets[b];
+        while (*link != NULL) {
+            cmd_entry_t* e = *link;
+            if (all || e->path == NULL || e->dir_index >= from_dir) {
+                *link = e->next;
+                free(e->name);
+                free(e->path);
+                free(e);
+            } else {
+                link = &e->next;
+            }
+        }
+    }
+}
+
+static void stat_dir(path_dir_t* pd) {
+    struct stat st;
+    if (stat(pd->dir, &st) == 0) {
+        pd->mtime = st.st_mtim;
+        pd->exists = 1;
+    } else {
+        pd->exists = 0;
+    }
+}
+
+static void free_path_dirs() {
+    for (int i = 0; i < path_dir_count; i++) {
+        free(path_dirs[i].dir);
+    }
+    free(path_dirs);
+    path_dirs = NULL;
+    path_dir_count = -1;
+    path_has_relative = 0;
+}
+
+// Split $PATH into directories and record their current mtimes
+static void load_path_dirs() {
+    const char* path = get_variable("PATH");
+    if (path == NULL) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+
+    int count = 1;
+    for (const char* p = path; *p; p++) {
+        if (*p == ':') count++;
+    }
+
+    path_dirs = calloc(count, sizeof(path_dir_t));
+    path_dir_count = 0;
+    if (path_dirs == NULL) {
+        return;
+    }
+
+    const char* start = path;
+    while (1) {
+        const char* end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+
+        // An empty entry means the current directory
+        path_dir_t* pd = &path_dirs[path_dir_count++];
+        pd->dir = len ? strndup(start, len) : strdup(".");
+        if (pd->dir[0] != '/') {
+            path_has_relative = 1;
+        }
+        stat_dir(pd);
+
+        if (end == NULL) break;
+        start = end + 1;
+    }
+    last_check = time(NULL);
+}
+
+// Re-stat the PATH directories and drop entries that may have changed.
+// Unless forced, this runs at most once per PATH_RECHECK_SECONDS.
+static void revalidate(int force) {
+    time_t now = time(NULL);
+    if (!force && now - last_check < PATH_RECHECK_SECONDS) {
+        return;
+    }
+    last_check = now;
+
+    for (int i = 0; i < path_dir_count; i++) {
+        path_dir_t old = path_dirs[i];
+        stat_dir(&path_dirs[i]);
+        if (old.exists != path_dirs[i].exists ||
+            old.mtime.tv_sec != path_dirs[i].mtime.tv_sec ||
+            old.mtime.tv_nsec != path_dirs[i].mtime.tv_nsec) {
+            flush_entries(i, 0);
+            return;
+        }
+    }
+}
+
+// Walk the PATH directories looking for an executable regular file
+static char* search_path(const char* name, int* dir_index) {
+    size_t name_len = strlen(name);
+    for (int i = 0; i < path_dir_count; i++) {
+        if (!path_dirs[i].exists) continue;
+
+        size_t dir_len = strlen(path_dirs[i].dir);
+        char* candidate = malloc(dir_len + name_len + 2);
+        if (candidate == NULL) return NULL;
+        memcpy(candidate, path_dirs[i].dir, dir_len);
+        candidate[dir_len] = '/';
+        memcpy(candidate + dir_len + 1, name, name_len + 1);
+
+        struct stat st;
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate, X_OK) == 0) {
+            *dir_index = i;
+            return candidate;
+        }
+        free(candidate);
+    }
+    *dir_index = path_dir_count;
+    return NULL;
+}
+
+static cmd_entry_t* find_entry(const char* name, unsigned int b) {
+    for (cmd_entry_t* e = buckets[b]; e != NULL; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// Resolve a command name to an absolute path, using the hash table.
+// Names containing a slash are returned unchanged. Returns NULL if the
+// command is not on PATH. The result stays valid until the table changes.
+const char* hash_lookup_command(const char* name) {
+    if (name == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+
+    if (path_dir_count < 0) {
+        load_path_dirs();
+    }
+
+    // A remembered location is rechecked at most once a second, but a
+    // miss always is: "not found" must not outlive the new binary
+    unsigned int b = hash_name(name);
+    cmd_entry_t* e = find_entry(name, b);
+    revalidate(e == NULL || e->path == NULL);
+    e = find_entry(name, b);  // May have been flushed
+    if (e != NULL) {
+        e->hits++;
+        return e->path;
+    }
+
+    int dir_index;
+    char* path = search_path(name, &dir_index);
+
+    // Results that depend on the current directory are never remembered
+    if (path_has_relative &&
+        (path == NULL || path_dirs[dir_index].dir[0] != '/')) {
+        static char* uncached = NULL;
+        free(uncached);
+        uncached = path;
+        return path;
+    }
+
+    e = malloc(sizeof(cmd_entry_t));
+    if (e == NULL) {
+        free(path);
+        return NULL;
+    }
+    e->name = strdup(name);
+    e->path = path;
+    e->dir_index = dir_index;
+    e->hits = 1;
+    e->next = buckets[b];
+    buckets[b] = e;
+    return path;
+}
+
+// Add a command to the table without running it. Returns 0 if found.
+int hash_remember_command(const char* name) {
+    return hash_lookup_command(name) != NULL ? 0 : -1;
+}
+
+// Forget a single command, e.g. after its cached binary disappeared
+void hash_forget_command(const char* name) {
+    unsigned int b = hash_name(name);
+    cmd_entry_t** link = &buckets[b];
+    while (*link != NULL) {
+        cmd_entry_t* e = *link;
+        if (strcmp(e->name, name) == 0) {
+            *link = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+// Forget everything, including the split PATH (called when PATH changes)
+void hash_reset() {
+    flush_entries(0, 1);
+    free_path_dirs();
+}
+
+// Print remembered locations (misses are not listed)
+void hash_print() {
+    int found = 0;
+    for (int b = 0; b < CMD_HASH_BUCKETS; b++) {
+        for (cmd_entry_t* e = buckets[b]; e != NULL; e = e->next) {
+            if (e->path == NULL) continue;
+            if (!found) {
+                printf("hits\tcommand\n");
+                found = 1;
+            }
+            printf("%4d\t%s\n", e->hits, e->path);
+        }
+    }
+    if (!found) {
+        printf("hash: hash table empty\n");
+    }
+}
@@ -0,0 +1,317 @@
+#include "shell.h"
+#include <fnmatch.h>
+
+// Conditional expressions, evaluated in the shell process: the test and
+// [ built-ins, and [[ ... ]] commands. test arguments are interpreted by
+// count as POSIX specifies for up to four of them, and by a small
+// grammar (! -a -o and parentheses) beyond that. [[ ]] is parsed once by
+// the parser into a cond_node_t tree; only its words are expanded when
+// it runs, without field splitting.
+
+// Integer operand of a comparison. Sets *error for anything else.
+static long integer_operand(const char* arg, int* error) {
+    char* end;
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (*arg == '\0' || *end != '\0' || errno != 0) {
+        fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        *error = 1;
+    }
+    return value;
+}
+
+// Whether op is a unary test operator
+int is_unary_test(const char* op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' &&
+           strchr("bcdefghLnprsStuwxz", op[1]) != NULL;
+}
+
+// Binary test operators (string, integer and file comparisons)
+static const char* binary_ops[] = {
+    "=", "==", "!=", "<", ">",
+    "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+    "-nt", "-ot", "-ef", NULL
+};
+
+// Whether op is a binary test operator
+int is_binary_test(const char* op) {
+    for (int i = 0; binary_ops[i] != NULL; i++) {
+        if (strcmp(op, binary_ops[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// Evaluate a unary test: 0 true, 1 false
+static int unary_test(char op, const char* arg) {
+    struct stat st;
+    switch (op) {
+        case 'z': return arg[0] == '\0' ? 0 : 1;
+        case 'n': return arg[0] != '\0' ? 0 : 1;
+        case 't': return isatty(atoi(arg)) ? 0 : 1;
+        case 'r': return access(arg, R_OK) == 0 ? 0 : 1;
+        case 'w': return access(arg, W_OK) == 0 ? 0 : 1;
+        case 'x': return access(arg, X_OK) == 0 ? 0 : 1;
+        case 'h':
+        case 'L': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode) ? 0 : 1;
+        default:  break;
+    }
+
+    if (stat(arg, &st) < 0) {
+        return 1;
+    }
+    switch (op) {
+        case 'e': return 0;
+        case 'f': return S_ISREG(st.st_mode) ? 0 : 1;
+        case 'd': return S_ISDIR(st.st_mode) ? 0 : 1;
+        case 'b': return S_ISBLK(st.st_mode) ? 0 : 1;
+        case 'c': return S_ISCHR(st.st_mode) ? 0 : 1;
+        case 'p': return S_ISFIFO(st.st_mode) ? 0 : 1;
+        case 'S': return S_ISSOCK(st.st_mode) ? 0 : 1;
+        case 's': return st.st_size > 0 ? 0 : 1;
+        case 'g': return st.st_mode & S_ISGID ? 0 : 1;
+        case 'u': return st.st_mode & S_ISUID ? 0 : 1;
+    }
+    return 1;
+}
+
+// Whether file a is newer than file b. A missing file is older than any
+// existing one.
+static int is_newer(const char* a, const char* b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) < 0) return 0;
+    if (stat(b, &sb) < 0) return 1;
+    return sa.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+           (sa.st_mtim.tv_sec == sb.st_mtim.tv_sec && sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec);
+}
+
+// -ef: both names refer to the same file
+static int same_file(const char* a, const char* b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 &&
+           sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// Evaluate a binary test: 0 true, 1 false, 2 bad operand (reported)
+static int binary_test(const char* left, const char* op, const char* right) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0 ? 0 : 1;
+    if (strcmp(op, "!=") == 0) return strcmp(left, right) != 0 ? 0 : 1;
+    if (strcmp(op, "<") == 0)  return strcmp(left, right) < 0 ? 0 : 1;
+    if (strcmp(op, ">") == 0)  return strcmp(left, right) > 0 ? 0 : 1;
+    if (strcmp(op, "-nt") == 0) return is_newer(left, right) ? 0 : 1;
+    if (strcmp(op, "-ot") == 0) return is_newer(right, left) ? 0 : 1;
+    if (strcmp(op, "-ef") == 0) return same_file(left, right) ? 0 : 1;
+
+    int error = 0;
+    long a = integer_operand(left, &error);
+    long b = integer_operand(right, &error);
+    if (error) return 2;
+
+    int result;
+    switch (op[1] * 256 + op[2]) {
+        case 'e' * 256 + 'q': result = a == b; break;
+        case 'n' * 256 + 'e': result = a != b; break;
+        case 'l' * 256 + 't': result = a < b; break;
+        case 'l' * 256 + 'e': result = a <= b; break;
+        case 'g' * 256 + 't': result = a > b; break;
+        default:              result = a >= b; break;
+    }
+    return result ? 0 : 1;
+}
+
+// Negate a test status, keeping errors
+static int negate(int status) {
+    return status == 2 ? 2 : !status;
+}
+
+// Combine two statuses with -a / && (and = 1) or -o / ||
+static int combine(int a, int b, int and) {
+    if (a == 2 || b == 2) return 2;
+    return and ? (a == 0 && b == 0 ? 0 : 1) : (a == 0 || b == 0 ? 0 : 1);
+}
+
+// test arguments being parsed by the grammar for longer expressions
+typedef struct {
+    char** args;
+    int count;
+    int pos;
+} test_parser_t;
+
+static int test_or(test_parser_t* t);
+
+static int at_arg(test_parser_t* t, const char* text) {
+    return t->pos < t->count && strcmp(t->args[t->pos], text) == 0;
+}
+
+// primary := '(' or ')' | '!' primary | unary-op arg | arg binary-op arg | arg
+static int test_primary(test_parser_t* t) {
+    if (t->pos >= t->count) {
+        fprintf(stderr, "test: argument expected\n");
+        return 2;
+    }
+    char** args = t->args + t->pos;
+    int left = t->count - t->pos;
+
+    if (strcmp(args[0], "!") == 0) {
+        t->pos++;
+        return negate(test_primary(t));
+    }
+    if (strcmp(args[0], "(") == 0) {
+        t->pos++;
+        int status = test_or(t);
+        if (!at_arg(t, ")")) {
+            fprintf(stderr, "test: `)' expected\n");
+            return 2;
+        }
+        t->pos++;
+        return status;
+    }
+    if (left >= 3 && is_binary_test(args[1])) {
+        t->pos += 3;
+        return binary_test(args[0], args[1], args[2]);
+    }
+    if (left >= 2 && is_unary_test(args[0])) {
+        t->pos += 2;
+        return unary_test(args[0][1], args[1]);
+    }
+    t->pos++;
+    return args[0][0] != '\0' ? 0 : 1;
+}
+
+static int test_and(test_parser_t* t) {
+    int status = test_primary(t);
+    while (status != 2 && at_arg(t, "-a")) {
+        t->pos++;
+        status = combine(status, test_primary(t), 1);
+    }
+    return status;
+}
+
+static int test_or(test_parser_t* t) {
+    int status = test_and(t);
+    while (status != 2 && at_arg(t, "-o")) {
+        t->pos++;
+        status = combine(status, test_and(t), 0);
+    }
+    return status;
+}
+
+// Evaluate test arguments: by count for up to four, else by the grammar
+static int evaluate(char** args, int count) {
+    switch (count) {
+        case 0:
+            return 1;
+        case 1:
+            return args[0][0] != '\0' ? 0 : 1;
+        case 2:
+            if (strcmp(args[0], "!") == 0) {
+                return negate(evaluate(args + 1, 1));
+            }
+            if (is_unary_test(args[0])) {
+                return unary_test(args[0][1], args[1]);
+            }
+            fprintf(stderr, "test: %s: unary operator expected\n", args[0]);
+            return 2;
+        case 3:
+            if (is_binary_test(args[1])) {
+                return binary_test(args[0], args[1], args[2]);
+            }
+            if (strcmp(args[1], "-a") == 0 || strcmp(args[1], "-o") == 0) {
+                return combine(evaluate(args, 1), evaluate(args + 2, 1), args[1][1] == 'a');
+            }
+            if (strcmp(args[0], "!") == 0) {
+                return negate(evaluate(args + 1, 2));
+            }
+            if (strcmp(args[0], "(") == 0 && strcmp(args[2], ")") == 0) {
+                return evaluate(args + 1, 1);
+            }
+            fprintf(stderr, "test: %s: binary operator expected\n", args[1]);
+            return 2;
+        case 4:
+            if (strcmp(args[0], "!") == 0) {
+                return negate(evaluate(args + 1, 3));
+            }
+            if (strcmp(args[0], "(") == 0 && strcmp(args[3], ")") == 0) {
+                return evaluate(args + 1, 2);
+            }
+            break;
+    }
+
+    test_parser_t t = { args, count, 0 };
+    int status = test_or(&t);
+    if (status != 2 && t.pos < count) {
+        fprintf(stderr, "test: %s: unexpected argument\n", args[t.pos]);
+        return 2;
+    }
+    return status;
+}
+
+// Built-in commands: test expr and [ expr ]. Status 0 if the expression
+// is true, 1 if false, 2 on error.
+int builtin_test(char** arglist) {
+    int count = 0;
+    while (arglist[count + 1] != NULL) count++;
+
+    if (strcmp(arglist[0], "[") == 0) {
+        if (count == 0 || strcmp(arglist[count], "]") != 0) {
+            fprintf(stderr, "[: missing `]'\n");
+            return 2;
+        }
+        count--;
+    }
+    return evaluate(arglist + 1, count);
+}
+
+// Whether a raw word has quoting, which makes a [[ == ]] pattern literal
+static int has_quotes(const char* word) {
+    return strpbrk(word, "'\"\\") != NULL;
+}
+
+// Evaluate a [[ ]] tree with words expanded into arena
+static int evaluate_cond(cond_node_t* node, arena_t* arena) {
+    switch (node->op) {
+        case COND_AND:
+        case COND_OR: {
+            // && and || short-circuit, so later operands are not expanded
+            int status = evaluate_cond(node->left, arena);
+            if (status == 2 || (status == 0) != (node->op == COND_AND)) {
+                return status;
+            }
+            return evaluate_cond(node->right, arena);
+        }
+        case COND_NOT:
+            return negate(evaluate_cond(node->left, arena));
+        default:
+            break;
+    }
+
+    char* left = expand_word_string(node->words[0], arena);
+    if (left == NULL) return 2;
+    if (node->op == COND_WORD) {
+        return left[0] != '\0' ? 0 : 1;
+    }
+    if (node->op == COND_UNARY) {
+        return unary_test(node->test[1], left);
+    }
+
+    char* right = expand_word_string(node->words[1], arena);
+    if (right == NULL) return 2;
+    int equal = strcmp(node->test, "==") == 0 || strcmp(node->test, "=") == 0;
+    if ((equal || strcmp(node->test, "!=") == 0) && !has_quotes(node->words[1])) {
+        // An unquoted right side is a pattern
+        int match = fnmatch(right, left, 0) == 0;
+        return match == equal ? 0 : 1;
+    }
+    return binary_test(left, node->test, right);
+}
+
+// Run a [[ ]] command: status 0 if true, 1 if false, 2 on error
+int execute_cond(node_t* node) {
+    arena_t* arena = push_expansion_arena();
+    if (arena == NULL) {
+        return 2;
+    }
+    int status = evaluate_cond(node->cond, arena);
+    pop_expansion_arena();
+    return status;
+}
@@ -1,203 +1,320 @@
 #include "shell.h"
 
-// Simple approach: Handle if-then-else as single line commands
-
-// Check if command is an if-then-else statement
-int is_if_then_else_command(const char* cmdline) {
-    if (cmdline == NULL) return 0;
-    
-    // Look for the pattern: if ... then ... fi
-    return (strstr(cmdline, "if ") != NULL && 
-            strstr(cmdline, " then ") != NULL && 
-            strstr(cmdline, " fi") != NULL);
-}
-
-// Parse if-then-else from a single line
-int parse_if_then_else(const char* cmdline, if_block_t* if_block) {
-    if (cmdline == NULL || if_block == NULL) {
-        return -1;
-    }
-    
-    // Initialize if_block
-    if_block->condition = NULL;
-    if_block->then_count = 0;
-    if_block->else_count = 0;
-    if_block->has_else = 0;
-    
-    for (int i = 0; i < MAX_BLOCK_LINES; i++) {
-        if_block->then_commands[i] = NULL;
-        if_block->else_commands[i] = NULL;
-    }
-    
-    char* copy = strdup(cmdline);
-    
-    // Find the positions of key words
-    char* if_pos = strstr(copy, "if ");
-    char* then_pos = strstr(copy, " then ");
-    char* else_pos = strstr(copy, " else ");
-    char* fi_pos = strstr(copy, " fi");
-    
-    if (if_pos == NULL || then_pos == NULL || fi_pos == NULL) {
-        free(copy);
-        return -1;
-    }
-    
-    // Extract condition (between "if " and " then ")
-    *then_pos = '\0'; // Terminate at "then"
-    if_block->condition = strdup(if_pos + 3); // Skip "if "
-    
-    // Extract then commands (between " then " and " else " or " fi")
-    char* then_start = then_pos + 6; // Skip " then "
-    
-    if (else_pos != NULL) {
-        *else_pos = '\0';
-        if_block->has_else = 1;
-    } else {
-        *fi_pos = '\0';
-    }
-    
-    // Parse then commands
-    char* then_commands = then_start;
-    char* token = strtok(then_commands, ";");
-    while (token != NULL && if_block->then_count < MAX_BLOCK_LINES) {
-        // Trim whitespace
-        while (*token == ' ' || *token == '\t') token++;
-        char* end = token + strlen(token) - 1;
-        while (end > token && (*end == ' ' || *end == '\t')) end--;
-        *(end + 1) = '\0';
-        
-        if (strlen(token) > 0) {
-            if_block->then_commands[if_block->then_count++] = strdup(token);
-        }
-        token = strtok(NULL, ";");
-    }
-    
-    // Extract else commands if present
-    if (if_block->has_else && else_pos != NULL) {
-        char* else_start = else_pos + 6; // Skip " else "
-        *fi_pos = '\0'; // Terminate at "fi"
-        
-        // Parse else commands
-        char* else_commands = else_start;
-        token = strtok(else_commands, ";");
-        while (token != NULL && if_block->else_count < MAX_BLOCK_LINES) {
-            // Trim whitespace
-            while (*token == ' ' || *token == '\t') token++;
-            char* end = token + strlen(token) - 1;
-            while (end > token && (*end == ' ' || *end == '\t')) end--;
-            *(end + 1) = '\0';
-            
-            if (strlen(token) > 0) {
-                if_block->else_commands[if_block->else_count++] = strdup(token);
-            }
-            token = strtok(NULL, ";");
-        }
+// Execution of compound commands. Bodies are syntax tree nodes parsed
+// once, so nothing here ever looks at command text again: a loop only
+// re-expands the words of the commands it runs, and its arithmetic is
+// evaluated from trees built by the parser.
+
+// Nesting of the loops being run (in the current function), and a
+// break / continue / return that is unwinding them
+static int loop_depth = 0;
+static int break_levels = 0;       // Loops still to leave
+static int continue_pending = 0;   // Resume the loop reached after break_levels
+static int function_depth = 0;
+static int return_pending = 0;
+static int return_status = 0;
+
+// Set by Ctrl-C while an interactive command line runs in the shell. The
+// shell itself ignores SIGINT otherwise, so a loop of built-ins could not
+// be stopped.
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt_handler(int sig) {
+    (void)sig;
+    interrupted = 1;
+}
+
+// Catch Ctrl-C (on) while a command line runs, or go back to ignoring it
+void catch_interrupts(int on) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on ? interrupt_handler : SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &sa, NULL);
+    interrupted = 0;
+}
+
+// Whether Ctrl-C arrived while the current command line was running
+int interrupt_pending() {
+    return interrupted;
+}
+
+// Whether a break, continue, return or Ctrl-C is unwinding the current
+// commands
+static int loop_control_pending() {
+    return break_levels > 0 || continue_pending || return_pending || interrupted;
+}
+
+// Consume a pending break / continue at the end of a loop body. Returns
+// 1 if the loop has to stop.
+static int leave_loop() {
+    if (return_pending || interrupted) {
+        return 1;
     }
-    
-    free(copy);
+    if (break_levels > 0) {
+        break_levels--;
+        return 1;
+    }
+    continue_pending = 0;
     return 0;
 }
 
-// Execute an if-then-else block
-int execute_if_block(if_block_t* if_block) {
-    if (if_block == NULL || if_block->condition == NULL) {
-        return -1;
-    }
-    
-    printf("DEBUG: Condition: '%s'\n", if_block->condition);
-    printf("DEBUG: Then commands: %d\n", if_block->then_count);
-    for (int i = 0; i < if_block->then_count; i++) {
-        printf("DEBUG: Then[%d]: '%s'\n", i, if_block->then_commands[i]);
-    }
-    printf("DEBUG: Else commands: %d\n", if_block->else_count);
-    for (int i = 0; i < if_block->else_count; i++) {
-        printf("DEBUG: Else[%d]: '%s'\n", i, if_block->else_commands[i]);
-    }
-    
-    // Execute the condition command
-    pipeline_t pipeline;
-    int condition_result = -1;
-    
-    if (parse_redirection_pipes(if_block->condition, &pipeline) > 0) {
-        if (pipeline.num_commands > 0) {
-            condition_result = execute_single_command(&pipeline.commands[0]);
-        }
-        free_pipeline(&pipeline);
-    } else {
-        fprintf(stderr, "Error: failed to parse condition command: %s\n", if_block->condition);
-        return -1;
-    }
-    
-    printf("DEBUG: Condition result: %d\n", condition_result);
-    
-    // Execute appropriate block based on condition result
-    if (condition_result == 0) {
-        // Condition succeeded - execute then block
-        printf("DEBUG: Executing THEN block\n");
-        for (int i = 0; i < if_block->then_count; i++) {
-            if (if_block->then_commands[i] != NULL) {
-                printf("DEBUG: Executing then command: '%s'\n", if_block->then_commands[i]);
-                if (parse_redirection_pipes(if_block->then_commands[i], &pipeline) > 0) {
-                    execute_pipeline(&pipeline);
-                    free_pipeline(&pipeline);
-                } else {
-                    fprintf(stderr, "Error: failed to parse then command: %s\n", if_block->then_commands[i]);
-                }
-            }
+// The loop level argument of break and continue (default 1)
+static int loop_levels(char** arglist, const char* builtin) {
+    if (loop_depth == 0) {
+        fprintf(stderr, "%s: only meaningful in a loop\n", builtin);
+        return 0;
+    }
+    int levels = 1;
+    if (arglist[1] != NULL) {
+        char* end;
+        levels = (int)strtol(arglist[1], &end, 10);
+        if (*end != '\0' || levels < 1) {
+            fprintf(stderr, "%s: %s: loop count out of range\n", builtin, arglist[1]);
+            return 0;
         }
-    } else if (if_block->has_else) {
-        // Condition failed and else exists - execute else block
-        printf("DEBUG: Executing ELSE block\n");
-        for (int i = 0; i < if_block->else_count; i++) {
-            if (if_block->else_commands[i] != NULL) {
-                printf("DEBUG: Executing else command: '%s'\n", if_block->else_commands[i]);
-                if (parse_redirection_pipes(if_block->else_commands[i], &pipeline) > 0) {
-                    execute_pipeline(&pipeline);
-                    free_pipeline(&pipeline);
-                } else {
-                    fprintf(stderr, "Error: failed to parse else command: %s\n", if_block->else_commands[i]);
-                }
-            }
+    }
+    return levels < loop_depth ? levels : loop_depth;
+}
+
+// break [n]: leave the n innermost loops
+int builtin_break(char** arglist) {
+    int levels = loop_levels(arglist, "break");
+    if (levels == 0) {
+        return 1;
+    }
+    break_levels = levels;
+    return 0;
+}
+
+// continue [n]: start the next iteration of the n-th enclosing loop
+int builtin_continue(char** arglist) {
+    int levels = loop_levels(arglist, "continue");
+    if (levels == 0) {
+        return 1;
+    }
+    break_levels = levels - 1;
+    continue_pending = 1;
+    return 0;
+}
+
+// return [n]: leave the running function with status n (default 0)
+int builtin_return(char** arglist) {
+    if (function_depth == 0) {
+        fprintf(stderr, "return: can only `return' from a function\n");
+        return 1;
+    }
+    int status = 0;
+    if (arglist[1] != NULL) {
+        char* end;
+        status = (int)strtol(arglist[1], &end, 10);
+        if (*end != '\0') {
+            fprintf(stderr, "return: %s: numeric argument required\n", arglist[1]);
+            status = 2;
         }
     }
-    
+    return_status = status & 0xff;
+    return_pending = 1;
     return 0;
 }
 
-// Free memory allocated for if block
-void free_if_block(if_block_t* if_block) {
-    if (if_block == NULL) return;
-    
-    if (if_block->condition) {
-        free(if_block->condition);
+// Start running a function body. Loops around the call are out of reach
+// of break and continue inside it; saved_loops restores them afterwards.
+void enter_function(int* saved_loops) {
+    *saved_loops = loop_depth;
+    loop_depth = 0;
+    function_depth++;
+}
+
+// Finish a function body that ended with status. Returns the function's
+// status: the value given to return, if it was used.
+int leave_function(int saved_loops, int status) {
+    if (return_pending) {
+        status = return_status;
+        return_pending = 0;
+    }
+    if (interrupted) {
+        status = 128 + SIGINT;
     }
-    
-    for (int i = 0; i < if_block->then_count; i++) {
-        if (if_block->then_commands[i]) {
-            free(if_block->then_commands[i]);
+    break_levels = 0;
+    continue_pending = 0;
+    loop_depth = saved_loops;
+    function_depth--;
+    return status;
+}
+
+// Execute the commands of a list or { group } one after another.
+// Commands followed by & are started in the background.
+int execute_list(node_t* node) {
+    int status = 0;
+    for (int i = 0; i < node->list.count && !loop_control_pending(); i++) {
+        status = execute_node(node->list.items[i]);
+    }
+    return status;
+}
+
+// Execute an if / elif / else chain. The status is that of the branch
+// that ran, or 0 when no condition held and there is no else.
+int execute_if(node_t* node) {
+    while (node != NULL) {
+        int status = execute_node(node->branch.cond);
+        if (loop_control_pending()) {
+            return status;
+        }
+        if (status == 0) {
+            return execute_node(node->branch.body);
         }
+        node_t* next = node->branch.else_part;
+        if (next == NULL || next->type != NODE_IF || next->background) {
+            return execute_node(next);
+        }
+        node = next; // elif
+    }
+    return 0;
+}
+
+// cmd1 && cmd2 / cmd1 || cmd2: the right side runs only if the left side
+// succeeded (&&) or failed (||). A skipped side is never expanded or
+// started; the status is that of the last side that ran.
+int execute_and_or(node_t* node) {
+    int status = execute_node(node->pair.left);
+    if (loop_control_pending() || status == 128 + SIGINT) {
+        return status;
+    }
+    if ((status == 0) == (node->type == NODE_AND)) {
+        status = execute_node(node->pair.right);
+    }
+    return status;
+}
+
+// Run one iteration's body. Returns 1 if the loop has to stop (break, or
+// the body was interrupted with Ctrl-C).
+static int run_body(node_t* body, int* status) {
+    *status = execute_node(body);
+    if (interrupted) {
+        *status = 128 + SIGINT;
+    }
+    if (*status == 128 + SIGINT) {
+        return 1;
     }
-    
-    for (int i = 0; i < if_block->else_count; i++) {
-        if (if_block->else_commands[i]) {
-            free(if_block->else_commands[i]);
+    return loop_control_pending() && leave_loop();
+}
+
+// while / until: run the body as long as the condition succeeds (fails).
+// The status is the body's last status, or 0 if it never ran.
+int execute_while(node_t* node) {
+    int until = node->type == NODE_UNTIL;
+    int status = 0;
+
+    loop_depth++;
+    while (1) {
+        int cond = execute_node(node->branch.cond);
+        if (interrupted) {
+            cond = 128 + SIGINT;
+        }
+        if (cond == 128 + SIGINT) {
+            status = cond;
+            break;
+        }
+        if (loop_control_pending() && leave_loop()) {
+            break;
+        }
+        if ((cond == 0) == until) {
+            break;
+        }
+        if (run_body(node->branch.body, &status)) {
+            break;
         }
     }
+    loop_depth--;
+    return status;
 }
 
-// Check if a word is a control structure keyword
-int is_control_keyword(const char* word) {
-    return (strcmp(word, "if") == 0 ||
-            strcmp(word, "then") == 0 ||
-            strcmp(word, "else") == 0 ||
-            strcmp(word, "fi") == 0);
+// for NAME in words: the words are expanded once, when the loop starts.
+// Without 'in' the loop runs over the positional parameters.
+int execute_for(node_t* node) {
+    int status = 0;
+    if (node->loop.words == NULL) {
+        // No 'in': loop over the positional parameters
+        char** args;
+        int count = get_positional(&args);
+        loop_depth++;
+        for (int i = 0; i < count; i++) {
+            set_variable(node->loop.var, args[i]);
+            if (run_body(node->loop.body, &status)) {
+                break;
+            }
+        }
+        loop_depth--;
+        return status;
+    }
+
+    arena_t* arena = push_expansion_arena();
+    if (arena == NULL) {
+        return 1;
+    }
+    wordlist_t items;
+    wordlist_init(&items, arena, node->loop.num_words + 1);
+    for (int i = 0; i < node->loop.num_words; i++) {
+        if (expand_word(node->loop.words[i], &items) < 0) {
+            pop_expansion_arena();
+            return 1;
+        }
+    }
+    if (items.words == NULL) {
+        pop_expansion_arena();
+        return 1;
+    }
+
+    loop_depth++;
+    for (int i = 0; i < items.count; i++) {
+        set_variable(node->loop.var, items.words[i]);
+        if (run_body(node->loop.body, &status)) {
+            break;
+        }
+    }
+    loop_depth--;
+    pop_expansion_arena();
+    return status;
 }
 
-// Simple multiline command reader
-char* read_multiline_command(const char* initial_prompt) {
-    return strdup(initial_prompt);
+// for ((init; cond; step)): a missing condition counts as true
+int execute_arith_for(node_t* node) {
+    long value;
+    if (node->arith.init != NULL && arith_eval(node->arith.init, &value) < 0) {
+        return 1;
+    }
+
+    int status = 0;
+    loop_depth++;
+    while (1) {
+        if (node->arith.cond != NULL) {
+            if (arith_eval(node->arith.cond, &value) < 0) {
+                status = 1;
+                break;
+            }
+            if (value == 0) {
+                break;
+            }
+        }
+        if (run_body(node->arith.body, &status)) {
+            break;
+        }
+        if (node->arith.step != NULL && arith_eval(node->arith.step, &value) < 0) {
+            status = 1;
+            break;
+        }
+    }
+    loop_depth--;
+    return status;
 }
 
-int parse_if_block_from_string(const char* full_command, if_block_t* if_block) {
-    return parse_if_then_else(full_command, if_block);
+// (( expression )): succeeds when the value is not zero
+int execute_arith(node_t* node) {
+    long value;
+    if (arith_eval(node->arith.cond, &value) < 0) {
+        return 1;
+    }
+    return value != 0 ? 0 : 1;
 }
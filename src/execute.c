@@ -1,20 +1,401 @@
 #include "shell.h"
 
-int execute(char* arglist[]) {
+// Tree walker. Nodes are executed straight from the syntax tree; only the
+// words of a simple command are expanded, into an arena that is reset
+// once the command has finished.
+
+// One expansion arena per nesting level, kept between commands so that
+// steady-state execution does not call malloc
+static arena_t** expansion_arenas = NULL;
+static int arena_depth = 0;
+static int arena_count = 0;
+
+// Get a clean arena for the expansions of one command
+arena_t* push_expansion_arena() {
+    if (arena_depth == arena_count) {
+        arena_t** grown = realloc(expansion_arenas, (arena_count + 1) * sizeof(arena_t*));
+        if (grown == NULL) {
+            perror("realloc failed");
+            return NULL;
+        }
+        expansion_arenas = grown;
+        expansion_arenas[arena_count] = calloc(1, sizeof(arena_t));
+        if (expansion_arenas[arena_count] == NULL) {
+            perror("calloc failed");
+            return NULL;
+        }
+        arena_count++;
+    }
+    return expansion_arenas[arena_depth++];
+}
+
+// Release the arena taken by the matching push_expansion_arena()
+void pop_expansion_arena() {
+    if (arena_depth > 0) {
+        arena_reset(expansion_arenas[--arena_depth]);
+    }
+}
+
+// Split a NAME=value word and expand the value
+static char* expand_assignment(const char* word, char** name, arena_t* arena) {
+    const char* equal_sign = strchr(word, '=');
+    *name = arena_strndup(arena, word, equal_sign - word);
+    if (*name == NULL) {
+        return NULL;
+    }
+    return expand_word_string(equal_sign + 1, arena);
+}
+
+// Expand a simple command's words and redirections into cmd. Returns
+// -1 if an expansion failed (already reported). Here-documents opened
+// for cmd->redirs are closed with close_redirections().
+static int expand_command(node_t* node, command_t* cmd, arena_t* arena) {
+    wordlist_t args;
+    wordlist_init(&args, arena, node->cmd.num_words - node->cmd.num_assigns + 1);
+    for (int i = node->cmd.num_assigns; i < node->cmd.num_words; i++) {
+        if (expand_word(node->cmd.words[i], &args) < 0) {
+            return -1;
+        }
+    }
+    if (args.words == NULL) {
+        return -1;
+    }
+
+    memset(cmd, 0, sizeof(command_t));
+    cmd->args = args.words;
+    cmd->argc = args.count;
+    cmd->background = node->background;
+
+    // NAME=value words before a command only go into its environment
+    if (node->cmd.num_assigns > 0 && cmd->argc > 0) {
+        wordlist_t assigns;
+        wordlist_init(&assigns, arena, node->cmd.num_assigns + 1);
+        for (int i = 0; i < node->cmd.num_assigns; i++) {
+            const char* word = node->cmd.words[i];
+            const char* value = strchr(word, '=') + 1;
+            char* expanded = expand_word_string(value, arena);
+            if (expanded == NULL) return -1;
+
+            strbuf_t entry;
+            strbuf_init(&entry, arena, strlen(expanded) + (value - word) + 1);
+            strbuf_append(&entry, word, value - word);
+            strbuf_append(&entry, expanded, strlen(expanded));
+            if (entry.data == NULL || wordlist_add(&assigns, entry.data) < 0) return -1;
+        }
+        cmd->assigns = assigns.words;
+    }
+
+    // Redirections last, so a failure above leaves no here-document open
+    return expand_redirections(node->redirs, &cmd->redirs, arena);
+}
+
+// Set NAME=value entries in the shell's environment, saving the old
+// values in saved (NULL entries for names that were unset)
+static void push_assignments(char** assigns, char** saved, arena_t* arena) {
+    for (int i = 0; assigns[i] != NULL; i++) {
+        char* equal_sign = strchr(assigns[i], '=');
+        *equal_sign = '\0';
+        const char* old = getenv(assigns[i]);
+        saved[i] = old ? arena_strndup(arena, old, strlen(old)) : NULL;
+        setenv(assigns[i], equal_sign + 1, 1);
+        *equal_sign = '=';
+    }
+}
+
+static void pop_assignments(char** assigns, char** saved) {
+    for (int i = 0; assigns[i] != NULL; i++) {
+        char* equal_sign = strchr(assigns[i], '=');
+        *equal_sign = '\0';
+        if (saved[i] != NULL) {
+            setenv(assigns[i], saved[i], 1);
+        } else {
+            unsetenv(assigns[i]);
+        }
+        *equal_sign = '=';
+    }
+}
+
+// Run an expanded simple command
+static int run_command(command_t* cmd, arena_t* arena) {
+    // Functions and built-in commands run in the shell itself (no fork),
+    // with their redirections applied around the call. Started with &,
+    // they go through the launcher, which forks.
+    function_t* fn = NULL;
+    builtin_fn builtin = NULL;
+    if (!cmd->background) {
+        fn = find_function(cmd->args[0]);
+        if (fn == NULL) builtin = find_builtin(cmd->args[0]);
+    }
+    if (fn != NULL || builtin != NULL) {
+        char** saved = NULL;
+        saved_fd_t* fds = NULL;
+        if (cmd->redirs != NULL && redirect_in_process(cmd->redirs, &fds, arena) < 0) {
+            return 1;
+        }
+        if (cmd->assigns != NULL) {
+            int n = 0;
+            while (cmd->assigns[n] != NULL) n++;
+            saved = arena_alloc(arena, n * sizeof(char*));
+            if (saved == NULL) {
+                restore_redirections(fds);
+                return 1;
+            }
+            push_assignments(cmd->assigns, saved, arena);
+        }
+
+        int status;
+        if (fn != NULL) {
+            status = call_function(fn, cmd->argc, cmd->args);
+        } else {
+            status = builtin(cmd->args);
+        }
+
+        if (saved != NULL) {
+            pop_assignments(cmd->assigns, saved);
+        }
+        restore_redirections(fds);
+        return status;
+    }
+
+    // cat between files and pipes is a copy the kernel can do for us
+    if (!cmd->background) {
+        int status = try_fast_copy(cmd, arena);
+        if (status >= 0) {
+            return status;
+        }
+    }
+
+    // Redirections, & and assignments are handled by the job launcher
+    return execute_piped_commands(cmd, 1);
+}
+
+// Execute a simple command: expand it, then run it
+int execute_command_node(node_t* node) {
+    arena_t* arena = push_expansion_arena();
+    if (arena == NULL) {
+        return 1;
+    }
+
+    command_t cmd;
     int status;
-    int cpid = fork();
-
-    switch (cpid) {
-        case -1:
-            perror("fork failed");
-            exit(1);
-        case 0: // Child process
-            execvp(arglist[0], arglist);
-            perror("Command not found"); // This line runs only if execvp fails
-            exit(1);
-        default: // Parent process
-            waitpid(cpid, &status, 0);
-            // printf("Child pid:%d exited with status %d\n", cpid, status >> 8);
-            return 0;
+    unsigned long substitutions = command_substitutions();
+    if (expand_command(node, &cmd, arena) < 0) {
+        pop_expansion_arena();
+        return 1;
+    }
+
+    if (cmd.argc == 0) {
+        // Only assignments and redirections (or nothing left after
+        // expansion). Redirections still open (and create) their files.
+        // The status is that of the last command substitution, if any.
+        status = 0;
+        saved_fd_t* saved;
+        if (cmd.redirs != NULL) {
+            if (redirect_in_process(cmd.redirs, &saved, arena) < 0) {
+                status = 1;
+            } else {
+                restore_redirections(saved);
+            }
+            close_redirections(cmd.redirs);
+        }
+        for (int i = 0; i < node->cmd.num_assigns; i++) {
+            char* name;
+            char* value = expand_assignment(node->cmd.words[i], &name, arena);
+            if (value == NULL) {
+                status = 1;
+                break;
+            }
+            set_variable(name, value);
+        }
+        if (status == 0 && command_substitutions() != substitutions) {
+            status = get_last_status();
+        }
+        pop_expansion_arena();
+        return status;
+    }
+
+    status = run_command(&cmd, arena);
+    close_redirections(cmd.redirs);
+    pop_expansion_arena();
+    return status;
+}
+
+// Label used for a compound command in job listings
+static char* compound_label(node_t* node) {
+    switch (node->type) {
+        case NODE_IF:        return "if";
+        case NODE_GROUP:     return "{";
+        case NODE_WHILE:     return "while";
+        case NODE_UNTIL:     return "until";
+        case NODE_FOR:
+        case NODE_ARITH_FOR: return "for";
+        case NODE_ARITH:     return "((";
+        case NODE_COND:      return "[[";
+        case NODE_AND:       return "&&";
+        case NODE_OR:        return "||";
+        default:             return "(list)";
+    }
+}
+
+// Set up cmd to run a compound command in a forked copy of the shell,
+// with its redirections expanded. Returns -1 on failure (reported).
+static int expand_compound(node_t* node, command_t* cmd, arena_t* arena) {
+    memset(cmd, 0, sizeof(command_t));
+    cmd->args = arena_alloc(arena, 2 * sizeof(char*));
+    if (cmd->args == NULL) {
+        return -1;
+    }
+    cmd->args[0] = compound_label(node);
+    cmd->args[1] = NULL;
+    cmd->argc = 1;
+    cmd->body = node;
+    return expand_redirections(node->redirs, &cmd->redirs, arena);
+}
+
+// Execute a pipeline: every stage is expanded first, then all stages are
+// started together as one job
+int execute_pipeline_node(node_t* node) {
+    arena_t* arena = push_expansion_arena();
+    if (arena == NULL) {
+        return 1;
+    }
+
+    int count = node->list.count;
+    command_t* cmds = arena_alloc(arena, count * sizeof(command_t));
+    if (cmds == NULL) {
+        pop_expansion_arena();
+        return 1;
+    }
+
+    int status = 1;
+    int expanded;
+    for (expanded = 0; expanded < count; expanded++) {
+        node_t* stage = node->list.items[expanded];
+        command_t* cmd = &cmds[expanded];
+        if (stage->type == NODE_COMMAND) {
+            if (expand_command(stage, cmd, arena) < 0) break;
+        } else if (expand_compound(stage, cmd, arena) < 0) {
+            break;
+        }
+    }
+
+    if (expanded == count) {
+        cmds[count - 1].background = node->background;
+        status = execute_piped_commands(cmds, count);
+    }
+    for (int i = 0; i < expanded; i++) {
+        close_redirections(cmds[i].redirs);
+    }
+    pop_expansion_arena();
+    return status;
+}
+
+// Run a compound command in the background as a job of its own
+static int execute_background_node(node_t* node) {
+    arena_t* arena = push_expansion_arena();
+    if (arena == NULL) {
+        return 1;
+    }
+    command_t cmd;
+    int status = 1;
+    if (expand_compound(node, &cmd, arena) == 0) {
+        cmd.background = 1;
+        status = execute_piped_commands(&cmd, 1);
+        close_redirections(cmd.redirs);
+    }
+    pop_expansion_arena();
+    return status;
+}
+
+// Run a compound command in the foreground with its redirections
+// applied around it
+static int execute_redirected_node(node_t* node) {
+    arena_t* arena = push_expansion_arena();
+    if (arena == NULL) {
+        return 1;
+    }
+    redir_t* redirs;
+    saved_fd_t* saved;
+    int status = 1;
+    if (expand_redirections(node->redirs, &redirs, arena) == 0) {
+        if (redirect_in_process(redirs, &saved, arena) == 0) {
+            status = execute_compound(node);
+            restore_redirections(saved);
+        }
+        close_redirections(redirs);
+    }
+    pop_expansion_arena();
+    return status;
+}
+
+// Execute a compound command in the current process, ignoring any &
+// (used by the forked shell that runs a background or piped compound)
+int execute_compound(node_t* node) {
+    switch (node->type) {
+        case NODE_IF:
+            return execute_if(node);
+        case NODE_LIST:
+        case NODE_GROUP:
+            return execute_list(node);
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            return execute_while(node);
+        case NODE_FOR:
+            return execute_for(node);
+        case NODE_ARITH_FOR:
+            return execute_arith_for(node);
+        case NODE_ARITH:
+            return execute_arith(node);
+        case NODE_COND:
+            return execute_cond(node);
+        case NODE_AND:
+        case NODE_OR:
+            return execute_and_or(node);
+        default:
+            return execute_node(node);
+    }
+}
+
+static int run_node(node_t* node) {
+    if (node == NULL) {
+        return 0;
+    }
+
+    switch (node->type) {
+        case NODE_COMMAND:
+            return execute_command_node(node);
+        case NODE_PIPELINE:
+            return execute_pipeline_node(node);
+        case NODE_LIST:
+        case NODE_GROUP:
+        case NODE_IF:
+        case NODE_WHILE:
+        case NODE_UNTIL:
+        case NODE_FOR:
+        case NODE_ARITH_FOR:
+        case NODE_ARITH:
+        case NODE_COND:
+        case NODE_AND:
+        case NODE_OR:
+            if (node->background) {
+                return execute_background_node(node);
+            }
+            if (node->redirs != NULL) {
+                return execute_redirected_node(node);
+            }
+            return execute_compound(node);
+        case NODE_FUNCTION:
+            return define_function(node->func.name, node->func.body) < 0 ? 1 : 0;
+    }
+    return 1;
+}
+
+// Execute any node and return its exit status, which also becomes $?
+int execute_node(node_t* node) {
+    int status = run_node(node);
+    if (status < 0) {
+        status = 1;
     }
+    set_last_status(status);
+    return status;
 }
@@ -0,0 +1,912 @@
+#include "shell.h"
+#include <limits.h>
+
+// Variable expansion engine. Expands $VAR, ${VAR}, the POSIX parameter
+// operators, $((arithmetic)) and $(command) / `command` substitution in
+// one left-to-right pass, writing into a growable arena buffer. Text in
+// single quotes is copied untouched and a backslash protects a following
+// $, ` or backslash.
+//
+// expand_variables() keeps quote characters in its output. The word
+// functions below work on one raw word from the syntax tree: they also
+// remove quotes, split the results of unquoted expansions into separate
+// fields and replace fields with unquoted *, ? or [ by the file names
+// they match (glob.c).
+
+static int expand_range(strbuf_t* out, const char* p, const char* end, int keep_quotes);
+
+// Characters that can appear in a variable name
+static int is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+// Find the } that closes a ${ starting at p (just after the brace),
+// skipping nested ${...} and quoted text. Returns NULL if unclosed.
+static const char* find_closing_brace(const char* p, const char* end) {
+    int depth = 1;
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end) {
+            p += 2;
+            continue;
+        }
+        if (*p == '\'' || *p == '"') {
+            const char* close = memchr(p + 1, *p, end - p - 1);
+            if (close == NULL) return NULL;
+            p = close + 1;
+            continue;
+        }
+        if (*p == '$' && p + 1 < end && p[1] == '{') {
+            depth++;
+            p += 2;
+            continue;
+        }
+        if (*p == '}' && --depth == 0) {
+            return p;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+// Find the "))" closing a $(( whose expression starts at p. Returns a
+// pointer to the first of the two parentheses, or NULL if unclosed.
+static const char* find_arith_close(const char* p, const char* end) {
+    int depth = 0;
+    for (; p < end; p++) {
+        if (*p == '(') {
+            depth++;
+        } else if (*p == ')') {
+            if (depth == 0) {
+                return p + 1 < end && p[1] == ')' ? p : NULL;
+            }
+            depth--;
+        }
+    }
+    return NULL;
+}
+
+// Find the ) closing a $( whose command starts at p, skipping quoted
+// text, backquotes and nested parentheses. Returns NULL if unclosed.
+static const char* find_closing_paren(const char* p, const char* end) {
+    int depth = 0;
+    for (; p < end; p++) {
+        if (*p == '\\') {
+            if (++p == end) break;
+        } else if (*p == '\'' || *p == '`') {
+            const char* close = memchr(p + 1, *p, end - p - 1);
+            if (close == NULL) return NULL;
+            p = close;
+        } else if (*p == '"') {
+            for (p++; p < end && *p != '"'; p++) {
+                if (*p == '\\' && p + 1 < end) p++;
+            }
+            if (p == end) return NULL;
+        } else if (*p == '(') {
+            depth++;
+        } else if (*p == ')' && depth-- == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Find the backquote closing a `command` that starts at p. Returns NULL
+// if unclosed.
+static const char* find_closing_backquote(const char* p, const char* end) {
+    for (; p < end; p++) {
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        } else if (*p == '`') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// Find the " closing a double-quoted string that starts at p, skipping
+// substitutions inside it. Returns NULL if unclosed.
+static const char* find_closing_dquote(const char* p, const char* end) {
+    for (; p < end && *p != '"'; p++) {
+        const char* close = NULL;
+        if (*p == '\\' && p + 1 < end) {
+            p++;
+        } else if (*p == '$' && p + 1 < end && p[1] == '{') {
+            close = find_closing_brace(p + 2, end);
+        } else if (*p == '$' && p + 1 < end && p[1] == '(') {
+            close = find_closing_paren(p + 2, end);
+        } else if (*p == '`') {
+            close = find_closing_backquote(p + 1, end);
+        }
+        if (close != NULL) p = close;
+    }
+    return p < end ? p : NULL;
+}
+
+// Substitute the output of `command` (the text between p and end). Inside
+// backquotes a backslash only escapes $, ` and \.
+static int expand_backquote(strbuf_t* out, const char* p, const char* end) {
+    strbuf_t text;
+    strbuf_init(&text, out->arena, end - p + 1);
+    while (p < end) {
+        if (*p == '\\' && p + 1 < end && strchr("$`\\", p[1]) != NULL) {
+            p++;
+        }
+        strbuf_putc(&text, *p++);
+    }
+    if (text.data == NULL) {
+        return -1;
+    }
+    return command_substitution(text.data, text.len, out);
+}
+
+// Expand the expression of $((expression)), between p and end.
+// Variables in it are expanded first, then it is parsed into the output
+// arena and evaluated.
+static int expand_arithmetic(strbuf_t* out, const char* p, const char* end) {
+    strbuf_t expr;
+    strbuf_init(&expr, out->arena, end - p + 16);
+    if (expand_range(&expr, p, end, 0) < 0 || expr.data == NULL) {
+        return -1;
+    }
+    arith_node_t* tree = arith_parse(expr.data, expr.len, out->arena);
+    long value;
+    if (tree == NULL || arith_eval(tree, &value) < 0) {
+        return -1;
+    }
+    char digits[24];
+    int n = snprintf(digits, sizeof(digits), "%ld", value);
+    strbuf_append(out, digits, n);
+    return 0;
+}
+
+// Expand ${...}. p points at the '{' and close at the matching '}'.
+// Returns 0, or -1 after reporting an error (${VAR:?msg}).
+static int expand_braced(strbuf_t* out, const char* p, const char* close, int keep_quotes) {
+    const char* name = p + 1;
+
+    // ${#VAR}: length of the value
+    if (*name == '#' && name + 1 < close) {
+        const char* value = get_variable_n(name + 1, close - name - 1);
+        char digits[24];
+        int n = snprintf(digits, sizeof(digits), "%zu", value ? strlen(value) : 0);
+        strbuf_append(out, digits, n);
+        return 0;
+    }
+
+    const char* name_end = name;
+    if ((*name == '#' || *name == '@' || *name == '*' || *name == '?' || *name == '!') &&
+        name + 1 == close) {
+        name_end = close; // ${#}, ${@}, ${*}, ${?}, ${!}
+    }
+    while (name_end < close && is_name_char(*name_end)) name_end++;
+    size_t name_len = name_end - name;
+    const char* value = get_variable_n(name, name_len);
+
+    // Plain ${VAR}; unset expands to nothing
+    if (name_end == close && name_len > 0) {
+        if (value != NULL) {
+            strbuf_append(out, value, strlen(value));
+        }
+        return 0;
+    }
+
+    // Operator: optional ':' (also treat empty as unset) then one of - = ? +
+    const char* op = name_end;
+    int check_null = 0;
+    if (*op == ':') {
+        check_null = 1;
+        op++;
+    }
+    if (name_len == 0 || op >= close || strchr("-=?+", *op) == NULL) {
+        fprintf(stderr, "%.*s: bad substitution\n", (int)(close - p + 2), p - 1);
+        return -1;
+    }
+
+    const char* word = op + 1;
+    int is_set = value != NULL && !(check_null && value[0] == '\0');
+
+    switch (*op) {
+        case '-':  // Use word if unset
+            if (is_set) {
+                strbuf_append(out, value, strlen(value));
+                return 0;
+            }
+            return expand_range(out, word, close, keep_quotes);
+
+        case '+':  // Use word if set
+            return is_set ? expand_range(out, word, close, keep_quotes) : 0;
+
+        case '=': {  // Assign word if unset
+            if (is_set) {
+                strbuf_append(out, value, strlen(value));
+                return 0;
+            }
+            strbuf_t assigned;
+            strbuf_init(&assigned, out->arena, close - word + 16);
+            if (expand_range(&assigned, word, close, keep_quotes) < 0) {
+                return -1;
+            }
+            char* var = arena_strndup(out->arena, name, name_len);
+            if (var == NULL || assigned.data == NULL) {
+                return -1;
+            }
+            set_variable(var, assigned.data);
+            strbuf_append(out, assigned.data, assigned.len);
+            return 0;
+        }
+
+        case '?': {  // Fail with a message if unset
+            if (is_set) {
+                strbuf_append(out, value, strlen(value));
+                return 0;
+            }
+            strbuf_t message;
+            strbuf_init(&message, out->arena, close - word + 16);
+            if (expand_range(&message, word, close, keep_quotes) < 0) {
+                return -1;
+            }
+            fprintf(stderr, "%.*s: %s\n", (int)name_len, name,
+                    message.len > 0 ? message.data : "parameter null or not set");
+            if (!interactive_shell()) {
+                exit(1);  // Fatal in a script, -c or subshell
+            }
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// Expand one $ reference. *pp points just past the '$' and is advanced
+// past the reference.
+static int expand_dollar(strbuf_t* out, const char** pp, const char* end, int keep_quotes) {
+    const char* p = *pp;
+    if (p < end && *p == '{') {
+        const char* close = find_closing_brace(p + 1, end);
+        if (close == NULL) {
+            fprintf(stderr, "Syntax error: missing '}' in variable reference\n");
+            return -1;
+        }
+        if (expand_braced(out, p, close, keep_quotes) < 0) {
+            return -1;
+        }
+        *pp = close + 1;
+        return 0;
+    }
+
+    // $((expression)), unless the parentheses only close as $( (...) )
+    const char* close = p + 1 < end && p[0] == '(' && p[1] == '(' ? find_arith_close(p + 2, end)
+                                                                    : NULL;
+    if (close != NULL) {
+        if (expand_arithmetic(out, p + 2, close) < 0) {
+            return -1;
+        }
+        *pp = close + 2;
+        return 0;
+    }
+
+    if (p < end && *p == '(') {
+        close = find_closing_paren(p + 1, end);
+        if (close == NULL) {
+            fprintf(stderr, "Syntax error: missing ')' in command substitution\n");
+            return -1;
+        }
+        if (command_substitution(p + 1, close - (p + 1), out) < 0) {
+            return -1;
+        }
+        *pp = close + 1;
+        return 0;
+    }
+
+    // $VAR syntax; $1..$9, $#, $@, $*, $? and $! are a single character
+    const char* name = p;
+    if (p < end && ((*p >= '0' && *p <= '9') || *p == '#' || *p == '@' || *p == '*' ||
+                    *p == '?' || *p == '!')) {
+        p++;
+    } else {
+        while (p < end && is_name_char(*p)) p++;
+    }
+    if (p == name) {
+        strbuf_putc(out, '$');  // A lone '$' is literal
+        *pp = p;
+        return 0;
+    }
+    // An unset parameter expands to nothing
+    const char* value = get_variable_n(name, p - name);
+    if (value != NULL) {
+        strbuf_append(out, value, strlen(value));
+    }
+    *pp = p;
+    return 0;
+}
+
+// Expand the text between p and end, appending to out. Without
+// keep_quotes the quote characters and escaping backslashes are removed.
+static int expand_range(strbuf_t* out, const char* p, const char* end, int keep_quotes) {
+    int in_dquote = 0;
+
+    while (p < end) {
+        // Copy the run of ordinary characters in one step
+        const char* run = p;
+        while (p < end && *p != '$' && *p != '\'' && *p != '"' && *p != '\\' && *p != '`') p++;
+        strbuf_append(out, run, p - run);
+        if (p >= end) break;
+
+        if (*p == '`') {
+            const char* close = find_closing_backquote(p + 1, end);
+            if (close == NULL) {
+                fprintf(stderr, "Syntax error: missing '`' in command substitution\n");
+                return -1;
+            }
+            if (expand_backquote(out, p + 1, close) < 0) {
+                return -1;
+            }
+            p = close + 1;
+        } else if (*p == '"') {
+            in_dquote = !in_dquote;
+            if (keep_quotes) strbuf_putc(out, *p);
+            p++;
+        } else if (*p == '\'') {
+            if (in_dquote) {
+                strbuf_putc(out, *p++);
+                continue;
+            }
+            // Single-quoted text is never expanded
+            const char* close = memchr(p + 1, '\'', end - p - 1);
+            const char* stop = close ? close + 1 : end;
+            if (keep_quotes) {
+                strbuf_append(out, p, stop - p);
+            } else {
+                strbuf_append(out, p + 1, (close ? close : end) - (p + 1));
+            }
+            p = stop;
+        } else if (*p == '\\') {
+            // \$, \` and \\ stand for the literal character; when removing
+            // quotes a backslash also escapes anything outside "..."
+            if (p + 1 < end && (p[1] == '$' || p[1] == '\\' || p[1] == '`' ||
+                                (!keep_quotes && (!in_dquote || p[1] == '"')))) {
+                strbuf_putc(out, p[1]);
+                p += 2;
+            } else {
+                strbuf_putc(out, *p++);
+            }
+        } else {
+            p++; // Skip the '$'
+            if (expand_dollar(out, &p, end, keep_quotes) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Expand variables in a string. The result is allocated from the given
+// arena. Returns NULL if expansion failed (the error is already printed).
+char* expand_variables(const char* str, arena_t* arena) {
+    if (str == NULL) return NULL;
+
+    size_t len = strlen(str);
+    strbuf_t result;
+    strbuf_init(&result, arena, len + 64);
+    if (result.data == NULL) return NULL;
+
+    if (expand_range(&result, str, str + len, 1) < 0) {
+        return NULL;
+    }
+    return result.data;
+}
+
+// Start an empty word list in the arena
+void wordlist_init(wordlist_t* list, arena_t* arena, int initial) {
+    list->arena = arena;
+    list->count = 0;
+    list->cap = initial < 4 ? 4 : initial;
+    list->words = arena_alloc(arena, list->cap * sizeof(char*));
+    if (list->words != NULL) {
+        list->words[0] = NULL;
+    }
+}
+
+// Append a word, keeping the list NULL-terminated
+int wordlist_add(wordlist_t* list, char* word) {
+    if (list->words == NULL) {
+        return -1;
+    }
+    if (list->count + 1 >= list->cap) {
+        char** grown = arena_extend(list->arena, list->words, list->cap * sizeof(char*),
+                                    list->cap * 2 * sizeof(char*));
+        if (grown == NULL) {
+            return -1;
+        }
+        list->words = grown;
+        list->cap *= 2;
+    }
+    list->words[list->count++] = word;
+    list->words[list->count] = NULL;
+    return 0;
+}
+
+static int is_field_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// Pattern form of the field being built: the same text with quoted
+// glob characters escaped. Only kept once the field contains a glob
+// character, so words without any cost nothing extra.
+typedef struct {
+    strbuf_t text;
+    int active;              // text is being kept
+    int wildcard;            // An unquoted *, ? or [ was seen
+} field_pattern_t;
+
+static int is_glob_char(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+// Mirror the text appended to field since start into its pattern form
+static void track_pattern(field_pattern_t* pat, const strbuf_t* field, size_t start, int quoted) {
+    const char* text = field->data + start;
+    size_t len = field->len - start;
+    if (!pat->active) {
+        size_t i = 0;
+        while (i < len && !is_glob_char(text[i])) i++;
+        if (i == len) {
+            return;
+        }
+        // Earlier text has no glob characters; only backslashes need escaping
+        pat->active = 1;
+        strbuf_init(&pat->text, field->arena, field->len + 16);
+        for (size_t j = 0; j < start; j++) {
+            if (field->data[j] == '\\') strbuf_putc(&pat->text, '\\');
+            strbuf_putc(&pat->text, field->data[j]);
+        }
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (is_glob_char(text[i]) || text[i] == '\\') {
+            if (quoted) {
+                strbuf_putc(&pat->text, '\\');
+            } else if (text[i] != '\\') {
+                pat->wildcard = 1;
+            }
+        }
+        strbuf_putc(&pat->text, text[i]);
+    }
+}
+
+// Add a finished field to out: the names it matches when it has a
+// wildcard and matches any, otherwise the field itself
+static int add_field(wordlist_t* out, const strbuf_t* field, field_pattern_t* pat) {
+    int matches = 0;
+    if (pat->active && pat->wildcard) {
+        matches = pat->text.data != NULL ? glob_expand(pat->text.data, out) : -1;
+    }
+    pat->active = 0;
+    pat->wildcard = 0;
+    if (matches != 0) {
+        return matches < 0 ? -1 : 0;
+    }
+    return wordlist_add(out, field->data);
+}
+
+// Split the text appended to field since offset start (the result of an
+// unquoted expansion) at blanks. Every completed field is added to out
+// and field is left holding the last, unfinished one. *has_field tells
+// whether field counts as a word even when it is empty.
+static int split_expansion(strbuf_t* field, size_t start, int* has_field,
+                           field_pattern_t* pat, wordlist_t* out) {
+    const char* text = field->data + start;
+    size_t len = field->len - start;
+    size_t i = 0;
+    while (i < len && !is_field_separator(text[i])) i++;
+    if (i == len) {
+        if (len > 0) *has_field = 1;
+        track_pattern(pat, field, start, 0);
+        return 0; // Common case: nothing to split
+    }
+
+    // Copy the expansion out, then rebuild the fields from it
+    char* copy = arena_strndup(field->arena, text, len);
+    if (copy == NULL) {
+        return -1;
+    }
+    field->len = start;
+    field->data[start] = '\0';
+
+    const char* p = copy;
+    const char* end = copy + len;
+    while (p < end) {
+        const char* word = p;
+        while (p < end && !is_field_separator(*p)) p++;
+        strbuf_append(field, word, p - word);
+        track_pattern(pat, field, field->len - (p - word), 0);
+        if (p - word > 0) *has_field = 1;
+        if (p == end) break;
+
+        // A separator ends the current field
+        if (*has_field) {
+            if (add_field(out, field, pat) < 0) return -1;
+            strbuf_init(field, field->arena, 32);
+            *has_field = 0;
+        }
+        while (p < end && is_field_separator(*p)) p++;
+    }
+    return 0;
+}
+
+// Expand a raw word without braces into zero or more fields appended to
+// out: quotes are removed, the results of unquoted expansions are split
+// at blanks and fields with wildcards are globbed
+static int expand_fields(const char* word, wordlist_t* out) {
+    size_t len = strlen(word);
+    strbuf_t field;
+    strbuf_init(&field, out->arena, len + 16);
+    if (field.data == NULL) {
+        return -1;
+    }
+
+    // A quoted empty string still makes a word, an empty expansion does not
+    int has_field = 0;
+    field_pattern_t pat = {0};
+    const char* p = word;
+    const char* end = word + len;
+
+    while (p < end) {
+        const char* run = p;
+        while (p < end && *p != '$' && *p != '\'' && *p != '"' && *p != '\\' && *p != '`') p++;
+        if (p > run) {
+            strbuf_append(&field, run, p - run);
+            track_pattern(&pat, &field, field.len - (p - run), 0);
+            has_field = 1;
+        }
+        if (p >= end) break;
+
+        if (*p == '$') {
+            size_t start = field.len;
+            p++;
+            if (expand_dollar(&field, &p, end, 0) < 0 ||
+                split_expansion(&field, start, &has_field, &pat, out) < 0) {
+                return -1;
+            }
+        } else if (*p == '`') {
+            size_t start = field.len;
+            const char* close = find_closing_backquote(p + 1, end);
+            if (close == NULL) {
+                fprintf(stderr, "Syntax error: missing '`' in command substitution\n");
+                return -1;
+            }
+            if (expand_backquote(&field, p + 1, close) < 0 ||
+                split_expansion(&field, start, &has_field, &pat, out) < 0) {
+                return -1;
+            }
+            p = close + 1;
+        } else if (*p == '\\') {
+            if (p + 1 < end) p++;
+            strbuf_putc(&field, *p++);
+            track_pattern(&pat, &field, field.len - 1, 1);
+            has_field = 1;
+        } else {
+            // Quoted text (both kinds) expands as one piece without splitting
+            const char* close = *p == '\'' ? memchr(p + 1, '\'', end - p - 1)
+                                            : find_closing_dquote(p + 1, end);
+            const char* stop = close ? close + 1 : end;
+            if (stop - p == 4 && memcmp(p, "\"$@\"", 4) == 0) {
+                // "$@": one field per positional parameter
+                char** args;
+                int count = get_positional(&args);
+                for (int i = 0; i < count; i++) {
+                    if (i > 0) {
+                        if (add_field(out, &field, &pat) < 0) return -1;
+                        strbuf_init(&field, out->arena, 32);
+                    }
+                    size_t start = field.len;
+                    strbuf_append(&field, args[i], strlen(args[i]));
+                    track_pattern(&pat, &field, start, 1);
+                    has_field = 1;
+                }
+                p = stop;
+                continue;
+            }
+            size_t start = field.len;
+            if (expand_range(&field, p, stop, 0) < 0) {
+                return -1;
+            }
+            track_pattern(&pat, &field, start, 1);
+            has_field = 1;
+            p = stop;
+        }
+    }
+
+    if (has_field) {
+        return add_field(out, &field, &pat);
+    }
+    return 0;
+}
+
+// Brace expansion. {a,b,c} and {x..y[..step]} are expanded first, on the
+// raw word, one variant at a time: each variant is built in a reused
+// buffer and expanded straight into the argument list, so {1..1000000}
+// never exists as one long string.
+
+// Skip a quoted string or a substitution starting at p. Returns the last
+// character of it, p itself if nothing starts there, or NULL if unclosed.
+static const char* skip_quoted(const char* p, const char* end) {
+    if (*p == '\\') {
+        return p + 1 < end ? p + 1 : p;
+    }
+    if (*p == '\'') {
+        return memchr(p + 1, '\'', end - p - 1);
+    }
+    if (*p == '"') {
+        return find_closing_dquote(p + 1, end);
+    }
+    if (*p == '`') {
+        return find_closing_backquote(p + 1, end);
+    }
+    if (*p == '$' && p + 1 < end && p[1] == '{') {
+        return find_closing_brace(p + 2, end);
+    }
+    if (*p == '$' && p + 1 < end && p[1] == '(') {
+        return find_closing_paren(p + 2, end);
+    }
+    return p;
+}
+
+// Bounds of a {x..y[..step]} sequence
+typedef struct {
+    long first, last, step;
+    int width;               // Zero-padded width, or 0
+    int letters;             // Characters rather than numbers
+} brace_sequence_t;
+
+// Parse one endpoint of a numeric sequence. Returns -1 if it is not an
+// integer.
+static int parse_bound(const char* p, const char* end, long* value, int* width) {
+    const char* digits = p < end && (*p == '-' || *p == '+') ? p + 1 : p;
+    if (digits == end) return -1;
+    for (const char* q = digits; q < end; q++) {
+        if (*q < '0' || *q > '9') return -1;
+    }
+    if (end - digits > 18) return -1;
+    *value = strtol(p, NULL, 10);
+    if (*digits == '0' && end - digits > 1) {
+        *width = (int)(end - p);
+    }
+    return 0;
+}
+
+// Parse the inside of {...} as a sequence. Returns -1 if it is not one.
+static int parse_sequence(const char* p, const char* end, brace_sequence_t* seq) {
+    const char* dots = NULL;
+    for (const char* q = p; q + 1 < end; q++) {
+        if (q[0] == '.' && q[1] == '.') {
+            dots = q;
+            break;
+        }
+    }
+    if (dots == NULL) return -1;
+
+    const char* last = dots + 2;
+    const char* last_end = end;
+    const char* step_dots = NULL;
+    for (const char* q = last; q + 1 < end; q++) {
+        if (q[0] == '.' && q[1] == '.') {
+            step_dots = q;
+            last_end = q;
+            break;
+        }
+    }
+
+    memset(seq, 0, sizeof(brace_sequence_t));
+    seq->step = 1;
+    if (step_dots != NULL) {
+        int unused = 0;
+        if (parse_bound(step_dots + 2, end, &seq->step, &unused) < 0) return -1;
+        if (seq->step < 0) seq->step = -seq->step;
+        if (seq->step == 0) seq->step = 1;
+    }
+
+    if (dots - p == 1 && last_end - last == 1 &&
+        !(*p >= '0' && *p <= '9') && !(*last >= '0' && *last <= '9')) {
+        seq->letters = 1;
+        seq->first = (unsigned char)*p;
+        seq->last = (unsigned char)*last;
+        return 0;
+    }
+    if (parse_bound(p, dots, &seq->first, &seq->width) < 0 ||
+        parse_bound(last, last_end, &seq->last, &seq->width) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Find the first brace expression in the word: an unquoted { whose
+// matching } encloses a top-level comma or a valid sequence. Returns 1
+// with *open and *close set, 0 if there is none.
+static int find_brace_expression(const char* word, const char* end, const char** open,
+                                 const char** close, brace_sequence_t* seq, int* is_sequence) {
+    for (const char* p = word; p < end; p++) {
+        const char* skipped = skip_quoted(p, end);
+        if (skipped == NULL) return 0;
+        if (skipped != p || *p != '{') {
+            p = skipped;
+            continue;
+        }
+
+        int depth = 0, comma = 0;
+        const char* q = p + 1;
+        for (; q < end; q++) {
+            const char* inner = skip_quoted(q, end);
+            if (inner == NULL) return 0;
+            if (inner != q) {
+                q = inner;
+            } else if (*q == '{') {
+                depth++;
+            } else if (*q == '}') {
+                if (depth-- == 0) break;
+            } else if (*q == ',' && depth == 0) {
+                comma = 1;
+            }
+        }
+        if (q >= end) {
+            continue;  // Unmatched: a literal {
+        }
+        *is_sequence = !comma && parse_sequence(p + 1, q, seq) == 0;
+        if (comma || *is_sequence) {
+            *open = p;
+            *close = q;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Expand prefix + middle + suffix as a word of its own (it may hold more
+// braces). buffer is reused between variants.
+static int expand_variant(strbuf_t* buffer, const char* word, const char* open,
+                          const char* middle, size_t middle_len, const char* suffix,
+                          wordlist_t* out) {
+    buffer->len = 0;
+    strbuf_append(buffer, word, open - word);
+    strbuf_append(buffer, middle, middle_len);
+    strbuf_append(buffer, suffix, strlen(suffix));
+    if (buffer->data == NULL) {
+        return -1;
+    }
+    return expand_word(buffer->data, out);
+}
+
+// Expand the first brace expression of word, if any. Returns 1 when the
+// word was expanded, 0 when it has no brace expression, -1 on failure.
+static int expand_braces(const char* word, wordlist_t* out) {
+    const char* end = word + strlen(word);
+    const char *open, *close;
+    brace_sequence_t seq;
+    int is_sequence;
+    if (!find_brace_expression(word, end, &open, &close, &seq, &is_sequence)) {
+        return 0;
+    }
+
+    strbuf_t buffer;
+    strbuf_init(&buffer, out->arena, (end - word) + 24);
+    const char* suffix = close + 1;
+
+    if (is_sequence) {
+        long step = seq.first <= seq.last ? seq.step : -seq.step;
+        for (long value = seq.first;
+             step > 0 ? value <= seq.last : value >= seq.last; value += step) {
+            char text[32];
+            int len;
+            if (seq.letters) {
+                text[0] = (char)value;
+                len = 1;
+            } else if (value < 0 && seq.width > 0) {
+                len = snprintf(text, sizeof(text), "-%0*ld", seq.width - 1, -value);
+            } else {
+                len = snprintf(text, sizeof(text), "%0*ld", seq.width, value);
+            }
+            if (expand_variant(&buffer, word, open, text, len, suffix, out) < 0) {
+                return -1;
+            }
+            if (step > 0 ? value > LONG_MAX - step : value < LONG_MIN - step) {
+                break;
+            }
+        }
+        return 1;
+    }
+
+    // Alternatives are split at top-level commas
+    const char* item = open + 1;
+    int depth = 0;
+    for (const char* p = open + 1; p <= close; p++) {
+        const char* skipped = p < close ? skip_quoted(p, close) : p;
+        if (skipped != p) {
+            p = skipped;
+            continue;
+        }
+        if (*p == '{') {
+            depth++;
+        } else if (*p == '}' && depth > 0) {
+            depth--;
+        } else if ((*p == ',' && depth == 0) || p == close) {
+            if (expand_variant(&buffer, word, open, item, p - item, suffix, out) < 0) {
+                return -1;
+            }
+            item = p + 1;
+        }
+    }
+    return 1;
+}
+
+// Expand one raw word into zero or more fields appended to out: braces
+// are expanded, quotes are removed, the results of unquoted expansions
+// are split at blanks and fields with wildcards are globbed. Returns -1
+// if expansion failed (the error is already printed).
+int expand_word(const char* word, wordlist_t* out) {
+    if (strchr(word, '{') != NULL) {
+        int expanded = expand_braces(word, out);
+        if (expanded != 0) {
+            return expanded < 0 ? -1 : 0;
+        }
+    }
+    return expand_fields(word, out);
+}
+
+// Expand one raw word into a single string without field splitting
+// (assignment values and redirection targets)
+char* expand_word_string(const char* word, arena_t* arena) {
+    size_t len = strlen(word);
+    strbuf_t result;
+    strbuf_init(&result, arena, len + 16);
+    if (result.data == NULL) return NULL;
+
+    if (expand_range(&result, word, word + len, 0) < 0) {
+        return NULL;
+    }
+    return result.data;
+}
+
+// Expand the body of an unquoted here-document. $ references are
+// expanded and a backslash escapes $, ` and \ (or joins lines), but
+// quotes are ordinary characters.
+char* expand_heredoc(const char* body, arena_t* arena) {
+    size_t len = strlen(body);
+    const char* p = body;
+    const char* end = body + len;
+    strbuf_t result;
+    strbuf_init(&result, arena, len + 64);
+    if (result.data == NULL) return NULL;
+
+    while (p < end) {
+        const char* run = p;
+        while (p < end && *p != '$' && *p != '\\' && *p != '`') p++;
+        strbuf_append(&result, run, p - run);
+        if (p >= end) break;
+
+        if (*p == '`') {
+            const char* close = find_closing_backquote(p + 1, end);
+            if (close == NULL) {
+                fprintf(stderr, "Syntax error: missing '`' in command substitution\n");
+                return NULL;
+            }
+            if (expand_backquote(&result, p + 1, close) < 0) {
+                return NULL;
+            }
+            p = close + 1;
+        } else if (*p == '\\') {
+            if (p + 1 < end && p[1] == '\n') {
+                p += 2;
+            } else if (p + 1 < end && strchr("$`\\", p[1]) != NULL) {
+                strbuf_putc(&result, p[1]);
+                p += 2;
+            } else {
+                strbuf_putc(&result, *p++);
+            }
+        } else {
+            p++; // Skip the '$'
+            if (expand_dollar(&result, &p, end, 1) < 0) {
+                return NULL;
+            }
+        }
+    }
+    return result.data;
+}
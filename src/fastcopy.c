@@ -0,0 +1,241 @@
+#include "shell.h"
+#include <sys/sendfile.h>
+
+// In-process cat. `cat file > out`, `cat < in > out` and `cat a b >> log`
+// move data between files and pipes without starting a process and
+// without passing the bytes through user space: copy_file_range() between
+// regular files, sendfile() from a regular file to anything, splice()
+// when either side is a pipe, and read()/write() only when none of them
+// applies. Anything cat would need to format (options) or that could
+// block on a terminal is left to the real cat.
+
+#define COPY_CHUNK (64 * 1024 * 1024)     // Bytes per kernel copy call
+#define COPY_BUFFER_SIZE (128 * 1024)     // read()/write() fallback buffer
+
+// Copy methods, best first
+typedef enum {
+    COPY_FILE_RANGE,
+    COPY_SENDFILE,
+    COPY_SPLICE,
+    COPY_READ_WRITE
+} copy_method_t;
+
+// Set by Ctrl-C while a copy runs in the foreground of an interactive shell
+static volatile sig_atomic_t copy_interrupted = 0;
+
+static void copy_interrupt_handler(int sig) {
+    (void)sig;
+    copy_interrupted = 1;
+}
+
+// Whether a descriptor is something the fast path can read or write
+static int is_copy_endpoint(const struct stat* st) {
+    return S_ISREG(st->st_mode) || S_ISFIFO(st->st_mode);
+}
+
+// The best method for a pair of descriptors. Files that report a size of
+// zero (procfs, sysfs) are read the ordinary way, since the kernel copy
+// calls trust the size.
+static copy_method_t first_method(const struct stat* in, const struct stat* out) {
+    if (S_ISREG(in->st_mode) && in->st_size > 0) {
+        return S_ISREG(out->st_mode) ? COPY_FILE_RANGE : COPY_SENDFILE;
+    }
+    if (S_ISFIFO(in->st_mode) || S_ISFIFO(out->st_mode)) {
+        return COPY_SPLICE;
+    }
+    return COPY_READ_WRITE;
+}
+
+// The method to try after one that the kernel refused for these files
+static copy_method_t next_method(copy_method_t method, const struct stat* in,
+                                 const struct stat* out) {
+    if (method == COPY_FILE_RANGE) {
+        return COPY_SENDFILE;
+    }
+    if (method == COPY_SENDFILE && (S_ISFIFO(in->st_mode) || S_ISFIFO(out->st_mode))) {
+        return COPY_SPLICE;
+    }
+    return COPY_READ_WRITE;
+}
+
+// Whether an error means the method does not work for these files (as
+// opposed to a real read or write error)
+static int method_unsupported(copy_method_t method, int err) {
+    return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EXDEV ||
+           (method == COPY_FILE_RANGE && err == EBADF);  // Output opened with O_APPEND
+}
+
+// Write all of buf, retrying short writes
+static int write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR && !copy_interrupted) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Move one chunk from in to out. Returns the bytes moved, 0 at the end
+// of the input, or -1 with errno set.
+static ssize_t copy_chunk(copy_method_t method, int in, int out) {
+    static char buffer[COPY_BUFFER_SIZE];
+    ssize_t n;
+
+    switch (method) {
+        case COPY_FILE_RANGE:
+            return copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+        case COPY_SENDFILE:
+            return sendfile(out, in, NULL, COPY_CHUNK);
+        case COPY_SPLICE:
+            return splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE);
+        default:
+            n = read(in, buffer, sizeof(buffer));
+            if (n > 0 && write_all(out, buffer, n) < 0) {
+                return -1;
+            }
+            return n;
+    }
+}
+
+// Copy everything from in to stdout. Returns 0, or the status of a
+// failed cat after reporting the error.
+static int copy_to_stdout(int in, const char* name, const struct stat* in_st,
+                          const struct stat* out_st) {
+    copy_method_t method = first_method(in_st, out_st);
+    while (1) {
+        ssize_t n = copy_chunk(method, in, STDOUT_FILENO);
+        if (n > 0) {
+            if (copy_interrupted) {
+                return 128 + SIGINT;
+            }
+            continue;
+        }
+        if (n == 0) {
+            return 0;
+        }
+
+        if (copy_interrupted) {
+            return 128 + SIGINT;
+        }
+        if (errno == EINTR || errno == EAGAIN) {
+            continue;
+        }
+        if (method != COPY_READ_WRITE && method_unsupported(method, errno)) {
+            method = next_method(method, in_st, out_st);
+            continue;
+        }
+        if (errno == EPIPE) {
+            return 128 + SIGPIPE;  // What the reader closing would do to cat
+        }
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+        return 1;
+    }
+}
+
+// Whether an argument of cat names an input (rather than an option)
+static int is_operand(const char* arg) {
+    return arg[0] != '-' || arg[1] == '\0';
+}
+
+// Copy the inputs of an expanded `cat [file...]` to stdout (with the
+// command's redirections in place)
+static int run_cat(command_t* cmd, const struct stat* out_st) {
+    static char* stdin_only[] = { "cat", "-", NULL };
+    char** args = cmd->argc > 1 ? cmd->args : stdin_only;
+    int status = 0;
+
+    for (int i = 1; args[i] != NULL && status < 128; i++) {
+        int from_stdin = strcmp(args[i], "-") == 0;
+        const char* name = from_stdin ? "-" : args[i];
+        int in = from_stdin ? STDIN_FILENO : open(args[i], O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        struct stat in_st;
+        int result = 0;
+        if (fstat(in, &in_st) < 0) {
+            fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+            result = 1;
+        } else if (S_ISDIR(in_st.st_mode)) {
+            fprintf(stderr, "cat: %s: Is a directory\n", name);
+            result = 1;
+        } else if (S_ISREG(in_st.st_mode) && S_ISREG(out_st->st_mode) &&
+                   in_st.st_dev == out_st->st_dev && in_st.st_ino == out_st->st_ino &&
+                   lseek(STDOUT_FILENO, 0, SEEK_CUR) < in_st.st_size) {
+            fprintf(stderr, "cat: %s: input file is output file\n", name);
+            result = 1;
+        } else {
+            result = copy_to_stdout(in, name, &in_st, out_st);
+        }
+
+        if (!from_stdin) {
+            close(in);
+        }
+        if (result != 0) {
+            status = result;
+        }
+    }
+    return status;
+}
+
+// Run cat in the shell itself when it only moves bytes between regular
+// files and pipes. Returns the exit status, or -1 if the command has to
+// be run the normal way (nothing has been read or written then).
+int try_fast_copy(command_t* cmd, arena_t* arena) {
+    if (strcmp(cmd->args[0], "cat") != 0) {
+        return -1;
+    }
+    int reads_stdin = cmd->argc == 1;
+    for (int i = 1; i < cmd->argc; i++) {
+        if (!is_operand(cmd->args[i])) {
+            return -1;
+        }
+        reads_stdin |= strcmp(cmd->args[i], "-") == 0;
+    }
+
+    saved_fd_t* saved = NULL;
+    fflush(stdout);
+    if (cmd->redirs != NULL && redirect_in_process(cmd->redirs, &saved, arena) < 0) {
+        return 1;
+    }
+
+    // Terminals (and anything else that is not a file or pipe) go to the
+    // real cat, which can be stopped and interrupted as a job
+    struct stat out_st, in_st;
+    if (fstat(STDOUT_FILENO, &out_st) < 0 || !is_copy_endpoint(&out_st) ||
+        (reads_stdin && (fstat(STDIN_FILENO, &in_st) < 0 || !is_copy_endpoint(&in_st)))) {
+        restore_redirections(saved);
+        return -1;
+    }
+
+    // A reader that goes away must not kill the shell, and Ctrl-C must
+    // still stop a long copy when the shell itself ignores it
+    struct sigaction ignore_pipe = {0}, old_pipe, on_interrupt = {0}, old_interrupt;
+    ignore_pipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore_pipe, &old_pipe);
+    int job_control = job_control_enabled();
+    if (job_control) {
+        on_interrupt.sa_handler = copy_interrupt_handler;
+        sigaction(SIGINT, &on_interrupt, &old_interrupt);
+    }
+    copy_interrupted = 0;
+
+    int status = run_cat(cmd, &out_st);
+
+    if (job_control) {
+        sigaction(SIGINT, &old_interrupt, NULL);
+        if (copy_interrupted) {
+            putchar('\n');
+        }
+    }
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    restore_redirections(saved);
+    return status;
+}
@@ -0,0 +1,212 @@
+#include "shell.h"
+
+// Output formatting for the echo and printf built-ins: backslash escapes
+// and printf conversions. Everything is written to stdout.
+
+// Decode the escape sequence after a backslash (p points at the letter).
+// Octal numbers are \0nnn for echo and %b, \nnn in printf formats. Sets
+// *ch to the byte (-1 for \c) and returns the position after the escape.
+static const char* decode_escape(const char* p, int printf_format, int* ch) {
+    switch (*p) {
+        case 'a':  *ch = '\a'; return p + 1;
+        case 'b':  *ch = '\b'; return p + 1;
+        case 'e':  *ch = 27; return p + 1;
+        case 'f':  *ch = '\f'; return p + 1;
+        case 'n':  *ch = '\n'; return p + 1;
+        case 'r':  *ch = '\r'; return p + 1;
+        case 't':  *ch = '\t'; return p + 1;
+        case 'v':  *ch = '\v'; return p + 1;
+        case '\\': *ch = '\\'; return p + 1;
+        case 'c':  *ch = -1; return p + 1;
+        default:   break;
+    }
+
+    if (*p >= '0' && *p <= '7') {
+        // Up to three octal digits, after the 0 in the echo form
+        if (!printf_format && *p == '0') p++;
+        int value = 0;
+        for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++, p++) {
+            value = value * 8 + (*p - '0');
+        }
+        *ch = value & 0xff;
+        return p;
+    }
+
+    // Unknown escape: keep the backslash
+    *ch = '\\';
+    return p;
+}
+
+// Write str with backslash escapes interpreted (echo -e, printf %b).
+// Returns 1 if a \c asked for output to stop, else 0.
+int print_escaped(const char* str, size_t len) {
+    const char* end = str + len;
+    while (str < end) {
+        const char* run = str;
+        while (str < end && *str != '\\') str++;
+        fwrite(run, 1, str - run, stdout);
+        if (str >= end) break;
+
+        if (str + 1 >= end) {
+            putchar('\\');
+            break;
+        }
+        int ch;
+        str = decode_escape(str + 1, 0, &ch);
+        if (ch < 0) return 1;
+        putchar(ch);
+    }
+    return 0;
+}
+
+// Numeric argument of a conversion. Reports arguments that are not
+// numbers and sets *status to 1, like other shells.
+static long numeric_arg(const char* arg, int* status) {
+    if (arg == NULL || *arg == '\0') {
+        return 0;
+    }
+    // 'c and "c give the character's code
+    if (*arg == '\'' || *arg == '"') {
+        return (unsigned char)arg[1];
+    }
+    char* end;
+    errno = 0;
+    long value = strtol(arg, &end, 0);
+    if (*end != '\0' || errno != 0) {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+// Floating point argument of %f, %e and %g
+static double float_arg(const char* arg, int* status) {
+    if (arg == NULL || *arg == '\0') {
+        return 0;
+    }
+    char* end;
+    double value = strtod(arg, &end);
+    if (*end != '\0') {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *status = 1;
+    }
+    return value;
+}
+
+// Run a printf format over args. The format is reused while arguments
+// remain, and missing arguments count as empty strings or zero. Returns
+// the exit status.
+int format_output(const char* format, char** args) {
+    int status = 0;
+
+    while (1) {
+        int used = 0;
+        const char* p = format;
+
+        while (*p) {
+            if (*p == '\\') {
+                int ch;
+                p = decode_escape(p + 1, 1, &ch);
+                if (ch < 0) return status;
+                putchar(ch);
+                continue;
+            }
+            if (*p != '%') {
+                const char* run = p;
+                while (*p && *p != '%' && *p != '\\') p++;
+                fwrite(run, 1, p - run, stdout);
+                continue;
+            }
+            if (p[1] == '%') {
+                putchar('%');
+                p += 2;
+                continue;
+            }
+
+            // %[flags][width][.precision]conversion, rebuilt for printf(3)
+            char spec[64];
+            size_t n = 0;
+            spec[n++] = *p++;
+            while (*p && strchr("-+ #0", *p) && n < 8) spec[n++] = *p++;
+
+            // A * width or precision takes its value from the arguments
+            if (*p == '*') {
+                int width = (int)numeric_arg(*args ? *args++ : NULL, &status);
+                n += snprintf(spec + n, 16, "%d", width);
+                used = 1;
+                p++;
+            } else {
+                while (*p >= '0' && *p <= '9' && n < 24) spec[n++] = *p++;
+            }
+            if (*p == '.') {
+                spec[n++] = *p++;
+                if (*p == '*') {
+                    int precision = (int)numeric_arg(*args ? *args++ : NULL, &status);
+                    n += snprintf(spec + n, 16, "%d", precision);
+                    used = 1;
+                    p++;
+                } else {
+                    while (*p >= '0' && *p <= '9' && n < 48) spec[n++] = *p++;
+                }
+            }
+
+            char conv = *p;
+            if (conv == '\0') {
+                fprintf(stderr, "printf: missing conversion in `%s'\n", format);
+                return 1;
+            }
+            p++;
+
+            const char* arg = NULL;
+            if (strchr("diouxXfFeEgGcsb", conv) != NULL) {
+                arg = *args;
+                if (arg != NULL) args++;
+                used = 1;
+            }
+
+            switch (conv) {
+                case 'd': case 'i':
+                    spec[n++] = 'l';
+                    spec[n++] = conv;
+                    spec[n] = '\0';
+                    printf(spec, numeric_arg(arg, &status));
+                    break;
+                case 'o': case 'u': case 'x': case 'X':
+                    spec[n++] = 'l';
+                    spec[n++] = conv;
+                    spec[n] = '\0';
+                    printf(spec, (unsigned long)numeric_arg(arg, &status));
+                    break;
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+                    spec[n++] = conv;
+                    spec[n] = '\0';
+                    printf(spec, float_arg(arg, &status));
+                    break;
+                case 'c':
+                    spec[n++] = 'c';
+                    spec[n] = '\0';
+                    printf(spec, arg && *arg ? *arg : '\0');
+                    break;
+                case 's':
+                    spec[n++] = 's';
+                    spec[n] = '\0';
+                    printf(spec, arg ? arg : "");
+                    break;
+                case 'b':
+                    if (arg != NULL && print_escaped(arg, strlen(arg)) > 0) {
+                        return status;
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "printf: %%%c: invalid conversion\n", conv);
+                    return 1;
+            }
+        }
+
+        // Reuse the format only if it consumed arguments and some are left
+        if (!used || *args == NULL) {
+            break;
+        }
+    }
+    return status;
+}
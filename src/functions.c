@@ -0,0 +1,119 @@
+#include "shell.h"
+
+// Shell functions. A definition copies the body's syntax tree out of the
+// input's arena into an arena of its own, so a call just walks that tree:
+// no parsing and no fork. Functions are found through a small chained
+// hash table keyed by name.
+
+#define FUNCTION_BUCKETS 64   // Power of two
+#define MAX_FUNCTION_DEPTH 1000
+
+static function_t* buckets[FUNCTION_BUCKETS];
+static int call_depth = 0;
+
+// FNV-1a hash of a function name
+static unsigned int hash_name(const char* name) {
+    unsigned int h = 2166136261u;
+    for (const char* p = name; *p; p++) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    return h & (FUNCTION_BUCKETS - 1);
+}
+
+static void free_function(function_t* fn) {
+    arena_release(&fn->arena);
+    free(fn);
+}
+
+// Take a function out of use. One that is still running is freed when
+// its last call returns.
+static void retire_function(function_t* fn) {
+    if (fn->calls > 0) {
+        fn->retired = 1;
+    } else {
+        free_function(fn);
+    }
+}
+
+// Find the link pointing at name's entry (or at the NULL ending its bucket)
+static function_t** find_link(const char* name) {
+    function_t** link = &buckets[hash_name(name)];
+    while (*link != NULL && strcmp((*link)->name, name) != 0) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Define (or redefine) a function. Returns 0, or -1 if out of memory.
+int define_function(const char* name, node_t* body) {
+    function_t* fn = calloc(1, sizeof(function_t));
+    if (fn == NULL) {
+        perror("calloc");
+        return -1;
+    }
+    fn->name = arena_strndup(&fn->arena, name, strlen(name));
+    fn->body = copy_node(body, &fn->arena);
+    if (fn->name == NULL || fn->body == NULL) {
+        free_function(fn);
+        return -1;
+    }
+
+    function_t** link = find_link(name);
+    if (*link != NULL) {
+        fn->next = (*link)->next;
+        retire_function(*link);
+    }
+    *link = fn;
+    return 0;
+}
+
+function_t* find_function(const char* name) {
+    if (name == NULL) {
+        return NULL;
+    }
+    return *find_link(name);
+}
+
+// Remove a function. Returns -1 if there is none with that name.
+int unset_function(const char* name) {
+    function_t** link = find_link(name);
+    function_t* fn = *link;
+    if (fn == NULL) {
+        return -1;
+    }
+    *link = fn->next;
+    retire_function(fn);
+    return 0;
+}
+
+// Call a function with args[1..argc-1] as its positional parameters.
+// Returns the status of `return`, or of the body's last command.
+int call_function(function_t* fn, int argc, char** args) {
+    if (call_depth >= MAX_FUNCTION_DEPTH) {
+        fprintf(stderr, "%s: maximum function nesting level exceeded (%d)\n",
+                fn->name, MAX_FUNCTION_DEPTH);
+        return 1;
+    }
+
+    positional_t saved;
+    set_positional(args + 1, argc - 1, &saved);
+    int scope = push_variable_scope();
+    int loops;
+    enter_function(&loops);
+    fn->calls++;
+    call_depth++;
+
+    // A Ctrl-C has to stop recursion too, not just loops
+    int status = interrupt_pending() ? 128 + SIGINT : execute_node(fn->body);
+
+    call_depth--;
+    fn->calls--;
+    status = leave_function(loops, status);
+    pop_variable_scope(scope);
+    restore_positional(&saved);
+
+    if (fn->retired && fn->calls == 0) {
+        free_function(fn);
+    }
+    return status;
+}
@@ -0,0 +1,509 @@
+#include "shell.h"
+#include <stdint.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+
+// Filename generation (*, ? and [...]). A pattern is split at '/' and
+// expanded one component at a time. Each wildcard component is compiled
+// once into a small matcher (literal prefix and suffix checks first, so
+// `*.tmp` over a large directory is mostly a length test and one memcmp)
+// and run over the directory's names. Directories are read in large
+// getdents64() batches and their listings cached until the current
+// command line finishes; a cached listing is reused only while the
+// directory's identity and mtime are unchanged, so commands on the same
+// line that create or remove files are still seen.
+//
+// Patterns come from expand_word() with quoted characters escaped by a
+// backslash. Names starting with '.' only match a pattern that starts
+// with a literal '.', and . and .. are never matched. Results are sorted
+// byte-wise.
+
+#define GLOB_READ_BUFFER (256 * 1024)   // Bytes per getdents64() call
+#define GLOB_CACHE_BUCKETS 64           // Power of two
+
+// Record layout returned by getdents64()
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} dirent64_record_t;
+
+// One name in a directory listing
+typedef struct {
+    const char* name;
+    unsigned char type;      // DT_* (DT_UNKNOWN if the filesystem does not say)
+} glob_entry_t;
+
+// Cached listing of one directory
+typedef struct dir_listing {
+    char* path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    glob_entry_t* entries;
+    int count;
+    arena_t arena;           // Path, names and entries
+    struct dir_listing* next;
+} dir_listing_t;
+
+// Compiled matcher for one path component
+typedef enum {
+    PAT_LITERAL,             // Fixed text
+    PAT_ANY,                 // ?
+    PAT_STAR,                // *
+    PAT_CLASS                // [...]
+} pat_op_type_t;
+
+typedef struct {
+    pat_op_type_t type;
+    const char* text;        // PAT_LITERAL
+    size_t len;
+    const uint8_t* set;      // PAT_CLASS: 256-bit membership bitmap
+} pat_op_t;
+
+typedef struct {
+    pat_op_t* ops;
+    int count;
+    int wildcard;            // Has any op other than PAT_LITERAL
+    int stars;               // Number of PAT_STAR ops
+    const char* literal;     // The unescaped component when !wildcard
+} glob_pattern_t;
+
+static dir_listing_t* listing_cache[GLOB_CACHE_BUCKETS];
+static char* read_buffer = NULL;
+
+static uint32_t hash_path(const char* path) {
+    uint32_t h = 2166136261u;
+    for (; *path; path++) {
+        h = (h ^ (unsigned char)*path) * 16777619u;
+    }
+    return h;
+}
+
+// Drop the directory listings cached for the current command line
+void glob_cache_reset() {
+    for (int i = 0; i < GLOB_CACHE_BUCKETS; i++) {
+        dir_listing_t* listing = listing_cache[i];
+        while (listing != NULL) {
+            dir_listing_t* next = listing->next;
+            arena_release(&listing->arena);
+            free(listing);
+            listing = next;
+        }
+        listing_cache[i] = NULL;
+    }
+}
+
+// Read every name of the open directory fd into listing (. and .. left
+// out). Returns 0, or -1 on a read error.
+static int read_listing(dir_listing_t* listing, int fd) {
+    if (read_buffer == NULL && (read_buffer = malloc(GLOB_READ_BUFFER)) == NULL) {
+        return -1;
+    }
+
+    int cap = 256;
+    listing->count = 0;
+    listing->entries = arena_alloc(&listing->arena, cap * sizeof(glob_entry_t));
+    if (listing->entries == NULL) {
+        return -1;
+    }
+
+    while (1) {
+        long n = syscall(SYS_getdents64, fd, read_buffer, GLOB_READ_BUFFER);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+
+        for (long offset = 0; offset < n;) {
+            dirent64_record_t* record = (dirent64_record_t*)(read_buffer + offset);
+            offset += record->d_reclen;
+            const char* name = record->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            if (listing->count == cap) {
+                glob_entry_t* grown = arena_extend(&listing->arena, listing->entries,
+                                                   cap * sizeof(glob_entry_t),
+                                                   cap * 2 * sizeof(glob_entry_t));
+                if (grown == NULL) {
+                    return -1;
+                }
+                listing->entries = grown;
+                cap *= 2;
+            }
+            glob_entry_t* entry = &listing->entries[listing->count];
+            entry->name = arena_strndup(&listing->arena, name, strlen(name));
+            if (entry->name == NULL) {
+                return -1;
+            }
+            entry->type = record->d_type;
+            listing->count++;
+        }
+    }
+}
+
+// The names in directory path ("" for the current directory), from the
+// cache when the directory has not changed. NULL if it cannot be read.
+static dir_listing_t* get_listing(const char* path) {
+    const char* dir = path[0] != '\0' ? path : ".";
+    struct stat st;
+    if (stat(dir, &st) < 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    dir_listing_t** bucket = &listing_cache[hash_path(path) & (GLOB_CACHE_BUCKETS - 1)];
+    dir_listing_t* listing = *bucket;
+    while (listing != NULL && strcmp(listing->path, path) != 0) {
+        listing = listing->next;
+    }
+    if (listing != NULL && listing->dev == st.st_dev && listing->ino == st.st_ino &&
+        listing->mtime.tv_sec == st.st_mtim.tv_sec &&
+        listing->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return listing;
+    }
+
+    if (listing == NULL) {
+        listing = calloc(1, sizeof(dir_listing_t));
+        if (listing == NULL) {
+            return NULL;
+        }
+        listing->next = *bucket;
+        *bucket = listing;
+    } else {
+        arena_reset(&listing->arena);  // Changed since it was read
+    }
+    listing->path = arena_strndup(&listing->arena, path, strlen(path));
+    listing->count = 0;
+
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || listing->path == NULL || read_listing(listing, fd) < 0) {
+        if (fd >= 0) close(fd);
+        if (listing->path == NULL) listing->path = "";
+        listing->count = 0;
+        listing->mtime.tv_nsec = -1;  // Read again on the next lookup
+        return NULL;
+    }
+    close(fd);
+
+    // Stat before reading, so a change during the read forces a re-read
+    listing->dev = st.st_dev;
+    listing->ino = st.st_ino;
+    listing->mtime = st.st_mtim;
+    return listing;
+}
+
+// Add the characters of a POSIX class name ([:alpha:] etc.) to set.
+// Returns -1 for an unknown name.
+static int add_named_class(uint8_t* set, const char* name, size_t len) {
+    static const struct {
+        const char* name;
+        int (*test)(int);
+    } classes[] = {
+        { "alpha", isalpha }, { "digit", isdigit }, { "alnum", isalnum },
+        { "upper", isupper }, { "lower", islower }, { "space", isspace },
+        { "blank", isblank }, { "punct", ispunct }, { "xdigit", isxdigit },
+        { "print", isprint }, { "graph", isgraph }, { "cntrl", iscntrl },
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0) {
+            for (int c = 0; c < 256; c++) {
+                if (classes[i].test(c)) set[c >> 3] |= 1 << (c & 7);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Compile the bracket expression starting at p (just past the '['). Returns
+// the position after the closing ']', or NULL if it is not a valid
+// bracket expression (the '[' is then literal).
+static const char* compile_class(const char* p, const char* end, uint8_t* set) {
+    int negate = p < end && (*p == '!' || *p == '^');
+    if (negate) p++;
+
+    int first = 1;
+    while (p < end && (*p != ']' || first)) {
+        first = 0;
+        if (*p == '[' && p + 1 < end && p[1] == ':') {
+            const char* close = p + 2;
+            while (close + 1 < end && !(close[0] == ':' && close[1] == ']')) close++;
+            if (close + 1 < end && add_named_class(set, p + 2, close - (p + 2)) == 0) {
+                p = close + 2;
+                continue;
+            }
+        }
+
+        unsigned char low = *p == '\\' && p + 1 < end ? *++p : *p;
+        p++;
+        unsigned char high = low;
+        if (p + 1 < end && *p == '-' && p[1] != ']') {
+            p++;
+            high = *p == '\\' && p + 1 < end ? *++p : *p;
+            p++;
+        }
+        for (int c = low; c <= high; c++) {
+            set[c >> 3] |= 1 << (c & 7);
+        }
+    }
+    if (p >= end) {
+        return NULL;
+    }
+    if (negate) {
+        for (int i = 0; i < 32; i++) set[i] = ~set[i];
+    }
+    return p + 1;
+}
+
+// Compile the component between p and end (escaped with backslashes)
+static int compile_pattern(const char* p, const char* end, glob_pattern_t* pat, arena_t* arena) {
+    memset(pat, 0, sizeof(glob_pattern_t));
+    pat->ops = arena_alloc(arena, (end - p + 1) * sizeof(pat_op_t));
+    char* literal = arena_alloc(arena, end - p + 1);
+    if (pat->ops == NULL || literal == NULL) {
+        return -1;
+    }
+    pat->literal = literal;
+
+    // Literal runs are unescaped into one buffer, each op pointing into it
+    char* run = literal;
+    char* out = literal;
+    while (p < end) {
+        pat_op_t op = {0};
+        if (*p == '*') {
+            op.type = PAT_STAR;
+            while (p < end && *p == '*') p++;
+            pat->stars++;
+        } else if (*p == '?') {
+            op.type = PAT_ANY;
+            p++;
+        } else if (*p == '[') {
+            uint8_t* set = arena_alloc(arena, 32);
+            if (set == NULL) return -1;
+            memset(set, 0, 32);
+            const char* next = compile_class(p + 1, end, set);
+            if (next != NULL) {
+                op.type = PAT_CLASS;
+                op.set = set;
+                p = next;
+            }
+        }
+
+        if (op.type == PAT_LITERAL) {
+            if (*p == '\\' && p + 1 < end) p++;
+            *out++ = *p++;
+            continue;
+        }
+        if (out > run) {
+            pat->ops[pat->count++] = (pat_op_t){ .type = PAT_LITERAL, .text = run,
+                                                 .len = out - run };
+            run = out;
+        }
+        pat->ops[pat->count++] = op;
+        pat->wildcard = 1;
+    }
+    if (out > run) {
+        pat->ops[pat->count++] = (pat_op_t){ .type = PAT_LITERAL, .text = run, .len = out - run };
+    }
+    *out = '\0';
+    return 0;
+}
+
+static int in_set(const uint8_t* set, unsigned char c) {
+    return (set[c >> 3] >> (c & 7)) & 1;
+}
+
+// Match ops against name[0..len). A mismatch after a * retries with the
+// star taking one more character; only the last star needs retrying.
+static int match_ops(const pat_op_t* ops, int count, const char* name, size_t len) {
+    int op = 0, star_op = -1;
+    size_t pos = 0, star_pos = 0;
+    while (1) {
+        if (op < count) {
+            const pat_op_t* o = &ops[op];
+            switch (o->type) {
+                case PAT_STAR:
+                    star_op = op++;
+                    star_pos = pos;
+                    continue;
+                case PAT_LITERAL:
+                    if (len - pos >= o->len && memcmp(name + pos, o->text, o->len) == 0) {
+                        pos += o->len;
+                        op++;
+                        continue;
+                    }
+                    break;
+                case PAT_ANY:
+                    if (pos < len) {
+                        pos++;
+                        op++;
+                        continue;
+                    }
+                    break;
+                case PAT_CLASS:
+                    if (pos < len && in_set(o->set, name[pos])) {
+                        pos++;
+                        op++;
+                        continue;
+                    }
+                    break;
+            }
+        } else if (pos == len) {
+            return 1;
+        }
+        if (star_op < 0 || star_pos >= len) {
+            return 0;
+        }
+        pos = ++star_pos;
+        op = star_op + 1;
+    }
+}
+
+// Whether name matches the compiled component
+static int match_name(const glob_pattern_t* pat, const char* name) {
+    const pat_op_t* ops = pat->ops;
+    int count = pat->count;
+    if (name[0] == '.' && (count == 0 || ops[0].type != PAT_LITERAL || ops[0].text[0] != '.')) {
+        return 0;  // Hidden names need an explicit leading '.'
+    }
+
+    size_t len = strlen(name);
+    // Fixed text at either end is checked before the general matcher
+    if (count > 0 && ops[0].type == PAT_LITERAL) {
+        if (len < ops[0].len || memcmp(name, ops[0].text, ops[0].len) != 0) {
+            return 0;
+        }
+        name += ops[0].len;
+        len -= ops[0].len;
+        ops++;
+        count--;
+    }
+    if (count > 0 && ops[count - 1].type == PAT_LITERAL && pat->stars > 0) {
+        const pat_op_t* last = &ops[count - 1];
+        if (len < last->len || memcmp(name + len - last->len, last->text, last->len) != 0) {
+            return 0;
+        }
+        if (count == 2 && ops[0].type == PAT_STAR) {
+            return 1;  // prefix*suffix
+        }
+        len -= last->len;
+        count--;
+    }
+    if (count == 1 && ops[0].type == PAT_STAR) {
+        return 1;
+    }
+    return match_ops(ops, count, name, len);
+}
+
+// path joined with name, in arena
+static char* join_path(const char* path, const char* name, arena_t* arena) {
+    size_t path_len = strlen(path), name_len = strlen(name);
+    int slash = path_len > 0 && path[path_len - 1] != '/';
+    char* joined = arena_alloc(arena, path_len + slash + name_len + 1);
+    if (joined == NULL) return NULL;
+    memcpy(joined, path, path_len);
+    if (slash) joined[path_len] = '/';
+    memcpy(joined + path_len + slash, name, name_len + 1);
+    return joined;
+}
+
+// Whether an entry is a directory (following symlinks)
+static int entry_is_dir(const glob_entry_t* entry, const char* path) {
+    if (entry->type == DT_DIR) return 1;
+    if (entry->type != DT_LNK && entry->type != DT_UNKNOWN) return 0;
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Expand pattern (quoted characters escaped with a backslash) into the
+// sorted names it matches, appended to out. Returns the number of names
+// added (0 if nothing matched), or -1 if out of memory.
+int glob_expand(const char* pattern, wordlist_t* out) {
+    arena_t* arena = out->arena;
+    wordlist_t paths, next;
+    wordlist_init(&paths, arena, 4);
+    if (wordlist_add(&paths, pattern[0] == '/' ? "/" : "") < 0) {
+        return -1;
+    }
+
+    const char* p = pattern;
+    int after_wildcard = 0;
+    while (*p != '\0' && paths.count > 0) {
+        while (*p == '/') p++;
+        const char* end = p;
+        while (*end != '\0' && *end != '/') end++;
+        if (end == p) break;
+        int need_dir = *end == '/';
+
+        glob_pattern_t pat;
+        if (compile_pattern(p, end, &pat, arena) < 0) {
+            return -1;
+        }
+        wordlist_init(&next, arena, paths.count);
+
+        for (int i = 0; i < paths.count; i++) {
+            if (!pat.wildcard) {
+                char* joined = join_path(paths.words[i], pat.literal, arena);
+                if (joined == NULL) return -1;
+                // Names before the first wildcard are checked by reading
+                // the directory below them; later ones must exist
+                struct stat st;
+                if (after_wildcard && (need_dir ? stat(joined, &st) < 0 || !S_ISDIR(st.st_mode)
+                                                : lstat(joined, &st) < 0)) {
+                    continue;
+                }
+                if (wordlist_add(&next, joined) < 0) return -1;
+                continue;
+            }
+
+            dir_listing_t* listing = get_listing(paths.words[i]);
+            if (listing == NULL) continue;
+            for (int j = 0; j < listing->count; j++) {
+                const glob_entry_t* entry = &listing->entries[j];
+                if (!match_name(&pat, entry->name)) continue;
+                char* joined = join_path(paths.words[i], entry->name, arena);
+                if (joined == NULL) return -1;
+                if (need_dir && !entry_is_dir(entry, joined)) continue;
+                if (wordlist_add(&next, joined) < 0) return -1;
+            }
+        }
+
+        after_wildcard |= pat.wildcard;
+        paths = next;
+        p = end;
+    }
+
+    // A trailing slash keeps only directories (checked above) and is kept
+    size_t len = strlen(pattern);
+    if (len > 1 && pattern[len - 1] == '/') {
+        for (int i = 0; i < paths.count; i++) {
+            paths.words[i] = join_path(paths.words[i], "", arena);
+            if (paths.words[i] == NULL) return -1;
+        }
+    }
+
+    // Listings come in directory order; most results need sorting
+    int sorted = 1;
+    for (int i = 1; i < paths.count && sorted; i++) {
+        sorted = strcmp(paths.words[i - 1], paths.words[i]) <= 0;
+    }
+    if (!sorted) {
+        qsort(paths.words, paths.count, sizeof(char*), compare_names);
+    }
+    for (int i = 0; i < paths.count; i++) {
+        if (wordlist_add(out, paths.words[i]) < 0) return -1;
+    }
+    return paths.count;
+}
@@ -1,9 +1,268 @@
 #include "shell.h"
+#include <sys/mman.h>
 
-// Global history variables
-static char* history[HISTORY_SIZE];
-static int history_count = 0;
-static int history_start = 0;
+// Command history backed by an append-only file ($HISTFILE, default
+// ~/.myshell_history) with one command per line. The file is mapped at
+// startup and entries are served straight from the mapping; the line
+// index is only built the first time history is actually used. Commands
+// are appended with a single write(). If the file cannot be used the same
+// layout is kept in a malloc'd buffer instead.
+
+#define HISTORY_FILE_NAME ".myshell_history"
+#define HISTORY_MAP_SLACK (16 * 1024 * 1024)  // Mapped beyond EOF for appends
+
+static int history_fd = -1;
+static char* history_data = NULL;     // Mapped file or in-memory buffer
+static size_t history_size = 0;       // Bytes of valid data
+static size_t history_mapped = 0;     // Length of the mapping (0 if malloc'd)
+static size_t history_cap = 0;        // Capacity of the malloc'd buffer
+static char* history_path = NULL;
+
+// Line index: entry i spans offsets[i] .. offsets[i + 1] - 1 (newline)
+static size_t* offsets = NULL;
+static size_t entry_count = 0;
+static size_t offsets_cap = 0;
+static size_t indexed_bytes = 0;      // Data covered by the index
+static int index_built = 0;
+
+// Entries added to the search index so far (-1 until first search)
+static long search_indexed = -1;
+
+// Copy of the entry returned by get_history_command()
+static char* entry_buf = NULL;
+static size_t entry_buf_cap = 0;
+
+// Maximum number of entries kept (HISTSIZE variable)
+static size_t history_limit() {
+    char* value = get_variable("HISTSIZE");
+    if (value != NULL && *value != '\0') {
+        long n = atol(value);
+        if (n > 0) return (size_t)n;
+    }
+    return HISTORY_SIZE;
+}
+
+// Map the file (with slack for appends), replacing any older mapping
+static int map_history_file() {
+    struct stat st;
+    if (fstat(history_fd, &st) < 0) {
+        return -1;
+    }
+    size_t length = st.st_size + HISTORY_MAP_SLACK;
+    char* data = mmap(NULL, length, PROT_READ, MAP_SHARED, history_fd, 0);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+    if (history_mapped) {
+        munmap(history_data, history_mapped);
+    }
+    history_data = data;
+    history_mapped = length;
+    history_size = st.st_size;
+    return 0;
+}
+
+// Open and map the history file. Nothing is parsed here.
+void init_history() {
+    const char* path = get_variable("HISTFILE");
+    if (path != NULL && *path != '\0') {
+        history_path = strdup(path);
+    } else {
+        const char* home = get_variable("HOME");
+        if (home != NULL) {
+            history_path = malloc(strlen(home) + sizeof(HISTORY_FILE_NAME) + 1);
+            if (history_path) sprintf(history_path, "%s/%s", home, HISTORY_FILE_NAME);
+        }
+    }
+
+    if (history_path != NULL) {
+        history_fd = open(history_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    }
+    if (history_fd >= 0 && map_history_file() < 0) {
+        close(history_fd);
+        history_fd = -1;
+    }
+}
+
+// Index entries in data[indexed_bytes .. history_size)
+static void index_new_entries() {
+    while (indexed_bytes < history_size) {
+        const char* nl = memchr(history_data + indexed_bytes, '\n',
+                                history_size - indexed_bytes);
+        if (nl == NULL) break; // Ignore an unfinished last line
+
+        if (entry_count + 2 > offsets_cap) {
+            size_t cap = offsets_cap ? offsets_cap * 2 : 1024;
+            size_t* grown = realloc(offsets, cap * sizeof(size_t));
+            if (grown == NULL) return;
+            offsets = grown;
+            offsets_cap = cap;
+        }
+        if (entry_count == 0) {
+            offsets[0] = indexed_bytes;
+        }
+        indexed_bytes = nl - history_data + 1;
+        offsets[++entry_count] = indexed_bytes;
+    }
+}
+
+// Rewrite the file with only the newest limit entries once it holds
+// twice that many, so it cannot grow without bound
+static void compact_history(size_t limit) {
+    if (entry_count <= limit * 2 || history_fd < 0) {
+        return;
+    }
+
+    size_t keep_from = offsets[entry_count - limit];
+    char* tmp_path = malloc(strlen(history_path) + 8);
+    if (tmp_path == NULL) return;
+    sprintf(tmp_path, "%s.tmp", history_path);
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        size_t len = history_size - keep_from;
+        ssize_t written = write(fd, history_data + keep_from, len);
+        close(fd);
+        if (written == (ssize_t)len && rename(tmp_path, history_path) == 0) {
+            int new_fd = open(history_path, O_RDWR | O_APPEND | O_CLOEXEC);
+            if (new_fd >= 0) {
+                close(history_fd);
+                history_fd = new_fd;
+                if (map_history_file() == 0) {
+                    entry_count = 0;
+                    indexed_bytes = 0;
+                    index_new_entries();
+                    if (search_indexed >= 0) {
+                        // Entries were renumbered
+                        history_index_reset();
+                        search_indexed = 0;
+                    }
+                }
+            }
+        } else {
+            unlink(tmp_path);
+        }
+    }
+    free(tmp_path);
+}
+
+// Build the index on first use and pick up lines appended since
+static void ensure_index() {
+    if (history_fd >= 0) {
+        // Other shells may have appended to the same file
+        struct stat st;
+        if (fstat(history_fd, &st) == 0 && (size_t)st.st_size != history_size) {
+            if ((size_t)st.st_size > history_mapped) {
+                map_history_file();
+            } else {
+                history_size = st.st_size;
+            }
+        }
+    }
+    index_new_entries();
+    if (!index_built) {
+        index_built = 1;
+        compact_history(history_limit());
+    }
+}
+
+// Index of the first visible entry (only the newest HISTSIZE are shown)
+static size_t first_visible() {
+    size_t limit = history_limit();
+    return entry_count > limit ? entry_count - limit : 0;
+}
+
+// Number of visible history entries
+int history_count() {
+    ensure_index();
+    return (int)(entry_count - first_visible());
+}
+
+// Get entry n (1-based, visible numbering) without copying. The text is
+// not NUL-terminated; its length is stored in len.
+const char* history_entry(int n, size_t* len) {
+    ensure_index();
+    size_t base = first_visible();
+    if (n < 1 || (size_t)n > entry_count - base) {
+        return NULL;
+    }
+    size_t i = base + n - 1;
+    *len = offsets[i + 1] - offsets[i] - 1;
+    return history_data + offsets[i];
+}
+
+// Get entry i by its position in the whole file (0-based)
+const char* history_raw_entry(size_t i, size_t* len) {
+    if (i >= entry_count) {
+        return NULL;
+    }
+    *len = offsets[i + 1] - offsets[i] - 1;
+    return history_data + offsets[i];
+}
+
+// Bring the search index up to date; it is built on the first search
+static void sync_search_index() {
+    if (search_indexed < 0) {
+        search_indexed = 0;
+    }
+    while ((size_t)search_indexed < entry_count) {
+        size_t len;
+        const char* entry = history_raw_entry(search_indexed, &len);
+        history_index_add(search_indexed, entry, len);
+        search_indexed++;
+    }
+}
+
+// Newest entry numbered below before that starts with prefix (or
+// contains it, if substring is set). Returns 0 if there is none.
+int history_find(const char* pattern, size_t len, int substring, int before) {
+    ensure_index();
+    sync_search_index();
+
+    size_t base = first_visible();
+    if (before < 1) {
+        return 0;
+    }
+    size_t hi = base + before - 1;
+    if (hi > entry_count) {
+        hi = entry_count;
+    }
+
+    long id = substring ? history_index_find_substring(pattern, len, base, hi)
+                        : history_index_find_prefix(pattern, len, base, hi);
+    return id < 0 ? 0 : (int)(id - base + 1);
+}
+
+// Print entries containing pattern, oldest first (history -s)
+int print_history_matches(const char* pattern) {
+    size_t len = strlen(pattern);
+    int count = 0, cap = 0;
+    int* found = NULL;
+
+    // Matches come newest first
+    int n = history_find(pattern, len, 1, history_count() + 1);
+    while (n > 0) {
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            int* grown = realloc(found, cap * sizeof(int));
+            if (grown == NULL) {
+                perror("realloc failed");
+                break;
+            }
+            found = grown;
+        }
+        found[count++] = n;
+        n = history_find(pattern, len, 1, n);
+    }
+
+    for (int i = count - 1; i >= 0; i--) {
+        size_t entry_len;
+        const char* entry = history_entry(found[i], &entry_len);
+        printf("%d %.*s\n", found[i], (int)entry_len, entry);
+    }
+    free(found);
+    return count;
+}
 
 // Add a command to history
 void add_to_history(const char* cmd) {
@@ -11,53 +270,106 @@ void add_to_history(const char* cmd) {
     if (cmd == NULL || cmd[0] == '\0' || cmd[0] == '\n') {
         return;
     }
+    size_t len = strlen(cmd);
+    if (memchr(cmd, '\n', len) != NULL) {
+        return; // Entries are single lines
+    }
     
     // Skip if same as last command
-    if (history_count > 0) {
-        int last_index = (history_start + history_count - 1) % HISTORY_SIZE;
-        if (strcmp(history[last_index], cmd) == 0) {
+    ensure_index();
+    if (entry_count > 0) {
+        size_t last_len;
+        const char* last = history_entry(history_count(), &last_len);
+        if (last != NULL && last_len == len && memcmp(last, cmd, len) == 0) {
             return;
         }
     }
-    
-    // Allocate memory for the new command
-    char* cmd_copy = malloc(strlen(cmd) + 1);
-    if (cmd_copy == NULL) {
+
+    // One write appends the whole line, even with other shells writing
+    char* line = malloc(len + 1);
+    if (line == NULL) {
         perror("malloc failed");
         return;
     }
-    strcpy(cmd_copy, cmd);
-    
-    // Add to history array (circular buffer)
-    int index = (history_start + history_count) % HISTORY_SIZE;
-    
-    // If buffer is full, free the oldest command
-    if (history_count == HISTORY_SIZE) {
-        free(history[history_start]);
-        history_start = (history_start + 1) % HISTORY_SIZE;
-        history_count--;
+    memcpy(line, cmd, len);
+    line[len] = '\n';
+
+    if (history_fd >= 0 && write(history_fd, line, len + 1) == (ssize_t)(len + 1)) {
+        free(line);
+        ensure_index();
+        compact_history(history_limit());
+        if (search_indexed >= 0) {
+            sync_search_index();
+        }
+        return;
+    }
+
+    // No usable file: keep the same layout in memory
+    if (history_mapped) {
+        // Switch from the mapping to a private copy
+        char* copy = malloc(history_size + len + 1 + 4096);
+        if (copy == NULL) {
+            free(line);
+            return;
+        }
+        memcpy(copy, history_data, history_size);
+        munmap(history_data, history_mapped);
+        history_data = copy;
+        history_mapped = 0;
+        history_cap = history_size + len + 1 + 4096;
+        if (history_fd >= 0) {
+            close(history_fd);
+            history_fd = -1;
+        }
+    }
+    if (history_size + len + 1 > history_cap) {
+        size_t cap = history_cap ? history_cap * 2 : 4096;
+        while (cap < history_size + len + 1) cap *= 2;
+        char* grown = realloc(history_data, cap);
+        if (grown == NULL) {
+            free(line);
+            return;
+        }
+        history_data = grown;
+        history_cap = cap;
+    }
+    memcpy(history_data + history_size, line, len + 1);
+    history_size += len + 1;
+    free(line);
+    index_new_entries();
+    if (search_indexed >= 0) {
+        sync_search_index();
     }
-    
-    history[index] = cmd_copy;
-    history_count++;
 }
 
 // Print all history commands with line numbers
 void print_history() {
-    for (int i = 0; i < history_count; i++) {
-        int index = (history_start + i) % HISTORY_SIZE;
-        printf("%d %s\n", i + 1, history[index]);
+    int count = history_count();
+    for (int i = 1; i <= count; i++) {
+        size_t len;
+        const char* entry = history_entry(i, &len);
+        printf("%d %.*s\n", i, (int)len, entry);
     }
 }
 
-// Get a specific history command by number
+// Get a specific history command by number. The returned string is
+// reused by the next call.
 char* get_history_command(int n) {
-    if (n < 1 || n > history_count) {
+    size_t len;
+    const char* entry = history_entry(n, &len);
+    if (entry == NULL) {
         return NULL;  // Invalid history number
     }
-    
-    int index = (history_start + n - 1) % HISTORY_SIZE;
-    return history[index];
+
+    if (len + 1 > entry_buf_cap) {
+        char* grown = realloc(entry_buf, len + 1);
+        if (grown == NULL) return NULL;
+        entry_buf = grown;
+        entry_buf_cap = len + 1;
+    }
+    memcpy(entry_buf, entry, len);
+    entry_buf[len] = '\0';
+    return entry_buf;
 }
 
 // Check if command is a history command (starts with !)
@@ -65,7 +377,7 @@ int is_history_command(const char* cmdline) {
     return (cmdline != NULL && cmdline[0] == '!');
 }
 
-// Expand history command (replace !n with actual command)
+// Expand history command (!!, !n, !prefix or !?substring?)
 char* expand_history_command(const char* cmdline) {
     if (cmdline == NULL || cmdline[0] != '!') {
         return NULL;
@@ -73,11 +385,12 @@ char* expand_history_command(const char* cmdline) {
     
     // Handle !! (previous command)
     if (cmdline[1] == '!' && cmdline[2] == '\0') {
-        if (history_count == 0) {
+        int count = history_count();
+        if (count == 0) {
             fprintf(stderr, "No previous command in history\n");
             return NULL;
         }
-        return get_history_command(history_count);
+        return get_history_command(count);
     }
     
     // Handle !n (specific command number)
@@ -99,7 +412,36 @@ char* expand_history_command(const char* cmdline) {
         return hist_cmd;
     }
     
+    // Handle !?substr? (most recent command containing substr)
+    if (cmdline[1] == '?') {
+        const char* pattern = &cmdline[2];
+        size_t len = strlen(pattern);
+        if (len > 0 && pattern[len - 1] == '?') {
+            len--;
+        }
+        if (len == 0) {
+            fprintf(stderr, "Invalid history syntax: %s\n", cmdline);
+            return NULL;
+        }
+        int n = history_find(pattern, len, 1, history_count() + 1);
+        if (n == 0) {
+            fprintf(stderr, "%s: event not found\n", cmdline);
+            return NULL;
+        }
+        return get_history_command(n);
+    }
+
+    // Handle !prefix (most recent command starting with prefix)
+    if (cmdline[1] != '\0' && cmdline[1] != ' ' && cmdline[1] != '\t') {
+        int n = history_find(&cmdline[1], strlen(&cmdline[1]), 0, history_count() + 1);
+        if (n == 0) {
+            fprintf(stderr, "%s: event not found\n", cmdline);
+            return NULL;
+        }
+        return get_history_command(n);
+    }
+
     fprintf(stderr, "Invalid history syntax: %s\n", cmdline);
-    fprintf(stderr, "Use !n for command number n, or !! for previous command\n");
+    fprintf(stderr, "Use !n, !!, !prefix or !?substring?\n");
     return NULL;
 }
@@ -0,0 +1,260 @@
+#include "shell.h"
+#include <stdint.h>
+
+// Search index over history entries, addressed by their position in the
+// history file. A depth-capped prefix trie answers `!prefix` and a
+// trigram table narrows `!?substr?` and `history -s` to the entries that
+// contain the rarest trigram of the pattern. Posting lists only ever get
+// appended to, so they stay sorted by entry.
+
+#define TRIE_DEPTH 12          // Longer prefixes are checked against the text
+#define TRIGRAM_INITIAL 4096   // Initial trigram table size (power of two)
+
+typedef struct {
+    uint32_t* ids;
+    uint32_t len;
+    uint32_t cap;
+} posting_t;
+
+typedef struct {
+    posting_t posts;           // Entries whose prefix ends at this node
+    uint32_t first_child;      // 0 = none (the root is never a child)
+    uint32_t next_sibling;
+    unsigned char ch;
+} trie_node_t;
+
+typedef struct {
+    uint32_t key;              // Trigram + 1, 0 = empty slot
+    posting_t posts;
+} trigram_slot_t;
+
+static trie_node_t* nodes = NULL;
+static uint32_t node_count = 0;
+static uint32_t node_cap = 0;
+
+static trigram_slot_t* trigrams = NULL;
+static uint32_t trigram_cap = 0;
+static uint32_t trigram_count = 0;
+
+// Append an entry to a posting list, once per entry
+static int posting_add(posting_t* p, uint32_t id) {
+    if (p->len > 0 && p->ids[p->len - 1] == id) {
+        return 0;
+    }
+    if (p->len == p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : 4;
+        uint32_t* grown = realloc(p->ids, cap * sizeof(uint32_t));
+        if (grown == NULL) {
+            perror("realloc failed");
+            return -1;
+        }
+        p->ids = grown;
+        p->cap = cap;
+    }
+    p->ids[p->len++] = id;
+    return 0;
+}
+
+// Number of posted entries below hi
+static uint32_t posting_below(const posting_t* p, uint32_t hi) {
+    uint32_t lo = 0, top = p->len;
+    while (lo < top) {
+        uint32_t mid = lo + (top - lo) / 2;
+        if (p->ids[mid] < hi) lo = mid + 1;
+        else top = mid;
+    }
+    return lo;
+}
+
+// Find or create the child of node for ch; returns 0 on failure
+static uint32_t trie_child(uint32_t node, unsigned char ch, int create) {
+    uint32_t child = nodes[node].first_child;
+    while (child != 0 && nodes[child].ch != ch) {
+        child = nodes[child].next_sibling;
+    }
+    if (child != 0 || !create) {
+        return child;
+    }
+
+    if (node_count == node_cap) {
+        uint32_t cap = node_cap * 2;
+        trie_node_t* grown = realloc(nodes, cap * sizeof(trie_node_t));
+        if (grown == NULL) {
+            perror("realloc failed");
+            return 0;
+        }
+        nodes = grown;
+        node_cap = cap;
+    }
+    child = node_count++;
+    memset(&nodes[child], 0, sizeof(trie_node_t));
+    nodes[child].ch = ch;
+    nodes[child].next_sibling = nodes[node].first_child;
+    nodes[node].first_child = child;
+    return child;
+}
+
+static uint32_t trigram_key(const char* s) {
+    return ((uint32_t)(unsigned char)s[0] << 16 |
+            (uint32_t)(unsigned char)s[1] << 8 |
+            (uint32_t)(unsigned char)s[2]) + 1;
+}
+
+static uint32_t trigram_slot(uint32_t key) {
+    uint32_t i = (key * 2654435761u) & (trigram_cap - 1);
+    while (trigrams[i].key != 0 && trigrams[i].key != key) {
+        i = (i + 1) & (trigram_cap - 1);
+    }
+    return i;
+}
+
+static int trigram_grow() {
+    uint32_t old_cap = trigram_cap;
+    trigram_slot_t* old = trigrams;
+
+    trigram_cap = old_cap ? old_cap * 2 : TRIGRAM_INITIAL;
+    trigrams = calloc(trigram_cap, sizeof(trigram_slot_t));
+    if (trigrams == NULL) {
+        perror("calloc failed");
+        trigrams = old;
+        trigram_cap = old_cap;
+        return -1;
+    }
+    for (uint32_t i = 0; i < old_cap; i++) {
+        if (old[i].key != 0) {
+            trigrams[trigram_slot(old[i].key)] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static posting_t* trigram_posts(const char* s, int create) {
+    if (trigram_cap == 0) {
+        if (!create || trigram_grow() < 0) return NULL;
+    }
+    uint32_t key = trigram_key(s);
+    uint32_t i = trigram_slot(key);
+    if (trigrams[i].key == 0) {
+        if (!create) return NULL;
+        if ((trigram_count + 1) * 10 > trigram_cap * 7) {
+            if (trigram_grow() < 0) return NULL;
+            i = trigram_slot(key);
+        }
+        trigrams[i].key = key;
+        trigram_count++;
+    }
+    return &trigrams[i].posts;
+}
+
+// Drop everything (entries were renumbered)
+void history_index_reset() {
+    for (uint32_t i = 0; i < node_count; i++) {
+        free(nodes[i].posts.ids);
+    }
+    free(nodes);
+    nodes = NULL;
+    node_count = node_cap = 0;
+
+    for (uint32_t i = 0; i < trigram_cap; i++) {
+        free(trigrams[i].posts.ids);
+    }
+    free(trigrams);
+    trigrams = NULL;
+    trigram_cap = trigram_count = 0;
+}
+
+// Index entry id; entries must be added in increasing order
+void history_index_add(size_t id, const char* text, size_t len) {
+    if (nodes == NULL) {
+        node_cap = 256;
+        nodes = calloc(node_cap, sizeof(trie_node_t));
+        if (nodes == NULL) {
+            perror("calloc failed");
+            node_cap = 0;
+            return;
+        }
+        node_count = 1; // Root
+    }
+
+    uint32_t node = 0;
+    size_t depth = len < TRIE_DEPTH ? len : TRIE_DEPTH;
+    for (size_t i = 0; i < depth; i++) {
+        node = trie_child(node, (unsigned char)text[i], 1);
+        if (node == 0 || posting_add(&nodes[node].posts, id) < 0) break;
+    }
+
+    for (size_t i = 0; i + 3 <= len; i++) {
+        posting_t* posts = trigram_posts(text + i, 1);
+        if (posts == NULL || posting_add(posts, id) < 0) break;
+    }
+}
+
+// Newest entry in [lo, hi) starting with prefix, or -1
+long history_index_find_prefix(const char* prefix, size_t len, size_t lo, size_t hi) {
+    if (nodes == NULL || len == 0) {
+        return -1;
+    }
+
+    uint32_t node = 0;
+    size_t depth = len < TRIE_DEPTH ? len : TRIE_DEPTH;
+    for (size_t i = 0; i < depth; i++) {
+        node = trie_child(node, (unsigned char)prefix[i], 0);
+        if (node == 0) return -1;
+    }
+
+    const posting_t* p = &nodes[node].posts;
+    for (uint32_t k = posting_below(p, hi); k > 0 && p->ids[k - 1] >= lo; k--) {
+        uint32_t id = p->ids[k - 1];
+        if (len <= TRIE_DEPTH) {
+            return id;
+        }
+        size_t entry_len;
+        const char* entry = history_raw_entry(id, &entry_len);
+        if (entry != NULL && entry_len >= len && memcmp(entry, prefix, len) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+// Newest entry in [lo, hi) containing pattern, or -1
+long history_index_find_substring(const char* pattern, size_t len, size_t lo, size_t hi) {
+    if (len == 0) {
+        return -1;
+    }
+
+    if (len < 3) {
+        // Too short for a trigram; such patterns rarely need a long scan
+        for (size_t id = hi; id > lo; id--) {
+            size_t entry_len;
+            const char* entry = history_raw_entry(id - 1, &entry_len);
+            if (entry != NULL && memmem(entry, entry_len, pattern, len) != NULL) {
+                return id - 1;
+            }
+        }
+        return -1;
+    }
+
+    // Candidates come from the pattern's least common trigram
+    const posting_t* best = NULL;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const posting_t* p = trigram_posts(pattern + i, 0);
+        if (p == NULL || p->len == 0) {
+            return -1; // Some trigram occurs nowhere
+        }
+        if (best == NULL || p->len < best->len) {
+            best = p;
+        }
+    }
+
+    for (uint32_t k = posting_below(best, hi); k > 0 && best->ids[k - 1] >= lo; k--) {
+        uint32_t id = best->ids[k - 1];
+        size_t entry_len;
+        const char* entry = history_raw_entry(id, &entry_len);
+        if (entry != NULL && memmem(entry, entry_len, pattern, len) != NULL) {
+            return id;
+        }
+    }
+    return -1;
+}
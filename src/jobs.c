@@ -1,101 +1,548 @@
 #include "shell.h"
+#include <termios.h>
 
-// Global job list
-static job_t jobs[MAX_JOBS];
+#define JOB_SLAB_SIZE 64          // Jobs allocated per slab
+#define JOB_MAP_INITIAL 64        // Initial pid map buckets (power of two)
+
+// Job table: jobs live in slabs that never move, unused entries sit on a
+// free list, and active jobs are linked in creation order for printing
+static job_t** slabs = NULL;
+static int slab_count = 0;
+static job_t* free_jobs = NULL;
+static job_t* first_job = NULL;
+static job_t* last_job = NULL;
+static int numbered_jobs = 0;
 static int next_job_id = 1;
 
-// Initialize job list
-void init_jobs() {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        jobs[i].pid = -1;
-        jobs[i].command = NULL;
-        jobs[i].status = JOB_DONE;
-        jobs[i].job_id = 0;
+// pid -> process map (chained through job_process_t.hash_next)
+static job_process_t** pid_map = NULL;
+static size_t pid_map_size = 0;
+static size_t mapped_pids = 0;
+
+// Bumped by the SIGCHLD handler; the reaper only runs when it changed
+static volatile sig_atomic_t child_events = 0;
+static sig_atomic_t seen_child_events = 0;
+
+// Job control state (only when the shell is interactive)
+static int shell_interactive = 0;
+static pid_t shell_pgid = 0;
+static struct termios shell_tmodes;
+
+// SIGCHLD handler: just record that something happened
+static void sigchld_handler(int sig) {
+    (void)sig;
+    child_events++;
+}
+
+static size_t pid_bucket(pid_t pid, size_t size) {
+    return ((size_t)pid * 2654435761u) & (size - 1);
+}
+
+// Double the pid map when it holds more processes than buckets
+static void grow_pid_map() {
+    size_t new_size = pid_map_size ? pid_map_size * 2 : JOB_MAP_INITIAL;
+    job_process_t** new_map = calloc(new_size, sizeof(job_process_t*));
+    if (new_map == NULL) {
+        return; // Keep using the smaller map; chains just get longer
+    }
+    for (size_t i = 0; i < pid_map_size; i++) {
+        job_process_t* proc = pid_map[i];
+        while (proc != NULL) {
+            job_process_t* next = proc->hash_next;
+            size_t b = pid_bucket(proc->pid, new_size);
+            proc->hash_next = new_map[b];
+            new_map[b] = proc;
+            proc = next;
+        }
+    }
+    free(pid_map);
+    pid_map = new_map;
+    pid_map_size = new_size;
+}
+
+// Find the process entry for a pid in O(1)
+static job_process_t* find_process(pid_t pid) {
+    if (pid_map == NULL) return NULL;
+    for (job_process_t* proc = pid_map[pid_bucket(pid, pid_map_size)]; proc != NULL;
+         proc = proc->hash_next) {
+        if (proc->pid == pid) return proc;
+    }
+    return NULL;
+}
+
+static void unmap_process(job_process_t* proc) {
+    job_process_t** link = &pid_map[pid_bucket(proc->pid, pid_map_size)];
+    while (*link != NULL && *link != proc) link = &(*link)->hash_next;
+    if (*link != NULL) {
+        *link = proc->hash_next;
+        mapped_pids--;
+    }
+}
+
+// Take a job from the free list, adding a slab if it is empty
+static job_t* alloc_job() {
+    if (free_jobs == NULL) {
+        job_t** grown = realloc(slabs, (slab_count + 1) * sizeof(job_t*));
+        if (grown == NULL) return NULL;
+        slabs = grown;
+
+        job_t* slab = calloc(JOB_SLAB_SIZE, sizeof(job_t));
+        if (slab == NULL) return NULL;
+        slabs[slab_count++] = slab;
+
+        for (int i = JOB_SLAB_SIZE - 1; i >= 0; i--) {
+            slab[i].next = free_jobs;
+            free_jobs = &slab[i];
+        }
+    }
+
+    job_t* job = free_jobs;
+    free_jobs = job->next;
+    memset(job, 0, sizeof(job_t));
+    return job;
+}
+
+// Initialize job list, job control and the SIGCHLD reaper. Job control
+// is only used by an interactive shell reading from a terminal.
+void init_jobs(int interactive) {
+    shell_interactive = interactive && isatty(STDIN_FILENO);
+    if (shell_interactive) {
+        // Wait until the shell is in the foreground
+        while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp())) {
+            kill(-shell_pgid, SIGTTIN);
+        }
+
+        // Job control signals go to the foreground job, not the shell
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+
+        // Put the shell in its own process group and take the terminal
+        shell_pgid = getpid();
+        if (getpgrp() != shell_pgid) {
+            setpgid(shell_pgid, shell_pgid);
+        }
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcgetattr(STDIN_FILENO, &shell_tmodes);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    if (pid_map == NULL) {
+        grow_pid_map();
     }
     next_job_id = 1;
 }
 
-// Add a new background job
-void add_job(pid_t pid, const char* command) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid == -1) {
-            jobs[i].pid = pid;
-            jobs[i].command = strdup(command);
-            jobs[i].status = JOB_RUNNING;
-            jobs[i].job_id = next_job_id++;
-            printf("[%d] %d\n", jobs[i].job_id, jobs[i].pid);
-            return;
+// Called in a forked child that goes on to run shell code: the child is
+// not interactive and the parent's jobs are not its children
+void enter_subshell() {
+    shell_interactive = 0;
+    first_job = NULL;
+    last_job = NULL;
+    numbered_jobs = 0;
+}
+
+// Whether commands get their own process groups and the terminal
+int job_control_enabled() {
+    return shell_interactive;
+}
+
+// Whether the shell is reading commands typed at a terminal (not a
+// script, -c or a subshell)
+int interactive_shell() {
+    return shell_interactive;
+}
+
+// Create a job for num_procs processes. Takes ownership of command (a
+// malloc'd string). The job has no number until it is put in the
+// background or stopped.
+job_t* create_job(char* command, int num_procs) {
+    job_t* job = alloc_job();
+    if (job == NULL) {
+        free(command);
+        return NULL;
+    }
+    job->procs = calloc(num_procs, sizeof(job_process_t));
+    if (job->procs == NULL) {
+        free(command);
+        job->next = free_jobs;
+        free_jobs = job;
+        return NULL;
+    }
+
+    job->command = command ? command : strdup("");
+    job->status = JOB_RUNNING;
+
+    job->prev = last_job;
+    job->next = NULL;
+    if (last_job) last_job->next = job; else first_job = job;
+    last_job = job;
+    return job;
+}
+
+// Record a started process of the job; the first one leads the group
+void job_add_process(job_t* job, pid_t pid) {
+    job_process_t* proc = &job->procs[job->num_procs++];
+    proc->pid = pid;
+    proc->state = JOB_RUNNING;
+    proc->job = job;
+    if (job->pgid == 0) {
+        job->pgid = pid;
+    }
+
+    if (mapped_pids + 1 > pid_map_size) {
+        grow_pid_map();
+    }
+    size_t b = pid_bucket(pid, pid_map_size);
+    proc->hash_next = pid_map[b];
+    pid_map[b] = proc;
+    mapped_pids++;
+}
+
+// Record a pipeline stage that could not be started as a process that
+// already exited with status, so the job's status stays pipefail-correct
+void job_add_failed(job_t* job, int status) {
+    job_process_t* proc = &job->procs[job->num_procs++];
+    memset(proc, 0, sizeof(job_process_t));
+    proc->state = JOB_DONE;
+    proc->status = W_EXITCODE(status, 0);
+    proc->job = job;
+}
+
+// Give the job a number for %n references
+static void number_job(job_t* job) {
+    if (job->job_id != 0) return;
+
+    // Numbering starts over once every earlier job has finished
+    if (numbered_jobs == 0) {
+        next_job_id = 1;
+    }
+    job->job_id = next_job_id++;
+    numbered_jobs++;
+}
+
+// Run a started job in the background, announcing it at the prompt
+void background_job(job_t* job) {
+    number_job(job);
+    pid_t last = 0;
+    for (int i = job->num_procs - 1; i >= 0 && last == 0; i--) {
+        last = job->procs[i].pid;  // 0 for a stage that could not start
+    }
+    set_last_background(last);
+    if (shell_interactive) {
+        printf("[%d] %d\n", job->job_id, last);
+    }
+}
+
+// Remove a job from the table
+void remove_job(job_t* job) {
+    if (job == NULL) return;
+
+    for (int i = 0; i < job->num_procs; i++) {
+        unmap_process(&job->procs[i]);
+    }
+
+    if (job->prev) job->prev->next = job->next; else first_job = job->next;
+    if (job->next) job->next->prev = job->prev; else last_job = job->prev;
+    if (job->job_id != 0) numbered_jobs--;
+
+    free(job->command);
+    free(job->procs);
+    job->command = NULL;
+    job->procs = NULL;
+    job->status = JOB_DONE;
+    job->next = free_jobs;
+    free_jobs = job;
+}
+
+// Record a wait status for one of a job's processes and recompute the
+// job's state. Returns 1 if this changed the job to done or stopped.
+static int record_status(job_process_t* proc, int status) {
+    job_t* job = proc->job;
+
+    if (WIFSTOPPED(status)) {
+        proc->state = JOB_STOPPED;
+    } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        proc->state = JOB_DONE;
+        proc->status = status;
+    } else if (WIFCONTINUED(status)) {
+        proc->state = JOB_RUNNING;
+    }
+
+    int running = 0, stopped = 0;
+    for (int i = 0; i < job->num_procs; i++) {
+        if (job->procs[i].state == JOB_RUNNING) running++;
+        else if (job->procs[i].state == JOB_STOPPED) stopped++;
+    }
+
+    job_status_t old = job->status;
+    job->status = running ? JOB_RUNNING : stopped ? JOB_STOPPED : JOB_DONE;
+    return job->status != old && job->status != JOB_RUNNING;
+}
+
+// Shell exit code for a wait status
+static int exit_code(int status) {
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+// Exit code of a finished job: the rightmost failing process (pipefail)
+static int job_exit_status(job_t* job) {
+    int result = 0;
+    for (int i = 0; i < job->num_procs; i++) {
+        if (job->procs[i].state == JOB_DONE && exit_code(job->procs[i].status) != 0) {
+            result = exit_code(job->procs[i].status);
         }
     }
-    fprintf(stderr, "Error: too many background jobs\n");
+    return result;
 }
 
-// Remove a completed job
-void remove_job(pid_t pid) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid == pid) {
-            free(jobs[i].command);
-            jobs[i].pid = -1;
-            jobs[i].command = NULL;
-            jobs[i].status = JOB_DONE;
-            jobs[i].job_id = 0;
-            return;
+// Announce a job that stopped or finished in the background; a finished
+// job is removed
+static void report_job(job_t* job) {
+    if (job->status == JOB_STOPPED) {
+        number_job(job);
+        printf("[%d] Stopped %s\n", job->job_id, job->command);
+    } else {
+        if (shell_interactive) {
+            // Like other shells, describe how the last process ended
+            int last = job->procs[job->num_procs - 1].status;
+            if (WIFSIGNALED(last)) {
+                printf("[%d] %s %s\n", job->job_id, strsignal(WTERMSIG(last)), job->command);
+            } else if (WEXITSTATUS(last) != 0) {
+                printf("[%d] Exit %d %s\n", job->job_id, WEXITSTATUS(last), job->command);
+            } else {
+                printf("[%d] Done   %s\n", job->job_id, job->command);
+            }
         }
+        remove_job(job);
     }
 }
 
-// Update job status and remove completed jobs
+// Collect status changes reported since the last call. Cost depends only
+// on how many children changed state, not on how many jobs exist: when no
+// SIGCHLD arrived this returns immediately.
 void update_jobs() {
+    if (child_events == seen_child_events) {
+        return;
+    }
+    seen_child_events = child_events;
+
     int status;
     pid_t pid;
-    
-    // Check all jobs
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid != -1) {
-            pid = waitpid(jobs[i].pid, &status, WNOHANG | WUNTRACED);
-            
-            if (pid > 0) {
-                if (WIFEXITED(status)) {
-                    printf("[%d] Done    %s\n", jobs[i].job_id, jobs[i].command);
-                    remove_job(jobs[i].pid);
-                } else if (WIFSIGNALED(status)) {
-                    printf("[%d] Killed  %s\n", jobs[i].job_id, jobs[i].command);
-                    remove_job(jobs[i].pid);
-                } else if (WIFSTOPPED(status)) {
-                    jobs[i].status = JOB_STOPPED;
-                    printf("[%d] Stopped %s\n", jobs[i].job_id, jobs[i].command);
-                }
+    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
+        job_process_t* proc = find_process(pid);
+        if (proc == NULL) {
+            continue; // Not a tracked process (e.g. a disowned job)
+        }
+        if (record_status(proc, status)) {
+            report_job(proc->job);
+        }
+    }
+}
+
+// Wait until one of the given jobs (each started with no job number)
+// finishes, and remove it. Other children that change state meanwhile
+// are handled as update_jobs() would. Returns the index of the finished
+// job with its exit code in *status, or -1 if there is nothing to wait
+// for.
+int wait_for_any_job(job_t** jobs, int count, int* status) {
+    while (1) {
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        job_process_t* proc = find_process(pid);
+        if (proc == NULL || !record_status(proc, wstatus)) {
+            continue;
+        }
+
+        job_t* job = proc->job;
+        for (int i = 0; i < count; i++) {
+            if (jobs[i] == job && job->status == JOB_DONE) {
+                *status = job_exit_status(job);
+                remove_job(job);
+                return i;
+            }
+        }
+        report_job(job);
+    }
+}
+
+// Wait until a job finishes or stops. In the foreground the job gets the
+// terminal while it runs. A finished job is removed and its exit code
+// returned; a stopped job stays in the table.
+static int wait_job(job_t* job, int foreground) {
+    if (job == NULL) return -1;
+
+    if (foreground) {
+        give_terminal_to(job->pgid);
+    }
+
+    while (job->status == JOB_RUNNING) {
+        // Wait on the first process that is still running
+        job_process_t* proc = NULL;
+        for (int i = 0; i < job->num_procs && proc == NULL; i++) {
+            if (job->procs[i].state == JOB_RUNNING) {
+                proc = &job->procs[i];
             }
         }
+        if (proc == NULL) break;
+
+        int status;
+        if (waitpid(proc->pid, &status, WUNTRACED) < 0) {
+            if (errno == EINTR) continue;
+            status = 0; // Already gone: count it as finished
+        }
+        record_status(proc, status);
+    }
+
+    if (foreground) {
+        if (job->status == JOB_STOPPED && shell_interactive) {
+            tcgetattr(STDIN_FILENO, &job->tmodes);
+            job->has_tmodes = 1;
+        }
+        reclaim_terminal();
+    }
+
+    if (job->status == JOB_STOPPED) {
+        number_job(job);
+        printf("\n[%d] Stopped %s\n", job->job_id, job->command);
+        return 128 + SIGTSTP;
+    }
+
+    int result = job_exit_status(job);
+    remove_job(job);
+    return result;
+}
+
+// Wait for a job in the foreground
+int wait_for_job(job_t* job) {
+    return wait_job(job, 1);
+}
+
+// Wait for a background job without giving it the terminal (wait builtin)
+int wait_for_background_job(job_t* job) {
+    return wait_job(job, 0);
+}
+
+// Get the oldest job that has a number, or NULL (for waiting on all jobs)
+job_t* first_background_job() {
+    for (job_t* job = first_job; job != NULL; job = job->next) {
+        if (job->job_id != 0 && job->status == JOB_RUNNING) return job;
+    }
+    return NULL;
+}
+
+// Resume a stopped or background job, in the foreground or background
+int continue_job(job_t* job, int foreground) {
+    for (int i = 0; i < job->num_procs; i++) {
+        if (job->procs[i].state == JOB_STOPPED) {
+            job->procs[i].state = JOB_RUNNING;
+        }
     }
+    job->status = JOB_RUNNING;
+
+    if (foreground) {
+        printf("%s\n", job->command);
+        if (job->has_tmodes && shell_interactive) {
+            tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+        }
+        give_terminal_to(job->pgid);
+    } else {
+        printf("[%d] %s &\n", job->job_id, job->command);
+    }
+
+    if (kill(-job->pgid, SIGCONT) < 0 && kill(job->pgid, SIGCONT) < 0) {
+        perror("kill (SIGCONT)");
+    }
+
+    return foreground ? wait_for_job(job) : 0;
+}
+
+// Find a job from a job spec: %n, %% or %+ (current), %- (previous),
+// %prefix (command starts with prefix), or NULL/empty for the current job
+job_t* find_job(const char* spec) {
+    job_t* current = NULL;
+    job_t* previous = NULL;
+    for (job_t* job = first_job; job != NULL; job = job->next) {
+        if (job->job_id != 0) {
+            previous = current;
+            current = job;
+        }
+    }
+
+    if (spec == NULL || spec[0] == '\0' || strcmp(spec, "%%") == 0 ||
+        strcmp(spec, "%+") == 0 || strcmp(spec, "%") == 0) {
+        return current;
+    }
+    if (strcmp(spec, "%-") == 0) {
+        return previous;
+    }
+
+    const char* p = spec[0] == '%' ? spec + 1 : spec;
+    if (*p >= '0' && *p <= '9') {
+        int id = atoi(p);
+        for (job_t* job = first_job; job != NULL; job = job->next) {
+            if (job->job_id == id) return job;
+        }
+        return NULL;
+    }
+
+    size_t len = strlen(p);
+    job_t* match = NULL;
+    for (job_t* job = first_job; job != NULL; job = job->next) {
+        if (job->job_id != 0 && strncmp(job->command, p, len) == 0) {
+            match = job;
+        }
+    }
+    return match;
+}
+
+// Find the job a process belongs to
+job_t* find_job_by_pid(pid_t pid) {
+    job_process_t* proc = find_process(pid);
+    return proc ? proc->job : NULL;
 }
 
 // Print all active jobs
 void print_jobs() {
     int found = 0;
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].pid != -1) {
-            const char* status_str = "Running";
-            if (jobs[i].status == JOB_STOPPED) {
-                status_str = "Stopped";
-            }
-            printf("[%d] %s %s\n", jobs[i].job_id, status_str, jobs[i].command);
-            found = 1;
+    for (job_t* job = first_job; job != NULL; job = job->next) {
+        if (job->job_id == 0) continue; // Foreground job
+        const char* status_str = "Running";
+        if (job->status == JOB_STOPPED) {
+            status_str = "Stopped";
         }
+        printf("[%d] %s %s\n", job->job_id, status_str, job->command);
+        found = 1;
     }
     if (!found) {
         printf("No background jobs\n");
     }
 }
 
-// Clean up zombie processes
-void cleanup_zombies() {
-    int status;
-    pid_t pid;
-    
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        // Found a completed child process
-        remove_job(pid);
+// Hand the terminal to a foreground process group
+void give_terminal_to(pid_t pgid) {
+    if (shell_interactive && pgid > 0) {
+        tcsetpgrp(STDIN_FILENO, pgid);
+    }
+}
+
+// Take the terminal back after a foreground process group finishes
+void reclaim_terminal() {
+    if (shell_interactive) {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
     }
 }
 
@@ -104,43 +551,5 @@ int execute_background(command_t* cmd) {
     if (cmd == NULL || cmd->args[0] == NULL) {
         return -1;
     }
-
-    // Build command string for job tracking
-    char cmd_str[MAX_LEN] = "";
-    for (int i = 0; cmd->args[i] != NULL; i++) {
-        if (i > 0) strcat(cmd_str, " ");
-        strcat(cmd_str, cmd->args[i]);
-    }
-
-    pid_t pid = fork();
-    
-    if (pid == 0) {
-        // Child process - set up redirection if needed
-        if (cmd->input_file != NULL) {
-            int input_fd = open(cmd->input_file, O_RDONLY);
-            if (input_fd >= 0) {
-                dup2(input_fd, STDIN_FILENO);
-                close(input_fd);
-            }
-        }
-        if (cmd->output_file != NULL) {
-            int output_fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (output_fd >= 0) {
-                dup2(output_fd, STDOUT_FILENO);
-                close(output_fd);
-            }
-        }
-        
-        // Execute the command
-        execvp(cmd->args[0], cmd->args);
-        perror("execvp");
-        exit(1);
-    } else if (pid > 0) {
-        // Parent process - add to job list
-        add_job(pid, cmd_str);
-        return 0;
-    } else {
-        perror("fork");
-        return -1;
-    }
+    return execute_piped_commands(cmd, 1);
 }
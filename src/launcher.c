@@ -0,0 +1,189 @@
+#include "shell.h"
+#include <spawn.h>
+
+extern char** environ;
+
+// Signals the shell may ignore or catch; children always get the defaults
+static const int reset_signals[] = {
+    SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD, SIGPIPE, 0
+};
+
+// Build the environment for a command with NAME=value prefixes: the
+// shell's environment minus overridden names, plus the assignments.
+// Returns a malloc'd array (the strings are not copied).
+static char** command_environment(char** assigns) {
+    int count = 0, extra = 0;
+    while (environ[count] != NULL) count++;
+    while (assigns[extra] != NULL) extra++;
+
+    char** envp = malloc((count + extra + 1) * sizeof(char*));
+    if (envp == NULL) {
+        return NULL;
+    }
+
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        const char* equal_sign = strchr(environ[i], '=');
+        size_t name_len = equal_sign ? (size_t)(equal_sign - environ[i]) : strlen(environ[i]);
+        int overridden = 0;
+        for (int j = 0; j < extra && !overridden; j++) {
+            overridden = strncmp(assigns[j], environ[i], name_len) == 0 &&
+                         assigns[j][name_len] == '=';
+        }
+        if (!overridden) {
+            envp[n++] = environ[i];
+        }
+    }
+    for (int j = 0; j < extra; j++) {
+        envp[n++] = assigns[j];
+    }
+    envp[n] = NULL;
+    return envp;
+}
+
+// Run a file the kernel would not execute (no #! line) as a /bin/sh
+// script, the way execvp() does. Returns posix_spawn's error code.
+static int spawn_script(pid_t* pid, const char* path, const posix_spawn_file_actions_t* actions,
+                        const posix_spawnattr_t* attr, char** args, char** envp) {
+    int argc = 0;
+    while (args[argc] != NULL) argc++;
+
+    char** sh_args = malloc((argc + 2) * sizeof(char*));
+    if (sh_args == NULL) {
+        return ENOMEM;
+    }
+    sh_args[0] = "/bin/sh";
+    sh_args[1] = (char*)path;
+    for (int i = 1; i <= argc; i++) {
+        sh_args[i + 1] = args[i];
+    }
+    int err = posix_spawn(pid, "/bin/sh", actions, attr, sh_args, envp);
+    free(sh_args);
+    return err;
+}
+
+// Launch an external command without copying the shell's address space.
+// posix_spawn in glibc uses clone(CLONE_VM|CLONE_VFORK), so the cost does
+// not grow with the shell's heap the way fork() does. Pipe ends and the
+// command's redirections are applied in the child through spawn file
+// actions, so the shell's own descriptors are never touched:
+//   in_fd/out_fd  - descriptors to install as stdin/stdout (-1 to inherit)
+//   pgid          - process group to join (0 = new group led by the child,
+//                   -1 = stay in the shell's group)
+// Returns the child's pid, LAUNCH_REDIRECT_FAILED if a redirection could
+// not be opened, or -1 if the command could not be started, with errno
+// set to ENOENT if it was not found.
+pid_t launch_command(command_t* cmd, int in_fd, int out_fd, pid_t pgid) {
+    if (cmd == NULL || cmd->args[0] == NULL) {
+        return -1;
+    }
+
+    // Keep the shell's buffered output ahead of the child's
+    fflush(stdout);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    // Pipe ends come first so explicit redirections override them
+    if (in_fd >= 0 && in_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    if (out_fd >= 0 && out_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+    for (redir_t* r = cmd->redirs; r != NULL; r = r->next) {
+        if (redirection_flags(r->type) >= 0) {
+            posix_spawn_file_actions_addopen(&actions, r->fd, r->target,
+                                             redirection_flags(r->type), 0644);
+        } else if (r->source_fd < 0) {
+            posix_spawn_file_actions_addclose(&actions, r->fd);
+        } else if (r->source_fd != r->fd) {
+            posix_spawn_file_actions_adddup2(&actions, r->source_fd, r->fd);
+        }
+    }
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    sigset_t sigdefault, sigmask;
+    sigemptyset(&sigdefault);
+    for (int i = 0; reset_signals[i] != 0; i++) {
+        sigaddset(&sigdefault, reset_signals[i]);
+    }
+    sigemptyset(&sigmask);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+
+    if (pgid >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, pgid);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    // NAME=value words before the command override the environment
+    char** envp = environ;
+    if (cmd->assigns != NULL) {
+        envp = command_environment(cmd->assigns);
+        if (envp == NULL) {
+            envp = environ;
+        }
+    }
+
+    // Resolve through the command hash instead of letting execvp walk PATH
+    pid_t pid;
+    int err;
+    const char* path = hash_lookup_command(cmd->args[0]);
+    if (path == NULL) {
+        err = ENOENT;
+    } else {
+        err = posix_spawn(&pid, path, &actions, &attr, cmd->args, envp);
+        if (err == ENOENT && path != cmd->args[0]) {
+            // The remembered binary is gone: forget it and search again
+            hash_forget_command(cmd->args[0]);
+            path = hash_lookup_command(cmd->args[0]);
+            err = path ? posix_spawn(&pid, path, &actions, &attr, cmd->args, envp)
+                       : ENOENT;
+        }
+        if (err == ENOEXEC) {
+            err = spawn_script(&pid, path, &actions, &attr, cmd->args, envp);
+        }
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (envp != environ) {
+        free(envp);
+    }
+
+    if (path == NULL) {
+        fprintf(stderr, "%s: command not found\n", cmd->args[0]);
+        errno = ENOENT;
+        return -1;
+    }
+    if (err != 0) {
+        if (report_redirection_error(cmd->redirs)) {
+            return LAUNCH_REDIRECT_FAILED;
+        }
+        fprintf(stderr, "%s: %s\n", cmd->args[0], strerror(err));
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Wait for a child and convert its wait status to a shell exit code
+int wait_for_process(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 0;
+}
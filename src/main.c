@@ -1,21 +1,49 @@
 #include "shell.h"
 
-int main() {
+// Print command line usage
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-c command | script-file]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
     char* cmdline;
-    pipeline_t pipeline;
+    int status = 0;
 
-    // Initialize Readline if available
-    initialize_readline();
-    
-    // Initialize job control
-    init_jobs();
+    // Initialize job control (only a shell without -c or a script is
+    // interactive)
+    init_jobs(argc == 1);
     
     // NEW: Initialize variables
     init_variables();
 
+    // Non-interactive modes skip readline, history and completion setup
+    if (argc > 1) {
+        if (strcmp(argv[1], "-c") == 0) {
+            if (argc < 3) {
+                usage(argv[0]);
+                return 2;
+            }
+            return run_command_string(argv[2]);
+        }
+        if (argv[1][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        }
+        // Arguments after the script name are its $1..$N
+        positional_t none;
+        set_positional(argv + 2, argc - 2, &none);
+        return run_script_file(argv[1]);
+    }
+    if (!isatty(STDIN_FILENO)) {
+        return run_script_fd(STDIN_FILENO);
+    }
+
+    // Open the persistent history and initialize Readline if available
+    init_history();
+    initialize_readline();
+
     while (1) {
-        // Clean up zombie processes before prompt
-        cleanup_zombies();
+        // Report jobs that finished or stopped since the last prompt
         update_jobs();
 
         // Use readline if available, otherwise fallback
@@ -25,59 +53,10 @@ int main() {
             break; // EOF (Ctrl+D)
         }
 
-        // Handle history expansion before adding to our internal history
-        if (is_history_command(cmdline)) {
-            char* expanded_cmd = expand_history_command(cmdline);
-            if (expanded_cmd != NULL) {
-                free(cmdline);
-                cmdline = malloc(strlen(expanded_cmd) + 1);
-                strcpy(cmdline, expanded_cmd);
-                printf("%s\n", cmdline);  // Show the expanded command
-            } else {
-                free(cmdline);
-                continue;  // Skip to next iteration if history expansion failed
-            }
-        }
-        
-        // NEW: Handle variable assignments FIRST
-        if (handle_variable_assignment(cmdline)) {
-            // Variable was assigned, don't execute as command
-            free(cmdline);
-            continue;
-        }
-        
-        // Handle control structures (if-then-else)
-        if (is_if_then_else_command(cmdline)) {
-            if_block_t if_block;
-            if (parse_if_then_else(cmdline, &if_block) == 0) {
-                execute_if_block(&if_block);
-                free_if_block(&if_block);
-            } else {
-                fprintf(stderr, "Error: failed to parse if-then-else command\n");
-            }
-            free(cmdline);
-            continue;
-        }
-        
-        // Add non-empty commands to our internal history (after expansion)
-        if (cmdline[0] != '\0' && cmdline[0] != '\n') {
-            add_to_history(cmdline);
-        }
-
-        // Parse for redirection, pipes, and command chaining
-        if (parse_redirection_pipes(cmdline, &pipeline) > 0) {
-            // Execute the parsed command(s)
-            execute_pipeline(&pipeline);
-            
-            // Free allocated memory
-            free_pipeline(&pipeline);
-        } else {
-            fprintf(stderr, "Error: failed to parse command\n");
-        }
-        
+        status = process_command_line(cmdline, 1);
         free(cmdline);
     }
 
     printf("\nShell exited.\n");
-    return 0;
+    return status;
 }
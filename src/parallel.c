@@ -0,0 +1,288 @@
+#include "shell.h"
+
+// parallel [-j N] command [arg...] [::: item...]
+//
+// Runs the command once per item, with at most N tasks at a time: a new
+// task starts as soon as any running one exits. In the command words {}
+// stands for the item; without {} the item is added as the last
+// argument. Items come after ::: or, without it, are the lines of stdin.
+// Each task is a job in the job table (without a job number), so the
+// shell's usual reaping and process lookup apply to it.
+//
+// The exit codes of the tasks are left in $PARALLEL_STATUS, in item
+// order. The status of parallel is the number of failed tasks (at most
+// 101, as with GNU parallel), or 130 if it was interrupted.
+
+#define PARALLEL_MAX_FAILED 101
+
+// Read all of stdin and split it into lines (in place). Returns the
+// number of lines; *buffer and *lines are malloc'd.
+static int read_lines(char** buffer, char*** lines) {
+    size_t cap = 4096, len = 0;
+    char* data = malloc(cap);
+    *buffer = NULL;
+    *lines = NULL;
+    if (data == NULL) {
+        perror("parallel");
+        return -1;
+    }
+
+    while (1) {
+        if (len + 1 >= cap) {
+            char* grown = realloc(data, cap * 2);
+            if (grown == NULL) {
+                perror("parallel");
+                free(data);
+                return -1;
+            }
+            data = grown;
+            cap *= 2;
+        }
+        ssize_t n = read(STDIN_FILENO, data + len, cap - len - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("parallel: stdin");
+            free(data);
+            return -1;
+        }
+        if (n == 0) break;
+        len += n;
+    }
+    data[len] = '\0';
+
+    int count = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '\n') count++;
+    }
+    if (len > 0 && data[len - 1] != '\n') count++;
+
+    char** result = malloc((count + 1) * sizeof(char*));
+    if (result == NULL) {
+        perror("parallel");
+        free(data);
+        return -1;
+    }
+    char* line = data;
+    for (int i = 0; i < count; i++) {
+        char* nl = strchr(line, '\n');
+        if (nl != NULL) *nl = '\0';
+        result[i] = line;
+        line = nl ? nl + 1 : line + strlen(line);
+    }
+    result[count] = NULL;
+
+    *buffer = data;
+    *lines = result;
+    return count;
+}
+
+// Build the arguments of one task: the template with {} replaced by the
+// item, or the item appended when no word contains {}
+static char** task_args(char** words, int num_words, const char* item, arena_t* arena) {
+    char** args = arena_alloc(arena, (num_words + 2) * sizeof(char*));
+    if (args == NULL) {
+        return NULL;
+    }
+
+    int replaced = 0, argc = 0;
+    size_t item_len = strlen(item);
+    for (int i = 0; i < num_words; i++) {
+        const char* word = words[i];
+        const char* marker = strstr(word, "{}");
+        if (marker == NULL) {
+            args[argc++] = (char*)word;
+            continue;
+        }
+
+        strbuf_t arg;
+        strbuf_init(&arg, arena, strlen(word) + item_len);
+        while (marker != NULL) {
+            strbuf_append(&arg, word, marker - word);
+            strbuf_append(&arg, item, item_len);
+            word = marker + 2;
+            marker = strstr(word, "{}");
+        }
+        strbuf_append(&arg, word, strlen(word));
+        if (arg.data == NULL) {
+            return NULL;
+        }
+        args[argc++] = arg.data;
+        replaced = 1;
+    }
+    if (!replaced) {
+        args[argc++] = (char*)item;
+    }
+    args[argc] = NULL;
+    return args;
+}
+
+// Start the task for item as a job of its own. Returns the job, or NULL
+// if it could not be started (already reported).
+static job_t* start_task(char** words, int num_words, const char* item, arena_t* arena) {
+    command_t cmd = {0};
+    cmd.args = task_args(words, num_words, item, arena);
+    if (cmd.args == NULL) {
+        perror("parallel");
+        return NULL;
+    }
+    while (cmd.args[cmd.argc] != NULL) cmd.argc++;
+
+    job_t* job = create_job(command_to_string(&cmd, 1), 1);
+    if (job == NULL) {
+        fprintf(stderr, "parallel: cannot track job\n");
+        return NULL;
+    }
+
+    // Tasks stay in the shell's process group, so Ctrl-C reaches them
+    pid_t pid = start_process(&cmd, -1, -1, -1, -1);
+    if (pid < 0) {
+        remove_job(job);
+        return NULL;
+    }
+    job_add_process(job, pid);
+    return job;
+}
+
+// Parse -j N / -jN. Returns the index of the first command word, or -1
+// after reporting a usage error.
+static int parse_options(char** arglist, int* jobs) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    *jobs = cpus > 0 ? (int)cpus : 1;
+
+    int i = 1;
+    for (; arglist[i] != NULL && arglist[i][0] == '-'; i++) {
+        if (strcmp(arglist[i], "--") == 0) {
+            i++;
+            break;
+        }
+        if (strncmp(arglist[i], "-j", 2) != 0) {
+            fprintf(stderr, "parallel: %s: invalid option\n", arglist[i]);
+            return -1;
+        }
+        const char* value = arglist[i][2] != '\0' ? arglist[i] + 2 : arglist[++i];
+        char* end;
+        long n = value ? strtol(value, &end, 10) : 0;
+        if (value == NULL || *end != '\0' || n < 1 || n > 65536) {
+            fprintf(stderr, "parallel: -j needs a positive number of tasks\n");
+            return -1;
+        }
+        *jobs = (int)n;
+    }
+    if (arglist[i] == NULL || strcmp(arglist[i], ":::") == 0) {
+        fprintf(stderr, "usage: parallel [-j N] command [arg...] [::: item...]\n");
+        return -1;
+    }
+    return i;
+}
+
+// Record the tasks' exit codes in $PARALLEL_STATUS
+static void save_statuses(const int* codes, int count, arena_t* arena) {
+    strbuf_t list;
+    strbuf_init(&list, arena, count * 4 + 1);
+    for (int i = 0; i < count; i++) {
+        char digits[16];
+        int n = snprintf(digits, sizeof(digits), i > 0 ? " %d" : "%d", codes[i]);
+        strbuf_append(&list, digits, n);
+    }
+    if (list.data != NULL) {
+        set_variable("PARALLEL_STATUS", list.data);
+    }
+}
+
+int builtin_parallel(char** arglist) {
+    int max_jobs;
+    int first = parse_options(arglist, &max_jobs);
+    if (first < 0) {
+        return 2;
+    }
+
+    // Template words up to :::, items after it (or from stdin)
+    int num_words = 0;
+    while (arglist[first + num_words] != NULL && strcmp(arglist[first + num_words], ":::") != 0) {
+        num_words++;
+    }
+    char** words = arglist + first;
+    char** items;
+    char* buffer = NULL;
+    char** lines = NULL;
+    int count;
+    if (words[num_words] != NULL) {
+        items = words + num_words + 1;
+        for (count = 0; items[count] != NULL; count++);
+    } else {
+        count = read_lines(&buffer, &lines);
+        if (count < 0) {
+            return 1;
+        }
+        items = lines;
+    }
+
+    if (max_jobs > count) {
+        max_jobs = count > 0 ? count : 1;
+    }
+    job_t** running = calloc(max_jobs, sizeof(job_t*));
+    int* task_of = calloc(max_jobs, sizeof(int));
+    int* codes = calloc(count + 1, sizeof(int));
+    arena_t arena = {0};
+    if (running == NULL || task_of == NULL || codes == NULL) {
+        perror("parallel");
+        free(running);
+        free(task_of);
+        free(codes);
+        free(buffer);
+        free(lines);
+        return 1;
+    }
+
+    // Keep max_jobs tasks running; refill a slot as soon as its task exits
+    int next = 0, active = 0, interrupted = 0;
+    fflush(stdout);
+    while (1) {
+        while (!interrupted && next < count && active < max_jobs) {
+            int slot = 0;
+            while (running[slot] != NULL) slot++;
+            running[slot] = start_task(words, num_words, items[next], &arena);
+            arena_reset(&arena);  // The started task has its own copy of the arguments
+            if (running[slot] == NULL) {
+                codes[next++] = 127;
+                continue;
+            }
+            task_of[slot] = next++;
+            active++;
+        }
+        if (active == 0) {
+            break;
+        }
+
+        int status;
+        int slot = wait_for_any_job(running, max_jobs, &status);
+        if (slot < 0) {
+            break;
+        }
+        codes[task_of[slot]] = status;
+        running[slot] = NULL;
+        active--;
+        if (status == 128 + SIGINT) {
+            interrupted = 1;  // Ctrl-C: let the running tasks finish, start no more
+        }
+    }
+
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (i >= next) codes[i] = 128 + SIGINT;  // Never started
+        if (codes[i] != 0) failed++;
+    }
+    save_statuses(codes, count, &arena);
+
+    arena_release(&arena);
+    free(running);
+    free(task_of);
+    free(codes);
+    free(buffer);
+    free(lines);
+
+    if (interrupted) {
+        return 128 + SIGINT;
+    }
+    return failed < PARALLEL_MAX_FAILED ? failed : PARALLEL_MAX_FAILED;
+}
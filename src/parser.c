@@ -1,217 +1,1482 @@
 #include "shell.h"
 
-// Helper function to check if a character is a quote
-int is_quote(char c) {
-    return c == '\'' || c == '"';
+// Tokenizer and recursive-descent parser. An input is parsed once into a
+// syntax tree whose nodes and words all live in the tree's arena, so the
+// whole parse is released by a single arena reset. Words keep their
+// quotes and $ references; expansion happens when a node runs.
+//
+// Grammar:
+//   list      := { and_or ( ';' | '&' | newline ) }
+//   and_or    := pipeline { ( '&&' | '||' ) newline* pipeline }
+//   pipeline  := command { '|' newline* command }
+//   command   := if_clause | while_clause | for_clause | group
+//              | '((' expression '))' | '[[' cond ']]' | function | simple
+//   function  := NAME '(' ')' newline* compound-command
+//   cond      := cond_and { '||' cond_and }
+//   cond_and  := cond_not { '&&' cond_not }
+//   cond_not  := '!' cond_not | '(' cond ')' | unary-op WORD
+//              | WORD [ binary-op WORD ]
+//   simple    := { WORD | redirect }+
+//   redirect  := [n] ( '<' | '>' | '>>' | '<>' | '>&' | '<&' | '>|' | '<<' | '<<-'
+//                | '<<<' ) WORD | ( '&>' | '&>>' ) WORD
+//   if_clause := 'if' list 'then' list { 'elif' list 'then' list }
+//                [ 'else' list ] 'fi'
+//   while_clause := ( 'while' | 'until' ) list do_group
+//   for_clause := 'for' NAME [ 'in' { WORD } ] ( ';' | newline ) do_group
+//              | 'for' '((' expr ';' expr ';' expr '))' [ ';' ] do_group
+//   do_group  := 'do' list 'done'
+//   group     := '{' list '}'
+//
+// A compound command may be followed by redirections too. Here-document
+// bodies are read at the newline that ends the line of their << operator.
+//
+// Arithmetic expressions are parsed here too (by arith.c), so a loop
+// condition is never looked at as text again while the loop runs.
+
+typedef enum {
+    TOK_WORD,
+    TOK_NEWLINE,
+    TOK_SEMI,
+    TOK_AMP,
+    TOK_PIPE,
+    TOK_AND_IF,             // &&
+    TOK_OR_IF,              // ||
+    TOK_LESS,               // < (without a descriptor number)
+    TOK_GREAT,              // > (without a descriptor number)
+    TOK_REDIR,              // Any other redirection operator
+    TOK_LPAREN,
+    TOK_RPAREN,
+    TOK_ARITH,              // (( ... )), with the inside in word
+    TOK_EOF
+} token_type_t;
+
+// A here-document whose body has not been read yet
+typedef struct pending_heredoc {
+    redir_t* redir;         // Gets the body as its target
+    char* delimiter;        // Delimiter word with quotes removed
+    int strip_tabs;         // <<- removes leading tabs from body lines
+    struct pending_heredoc* next;
+} pending_heredoc_t;
+
+typedef struct {
+    const char* pos;        // Next unread character
+    arena_t* arena;         // Arena of the tree being built
+    token_type_t type;      // Current token
+    char* word;             // Text of a TOK_WORD, as written
+    int quoted;             // The word has quoting, so it is never reserved
+    int incomplete;         // Input ended inside a quote or a construct
+    int error;              // A syntax error was reported
+    redir_type_t redir_type;  // Kind of a TOK_REDIR
+    int redir_fd;           // Descriptor of a TOK_REDIR (-1 for &>: stdout and stderr)
+    int strip_tabs;         // TOK_REDIR is <<-
+    const char* redir_text; // Operator of a TOK_REDIR, for error messages
+    pending_heredoc_t* heredocs;  // Here-documents waiting for the next newline
+} parser_t;
+
+// Words with a meaning of their own at the start of a command
+static const char* reserved_words[] = {
+    "if", "then", "elif", "else", "fi", "{", "}",
+    "while", "until", "for", "do", "done", "[[", "]]", NULL
+};
+
+static const char* then_stop[] = { "then", NULL };
+static const char* else_stop[] = { "elif", "else", "fi", NULL };
+static const char* fi_stop[] = { "fi", NULL };
+static const char* group_stop[] = { "}", NULL };
+static const char* do_stop[] = { "do", NULL };
+static const char* done_stop[] = { "done", NULL };
+
+static node_t* parse_list(parser_t* p, const char** stop);
+
+// Check whether a word is reserved (when unquoted and in command position)
+int is_reserved_word(const char* word) {
+    for (int i = 0; reserved_words[i] != NULL; i++) {
+        if (strcmp(word, reserved_words[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
-// Improved parse function that handles quotes and operators correctly
-int parse_redirection_pipes(char* cmdline, pipeline_t* pipeline) {
-    if (cmdline == NULL || pipeline == NULL) {
-        return -1;
+// Whether a word is a valid variable name
+static int is_name(const char* word) {
+    if (!((*word >= 'a' && *word <= 'z') || (*word >= 'A' && *word <= 'Z') || *word == '_')) {
+        return 0;
+    }
+    for (const char* s = word + 1; *s; s++) {
+        if (!((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') ||
+              (*s >= '0' && *s <= '9') || *s == '_')) {
+            return 0;
+        }
     }
+    return 1;
+}
 
-    // NEW: Expand variables in the command line
-    char* expanded_cmdline = expand_variables(cmdline);
-    if (expanded_cmdline == NULL) {
-        return -1;
+// Characters that end an unquoted word
+static int is_word_break(char c) {
+    switch (c) {
+        case '\0': case ' ': case '\t': case '\n':
+        case ';': case '&': case '|': case '<': case '>': case '(': case ')':
+            return 1;
+        default:
+            return 0;
     }
+}
 
-    // Initialize pipeline
-    pipeline->num_commands = 0;
-    for (int i = 0; i < MAX_PIPES; i++) {
-        pipeline->commands[i].input_file = NULL;
-        pipeline->commands[i].output_file = NULL;
-        pipeline->commands[i].background = 0;
-        for (int j = 0; j < MAXARGS; j++) {
-            pipeline->commands[i].args[j] = NULL;
-        }
-    }
-
-    char* tokens[MAX_LEN];
-    int token_count = 0;
-    char* current = expanded_cmdline;
-    
-    // Improved tokenization that handles quotes and operators
-    while (*current != '\0' && token_count < MAX_LEN - 1) {
-        // Skip leading whitespace
-        while (*current == ' ' || *current == '\t') current++;
-        
-        if (*current == '\0') break;
-        
-        // Handle quoted strings
-        if (is_quote(*current)) {
-            char quote = *current;
-            char* start = ++current; // Skip opening quote
-            
-            // Find closing quote
-            while (*current != '\0' && *current != quote) {
-                current++;
-            }
-            
-            if (*current == quote) {
-                tokens[token_count] = malloc(current - start + 1);
-                strncpy(tokens[token_count], start, current - start);
-                tokens[token_count][current - start] = '\0';
-                token_count++;
-                current++; // Skip closing quote
-            } else {
-                // Unclosed quote - use rest of string
-                tokens[token_count] = strdup(start);
-                token_count++;
-                break;
+static const char* skip_braces(const char* s);
+static const char* skip_parens(const char* s);
+
+// Skip the inside of `...` (s is just past the opening backquote).
+// Returns the character after the closing one, or NULL if it is missing.
+static const char* skip_backquote(const char* s) {
+    while (*s != '\0' && *s != '`') {
+        s += *s == '\\' && s[1] != '\0' ? 2 : 1;
+    }
+    return *s == '`' ? s + 1 : NULL;
+}
+
+// Skip the inside of "..." (s is just past the opening quote). Returns
+// the character after the closing quote, or NULL if it is missing.
+static const char* skip_dquote(const char* s) {
+    while (*s != '\0' && *s != '"') {
+        if (*s == '\\' && s[1] != '\0') {
+            s += 2;
+        } else if (*s == '$' && (s[1] == '{' || s[1] == '(')) {
+            s = s[1] == '{' ? skip_braces(s + 2) : skip_parens(s + 2);
+            if (s == NULL) return NULL;
+        } else if (*s == '`') {
+            s = skip_backquote(s + 1);
+            if (s == NULL) return NULL;
+        } else {
+            s++;
+        }
+    }
+    return *s == '"' ? s + 1 : NULL;
+}
+
+// Skip the inside of ${...} (s is just past the brace), so operator
+// words such as ${VAR:-a b} stay in one word. NULL if unclosed.
+static const char* skip_braces(const char* s) {
+    int depth = 1;
+    while (*s != '\0') {
+        if (*s == '\\' && s[1] != '\0') {
+            s += 2;
+        } else if (*s == '\'') {
+            s = strchr(s + 1, '\'');
+            if (s == NULL) return NULL;
+            s++;
+        } else if (*s == '"') {
+            s = skip_dquote(s + 1);
+            if (s == NULL) return NULL;
+        } else if (*s == '$' && s[1] == '{') {
+            depth++;
+            s += 2;
+        } else if (*s == '}' && --depth == 0) {
+            return s + 1;
+        } else {
+            s++;
+        }
+    }
+    return NULL;
+}
+
+// Skip the inside of $(...) or $((...)) (s is just past the first
+// parenthesis), so blanks and operators inside stay in one word. NULL if
+// unclosed.
+static const char* skip_parens(const char* s) {
+    int depth = 1;
+    while (*s != '\0') {
+        if (*s == '\\' && s[1] != '\0') {
+            s += 2;
+        } else if (*s == '\'') {
+            s = strchr(s + 1, '\'');
+            if (s == NULL) return NULL;
+            s++;
+        } else if (*s == '"') {
+            s = skip_dquote(s + 1);
+            if (s == NULL) return NULL;
+        } else if (*s == '`') {
+            s = skip_backquote(s + 1);
+            if (s == NULL) return NULL;
+        } else if (*s == '(') {
+            depth++;
+            s++;
+        } else if (*s == ')' && --depth == 0) {
+            return s + 1;
+        } else {
+            s++;
+        }
+    }
+    return NULL;
+}
+
+// Find the "))" closing an arithmetic command (s is just past the "((").
+// Returns a pointer to it, or NULL with *unclosed set if the input ends
+// first (NULL alone means the parentheses do not pair up as (( ))).
+static const char* find_arith_end(const char* s, int* unclosed) {
+    int depth = 0;
+    for (; *s != '\0'; s++) {
+        if (*s == '(') {
+            depth++;
+        } else if (*s == ')') {
+            if (depth == 0) {
+                return s[1] == ')' ? s : NULL;
             }
-        } 
-        // Handle operators (|, ;, <, >, &)
-        else if (*current == '<' || *current == '>' || *current == '|' || *current == '&' || *current == ';') {
-            // Special handling for && and || if needed, but for now treat & and ; separately
-            tokens[token_count] = malloc(2);
-            tokens[token_count][0] = *current;
-            tokens[token_count][1] = '\0';
-            token_count++;
-            current++;
-        }
-        // Handle regular tokens
-        else {
-            char* start = current;
-            while (*current != '\0' && *current != ' ' && *current != '\t' && 
-                   *current != '<' && *current != '>' && *current != '|' && 
-                   *current != '&' && *current != ';' && !is_quote(*current)) {
-                current++;
-            }
-            
-            if (current > start) {
-                tokens[token_count] = malloc(current - start + 1);
-                strncpy(tokens[token_count], start, current - start);
-                tokens[token_count][current - start] = '\0';
-                token_count++;
-            }
-        }
-    }
-    
-    tokens[token_count] = NULL;
-
-    // Free expanded command line after tokenization
-    free(expanded_cmdline);
-
-    if (token_count == 0) {
-        return -1; // Empty command
-    }
-
-    int cmd_index = 0;
-    int arg_index = 0;
-    int i = 0;
-
-    while (i < token_count) {
-        // Check for pipe symbol
-        if (strcmp(tokens[i], "|") == 0) {
-            pipeline->commands[cmd_index].args[arg_index] = NULL;
-            cmd_index++;
-            arg_index = 0;
-            i++;
-            continue;
+            depth--;
+        }
+    }
+    *unclosed = 1;
+    return NULL;
+}
+
+// Find the end of the word starting at s. Returns NULL (and marks the
+// input incomplete) if a quote, ${, $( or ` is still open at the end.
+static const char* scan_word(parser_t* p, const char* s) {
+    while (!is_word_break(*s)) {
+        const char* next;
+        switch (*s) {
+            case '\\':
+                p->quoted = 1;
+                next = s[1] != '\0' ? s + 2 : NULL;
+                break;
+            case '\'':
+                p->quoted = 1;
+                next = strchr(s + 1, '\'');
+                if (next != NULL) next++;
+                break;
+            case '"':
+                p->quoted = 1;
+                next = skip_dquote(s + 1);
+                break;
+            case '$':
+                next = s[1] == '{' ? skip_braces(s + 2)
+                     : s[1] == '(' ? skip_parens(s + 2) : s + 1;
+                break;
+            case '`':
+                next = skip_backquote(s + 1);
+                break;
+            default:
+                next = s + 1;
+                break;
         }
-        
-        // Check for command separator (semicolon)
-        else if (strcmp(tokens[i], ";") == 0) {
-            pipeline->commands[cmd_index].args[arg_index] = NULL;
-            cmd_index++;
-            arg_index = 0;
-            i++;
+        if (next == NULL) {
+            p->incomplete = 1;
+            return NULL;
+        }
+        s = next;
+    }
+    return s;
+}
+
+// Copy a word into the arena, dropping backslash-newline continuations
+static char* copy_word(parser_t* p, const char* start, size_t len) {
+    char* word = arena_strndup(p->arena, start, len);
+    if (word == NULL || memchr(word, '\n', len) == NULL) {
+        return word;
+    }
+
+    char* out = word;
+    int in_squote = 0, in_dquote = 0;
+    for (const char* s = word; *s; s++) {
+        if (*s == '\'' && !in_dquote) {
+            in_squote = !in_squote;
+        } else if (*s == '"' && !in_squote) {
+            in_dquote = !in_dquote;
+        } else if (!in_squote && *s == '\\' && s[1] == '\n') {
+            s++;
             continue;
+        } else if (!in_squote && *s == '\\' && s[1] != '\0') {
+            *out++ = *s++;
+        }
+        *out++ = *s;
+    }
+    *out = '\0';
+    return word;
+}
+
+// Lex the redirection operator at s. fd is the descriptor number written
+// before it, or -1 if there was none. Plain < and > are left to the
+// caller, since [[ ]] uses them as operators.
+static const char* lex_redirection(parser_t* p, const char* s, int fd) {
+    p->type = TOK_REDIR;
+    p->strip_tabs = 0;
+    int input = *s == '<';
+    const char* op = s++;
+
+    if (input && *s == '<') {
+        s++;
+        if (*s == '<') {
+            s++;
+            p->redir_type = REDIR_HERESTRING;
+        } else {
+            if (*s == '-') {
+                s++;
+                p->strip_tabs = 1;
+            }
+            p->redir_type = REDIR_HEREDOC;
+        }
+    } else if (input && *s == '>') {
+        s++;
+        p->redir_type = REDIR_READ_WRITE;
+    } else if (*s == '&') {
+        s++;
+        p->redir_type = REDIR_DUP;
+    } else if (!input && *s == '>') {
+        s++;
+        p->redir_type = REDIR_APPEND;
+    } else {
+        if (!input && *s == '|') s++;
+        p->redir_type = input ? REDIR_INPUT : REDIR_OUTPUT;
+    }
+
+    if (fd < 0) {
+        fd = input ? STDIN_FILENO : STDOUT_FILENO;
+    }
+    p->redir_fd = fd;
+    p->redir_text = arena_strndup(p->arena, op, s - op);
+    if (p->redir_text == NULL) {
+        p->error = 1;
+        p->type = TOK_EOF;
+    }
+    return s;
+}
+
+// Read the bodies of the pending here-documents from the lines starting
+// at s. Returns the position after the last delimiter line. If the input
+// ends first, it is incomplete.
+static const char* read_heredocs(parser_t* p, const char* s) {
+    for (pending_heredoc_t* doc = p->heredocs; doc != NULL; doc = doc->next) {
+        size_t delimiter_len = strlen(doc->delimiter);
+        strbuf_t body;
+        strbuf_init(&body, p->arena, 64);
+
+        while (1) {
+            if (*s == '\0') {
+                p->incomplete = 1;
+                p->heredocs = NULL;
+                return s;
+            }
+            const char* line = s;
+            const char* end = strchr(s, '\n');
+            if (end == NULL) end = s + strlen(s);
+            s = *end == '\n' ? end + 1 : end;
+
+            if (doc->strip_tabs) {
+                while (*line == '\t') line++;
+            }
+            if ((size_t)(end - line) == delimiter_len &&
+                memcmp(line, doc->delimiter, delimiter_len) == 0) {
+                break;
+            }
+            strbuf_append(&body, line, end - line);
+            strbuf_putc(&body, '\n');
+        }
+        if (body.data == NULL) {
+            p->error = 1;
+        }
+        doc->redir->target = body.data;
+    }
+    p->heredocs = NULL;
+    return s;
+}
+
+// Read the next token into the parser
+static void next_token(parser_t* p) {
+    const char* s = p->pos;
+
+    // Skip blanks, line continuations and comments
+    while (1) {
+        if (*s == ' ' || *s == '\t') {
+            s++;
+        } else if (*s == '\\' && s[1] == '\n') {
+            s += 2;
+        } else if (*s == '#') {
+            while (*s != '\0' && *s != '\n') s++;
+        } else {
+            break;
+        }
+    }
+
+    p->word = NULL;
+    p->quoted = 0;
+    switch (*s) {
+        case '\0':
+            // A here-document still needs its body from a later line
+            if (p->heredocs != NULL) {
+                p->incomplete = 1;
+            }
+            p->type = TOK_EOF;
+            p->pos = s;
+            return;
+        case '\n':
+            p->type = TOK_NEWLINE;
+            p->pos = p->heredocs != NULL ? read_heredocs(p, s + 1) : s + 1;
+            return;
+        case ';':  p->type = TOK_SEMI; break;
+        case '&':
+            if (s[1] == '>') {
+                // &> and &>> redirect stdout and stderr together
+                p->pos = lex_redirection(p, s + 1, -1);
+                p->redir_fd = -1;
+                return;
+            }
+            // Fall through
+        case '|':
+            if (s[1] == *s) {
+                p->type = *s == '&' ? TOK_AND_IF : TOK_OR_IF;
+                p->pos = s + 2;
+                return;
+            }
+            p->type = *s == '&' ? TOK_AMP : TOK_PIPE;
+            break;
+        case '<':
+        case '>':
+            p->pos = lex_redirection(p, s, -1);
+            if (p->pos == s + 1) {
+                p->type = *s == '<' ? TOK_LESS : TOK_GREAT;
+            }
+            return;
+        case '(':
+            if (s[1] == '(') {
+                int unclosed = 0;
+                const char* end = find_arith_end(s + 2, &unclosed);
+                if (end == NULL) {
+                    p->type = TOK_EOF;
+                    p->pos = s + strlen(s);
+                    if (unclosed) {
+                        p->incomplete = 1;
+                    } else {
+                        fprintf(stderr, "Syntax error: unbalanced parentheses in ((\n");
+                        p->error = 1;
+                    }
+                    return;
+                }
+                p->type = TOK_ARITH;
+                p->word = arena_strndup(p->arena, s + 2, end - (s + 2));
+                if (p->word == NULL) {
+                    p->error = 1;
+                    p->type = TOK_EOF;
+                }
+                p->pos = end + 2;
+                return;
+            }
+            p->type = TOK_LPAREN;
+            break;
+        case ')':  p->type = TOK_RPAREN; break;
+        default: {
+            // A number right before < or > is the descriptor to redirect
+            const char* digits = s;
+            while (*digits >= '0' && *digits <= '9') digits++;
+            if (digits > s && digits - s < 5 && (*digits == '<' || *digits == '>')) {
+                p->pos = lex_redirection(p, digits, atoi(s));
+                return;
+            }
+
+            const char* end = scan_word(p, s);
+            if (end == NULL) {
+                p->type = TOK_EOF;
+                p->pos = s + strlen(s);
+                return;
+            }
+            p->type = TOK_WORD;
+            p->word = copy_word(p, s, end - s);
+            if (p->word == NULL) {
+                p->error = 1;
+                p->type = TOK_EOF;
+            }
+            p->pos = end;
+            return;
         }
-        
-        // Check for input redirection
-        else if (strcmp(tokens[i], "<") == 0) {
-            if (i + 1 < token_count) {
-                pipeline->commands[cmd_index].input_file = strdup(tokens[i + 1]);
-                i += 2;
-            } else {
-                fprintf(stderr, "Syntax error: no file specified for input redirection\n");
-                // Free tokens before returning
-                for (int j = 0; j < token_count; j++) free(tokens[j]);
-                return -1;
-            }
-        }
-        
-        // Check for output redirection
-        else if (strcmp(tokens[i], ">") == 0) {
-            if (i + 1 < token_count) {
-                pipeline->commands[cmd_index].output_file = strdup(tokens[i + 1]);
-                i += 2;
-            } else {
-                fprintf(stderr, "Syntax error: no file specified for output redirection\n");
-                // Free tokens before returning
-                for (int j = 0; j < token_count; j++) free(tokens[j]);
-                return -1;
-            }
-        }
-        
-        // Check for background execution (must be at end of command)
-        else if (strcmp(tokens[i], "&") == 0) {
-            // Check if & is the last token or followed by ;
-            if (i == token_count - 1 || (i + 1 < token_count && strcmp(tokens[i + 1], ";") == 0)) {
-                pipeline->commands[cmd_index].background = 1;
-                i++;
-            } else {
-                // & in middle of command - treat as regular argument
-                pipeline->commands[cmd_index].args[arg_index++] = strdup(tokens[i++]);
-            }
-        }
-        
-        // Regular argument
-        else {
-            pipeline->commands[cmd_index].args[arg_index++] = strdup(tokens[i++]);
-        }
-
-        // Check bounds
-        if (cmd_index >= MAX_PIPES) {
-            fprintf(stderr, "Error: too many commands (max %d)\n", MAX_PIPES);
-            // Free tokens before returning
-            for (int j = 0; j < token_count; j++) free(tokens[j]);
+    }
+    p->pos = s + 1;
+}
+
+// Printable form of the current token for error messages
+static const char* token_text(parser_t* p) {
+    switch (p->type) {
+        case TOK_WORD:    return p->word;
+        case TOK_SEMI:    return ";";
+        case TOK_AMP:     return "&";
+        case TOK_PIPE:    return "|";
+        case TOK_AND_IF:  return "&&";
+        case TOK_OR_IF:   return "||";
+        case TOK_LESS:    return "<";
+        case TOK_GREAT:   return ">";
+        case TOK_REDIR:   return p->redir_text;
+        case TOK_LPAREN:  return "(";
+        case TOK_RPAREN:  return ")";
+        case TOK_ARITH:   return "((";
+        default:          return "newline";
+    }
+}
+
+static void syntax_error(parser_t* p) {
+    if (!p->error && !p->incomplete) {
+        fprintf(stderr, "Syntax error near unexpected token `%s'\n", token_text(p));
+    }
+    p->error = 1;
+}
+
+// Something else was required here. At the end of the input that only
+// means the construct continues on a later line.
+static void expect_more(parser_t* p) {
+    if (p->type == TOK_EOF) {
+        p->incomplete = 1;
+    } else {
+        syntax_error(p);
+    }
+}
+
+// Whether the current token is the given reserved word
+static int at_word(parser_t* p, const char* word) {
+    return p->type == TOK_WORD && !p->quoted && strcmp(p->word, word) == 0;
+}
+
+static int at_stop_word(parser_t* p, const char** stop) {
+    for (int i = 0; stop != NULL && stop[i] != NULL; i++) {
+        if (at_word(p, stop[i])) return 1;
+    }
+    return 0;
+}
+
+// Consume a required reserved word
+static int expect_word(parser_t* p, const char* word) {
+    if (!at_word(p, word)) {
+        expect_more(p);
+        return 0;
+    }
+    next_token(p);
+    return 1;
+}
+
+static node_t* new_node(parser_t* p, node_type_t type) {
+    node_t* node = arena_alloc(p->arena, sizeof(node_t));
+    if (node == NULL) {
+        p->error = 1;
+        return NULL;
+    }
+    memset(node, 0, sizeof(node_t));
+    node->type = type;
+    return node;
+}
+
+// Append to a node vector in the arena, doubling it when full
+static int push_item(parser_t* p, node_t*** items, int* count, int* cap, node_t* item) {
+    if (*count + 1 >= *cap) {
+        int new_cap = *cap ? *cap * 2 : 4;
+        node_t** grown = *items == NULL
+            ? arena_alloc(p->arena, new_cap * sizeof(node_t*))
+            : arena_extend(p->arena, *items, *cap * sizeof(node_t*), new_cap * sizeof(node_t*));
+        if (grown == NULL) {
+            p->error = 1;
+            return -1;
+        }
+        *items = grown;
+        *cap = new_cap;
+    }
+    (*items)[(*count)++] = item;
+    return 0;
+}
+
+// Append to a word vector in the arena, keeping room for a NULL
+static int push_word(parser_t* p, char*** words, int* count, int* cap, char* word) {
+    if (*count + 1 >= *cap) {
+        int new_cap = *cap ? *cap * 2 : 8;
+        char** grown = *words == NULL
+            ? arena_alloc(p->arena, new_cap * sizeof(char*))
+            : arena_extend(p->arena, *words, *cap * sizeof(char*), new_cap * sizeof(char*));
+        if (grown == NULL) {
+            p->error = 1;
+            return -1;
+        }
+        *words = grown;
+        *cap = new_cap;
+    }
+    (*words)[(*count)++] = word;
+    return 0;
+}
+
+// Whether the current token is a redirection operator
+static int at_redirection(parser_t* p) {
+    return p->type == TOK_LESS || p->type == TOK_GREAT || p->type == TOK_REDIR;
+}
+
+// Remove the quotes from a here-document delimiter
+static char* unquote_delimiter(parser_t* p, const char* word) {
+    char* out = arena_strndup(p->arena, word, strlen(word));
+    if (out == NULL) {
+        p->error = 1;
+        return NULL;
+    }
+    char* d = out;
+    for (const char* s = word; *s; s++) {
+        if (*s == '\\' && s[1] != '\0') {
+            *d++ = *++s;
+        } else if (*s != '\'' && *s != '"') {
+            *d++ = *s;
+        }
+    }
+    *d = '\0';
+    return out;
+}
+
+static redir_t* new_redir(parser_t* p, redir_type_t type, int fd, char* target, redir_t*** tail) {
+    redir_t* redir = arena_alloc(p->arena, sizeof(redir_t));
+    if (redir == NULL) {
+        p->error = 1;
+        return NULL;
+    }
+    memset(redir, 0, sizeof(redir_t));
+    redir->type = type;
+    redir->fd = fd;
+    redir->target = target;
+    redir->source_fd = -1;
+    **tail = redir;
+    *tail = &redir->next;
+    return redir;
+}
+
+// Parse a redirection operator and its word, appending the redirection
+// at *tail. A here-document is queued so its body is read at the end of
+// the line.
+static int parse_redirection(parser_t* p, redir_t*** tail) {
+    redir_type_t type = p->redir_type;
+    int fd = p->redir_fd;
+    int strip_tabs = p->strip_tabs;
+    if (p->type != TOK_REDIR) {
+        type = p->type == TOK_LESS ? REDIR_INPUT : REDIR_OUTPUT;
+        fd = p->type == TOK_LESS ? STDIN_FILENO : STDOUT_FILENO;
+    }
+    next_token(p);
+    if (p->type != TOK_WORD) {
+        syntax_error(p);
+        return -1;
+    }
+
+    // &>word is >word 2>&1
+    redir_t* redir = new_redir(p, type, fd < 0 ? STDOUT_FILENO : fd, p->word, tail);
+    if (redir == NULL || (fd < 0 && new_redir(p, REDIR_DUP, STDERR_FILENO, "1", tail) == NULL)) {
+        return -1;
+    }
+
+    if (type == REDIR_HEREDOC) {
+        pending_heredoc_t* doc = arena_alloc(p->arena, sizeof(pending_heredoc_t));
+        if (doc == NULL) {
+            p->error = 1;
             return -1;
         }
-        if (arg_index >= MAXARGS - 1) {
-            fprintf(stderr, "Error: too many arguments (max %d)\n", MAXARGS);
-            // Free tokens before returning
-            for (int j = 0; j < token_count; j++) free(tokens[j]);
+        doc->redir = redir;
+        doc->delimiter = unquote_delimiter(p, p->word);
+        doc->strip_tabs = strip_tabs;
+        doc->next = NULL;
+        redir->quoted = p->quoted;
+        redir->target = NULL;
+        if (doc->delimiter == NULL) {
             return -1;
         }
+
+        pending_heredoc_t** last = &p->heredocs;
+        while (*last != NULL) last = &(*last)->next;
+        *last = doc;
+    }
+    next_token(p);
+    return 0;
+}
+
+// Simple command: words and redirections in any order
+static node_t* parse_simple(parser_t* p) {
+    node_t* node = new_node(p, NODE_COMMAND);
+    if (node == NULL) return NULL;
+
+    char** words = NULL;
+    int count = 0, cap = 0;
+    redir_t** tail = &node->redirs;
+
+    while (1) {
+        if (p->type == TOK_WORD) {
+            // NAME=value words before the command name are assignments
+            if (count == node->cmd.num_assigns && is_variable_assignment(p->word)) {
+                node->cmd.num_assigns++;
+            }
+            if (push_word(p, &words, &count, &cap, p->word) < 0) {
+                return NULL;
+            }
+            next_token(p);
+        } else if (at_redirection(p)) {
+            if (parse_redirection(p, &tail) < 0) {
+                return NULL;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (count == 0 && node->redirs == NULL) {
+        expect_more(p);
+        return NULL;
+    }
+    if (words == NULL) {
+        words = arena_alloc(p->arena, sizeof(char*));
+        if (words == NULL) {
+            p->error = 1;
+            return NULL;
+        }
+    }
+    words[count] = NULL;
+    node->cmd.words = words;
+    node->cmd.num_words = count;
+    return node;
+}
+
+// A list that must contain at least one command (if/then bodies, groups)
+static node_t* parse_block(parser_t* p, const char** stop) {
+    node_t* list = parse_list(p, stop);
+    if (list == NULL) {
+        return NULL;
+    }
+    if (list->list.count == 0) {
+        expect_more(p);
+        return NULL;
+    }
+    if (list->list.count == 1 && !list->list.items[0]->background) {
+        return list->list.items[0];
+    }
+    return list;
+}
+
+// if_clause, entered at the 'if' or 'elif' keyword. An elif chain becomes
+// nested NODE_IFs sharing the final 'fi'.
+static node_t* parse_if(parser_t* p) {
+    node_t* node = new_node(p, NODE_IF);
+    if (node == NULL) return NULL;
+    next_token(p);
+
+    node->branch.cond = parse_block(p, then_stop);
+    if (node->branch.cond == NULL || !expect_word(p, "then")) {
+        return NULL;
+    }
+    node->branch.body = parse_block(p, else_stop);
+    if (node->branch.body == NULL) {
+        return NULL;
+    }
+
+    if (at_word(p, "elif")) {
+        node->branch.else_part = parse_if(p);
+        return node->branch.else_part ? node : NULL;
+    }
+    if (at_word(p, "else")) {
+        next_token(p);
+        node->branch.else_part = parse_block(p, fi_stop);
+        if (node->branch.else_part == NULL) {
+            return NULL;
+        }
+    }
+    return expect_word(p, "fi") ? node : NULL;
+}
+
+// { list }
+static node_t* parse_group(parser_t* p) {
+    next_token(p);
+    node_t* list = parse_list(p, group_stop);
+    if (list == NULL) {
+        return NULL;
+    }
+    if (list->list.count == 0) {
+        expect_more(p);
+        return NULL;
+    }
+    if (!expect_word(p, "}")) {
+        return NULL;
+    }
+    list->type = NODE_GROUP;
+    return list;
+}
+
+// do list done, ending a loop
+static node_t* parse_do_group(parser_t* p) {
+    while (p->type == TOK_NEWLINE) {
+        next_token(p);
+    }
+    if (!expect_word(p, "do")) {
+        return NULL;
+    }
+    node_t* body = parse_block(p, done_stop);
+    if (body == NULL || !expect_word(p, "done")) {
+        return NULL;
+    }
+    return body;
+}
+
+// while / until loop, entered at the keyword
+static node_t* parse_while(parser_t* p, node_type_t type) {
+    node_t* node = new_node(p, type);
+    if (node == NULL) return NULL;
+    next_token(p);
+
+    node->branch.cond = parse_block(p, do_stop);
+    if (node->branch.cond == NULL) {
+        return NULL;
+    }
+    node->branch.body = parse_do_group(p);
+    return node->branch.body ? node : NULL;
+}
+
+// Parse one clause of for (( ; ; )). A blank clause is NULL.
+static int parse_arith_clause(parser_t* p, const char* start, const char* end,
+                              arith_node_t** out) {
+    const char* s = start;
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\n')) s++;
+    if (s == end) {
+        *out = NULL;
+        return 0;
+    }
+    *out = arith_parse(start, end - start, p->arena);
+    if (*out == NULL) {
+        p->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// for (( init; cond; step )), with the current token the (( ))
+static node_t* parse_arith_for(parser_t* p) {
+    node_t* node = new_node(p, NODE_ARITH_FOR);
+    if (node == NULL) return NULL;
+
+    // Split the inside at the two top-level semicolons
+    const char* text = p->word;
+    const char* parts[4] = { text, NULL, NULL, NULL };
+    int count = 1, depth = 0;
+    for (const char* s = text; *s; s++) {
+        if (*s == '(') depth++;
+        else if (*s == ')') depth--;
+        else if (*s == ';' && depth == 0) {
+            if (count == 3) break;
+            parts[count++] = s + 1;
+        }
+    }
+    if (count != 3) {
+        fprintf(stderr, "Syntax error: for ((init; cond; step)) needs two semicolons\n");
+        p->error = 1;
+        return NULL;
+    }
+    const char* end = text + strlen(text);
+    if (parse_arith_clause(p, parts[0], parts[1] - 1, &node->arith.init) < 0 ||
+        parse_arith_clause(p, parts[1], parts[2] - 1, &node->arith.cond) < 0 ||
+        parse_arith_clause(p, parts[2], end, &node->arith.step) < 0) {
+        return NULL;
+    }
+
+    next_token(p);
+    if (p->type == TOK_SEMI) {
+        next_token(p);
+    }
+    node->arith.body = parse_do_group(p);
+    return node->arith.body ? node : NULL;
+}
+
+// for loop, entered at the 'for' keyword
+static node_t* parse_for(parser_t* p) {
+    next_token(p);
+    if (p->type == TOK_ARITH) {
+        return parse_arith_for(p);
+    }
+
+    node_t* node = new_node(p, NODE_FOR);
+    if (node == NULL) return NULL;
+    if (p->type != TOK_WORD || p->quoted || !is_name(p->word)) {
+        expect_more(p);
+        return NULL;
+    }
+    node->loop.var = p->word;
+    next_token(p);
+
+    while (p->type == TOK_NEWLINE) {
+        next_token(p);
+    }
+    if (at_word(p, "in")) {
+        next_token(p);
+        char** words = NULL;
+        int count = 0, cap = 0;
+        while (p->type == TOK_WORD) {
+            if (push_word(p, &words, &count, &cap, p->word) < 0) {
+                return NULL;
+            }
+            next_token(p);
+        }
+        if (p->type != TOK_SEMI && p->type != TOK_NEWLINE) {
+            expect_more(p);
+            return NULL;
+        }
+        next_token(p);
+        if (words == NULL) {
+            words = arena_alloc(p->arena, sizeof(char*));
+            if (words == NULL) {
+                p->error = 1;
+                return NULL;
+            }
+        }
+        words[count] = NULL;
+        node->loop.words = words;
+        node->loop.num_words = count;
+    } else if (p->type == TOK_SEMI) {
+        next_token(p);
+    }
+
+    node->loop.body = parse_do_group(p);
+    return node->loop.body ? node : NULL;
+}
+
+// (( expression )) as a command
+static node_t* parse_arith_command(parser_t* p) {
+    node_t* node = new_node(p, NODE_ARITH);
+    if (node == NULL) return NULL;
+    node->arith.cond = arith_parse(p->word, strlen(p->word), p->arena);
+    if (node->arith.cond == NULL) {
+        p->error = 1;
+        return NULL;
+    }
+    next_token(p);
+    return node;
+}
+
+static cond_node_t* parse_cond_or(parser_t* p);
+
+// Next token inside [[ ]], where newlines are only blanks
+static void next_cond_token(parser_t* p) {
+    do {
+        next_token(p);
+    } while (p->type == TOK_NEWLINE);
+}
+
+static cond_node_t* new_cond(parser_t* p, cond_op_t op) {
+    cond_node_t* node = arena_alloc(p->arena, sizeof(cond_node_t));
+    if (node == NULL) {
+        p->error = 1;
+        return NULL;
+    }
+    memset(node, 0, sizeof(cond_node_t));
+    node->op = op;
+    return node;
+}
+
+// An operand of [[ ]]; < and > are operators there, not redirections
+static const char* cond_operator(parser_t* p) {
+    if (p->type == TOK_LESS) return "<";
+    if (p->type == TOK_GREAT) return ">";
+    if (p->type == TOK_WORD && !p->quoted && is_binary_test(p->word)) return p->word;
+    return NULL;
+}
+
+// Whether the current token can be an operand word
+static int at_cond_word(parser_t* p) {
+    return p->type == TOK_WORD && !at_word(p, "]]");
+}
+
+static cond_node_t* parse_cond_primary(parser_t* p) {
+    if (p->type == TOK_WORD && !p->quoted && strcmp(p->word, "!") == 0) {
+        next_cond_token(p);
+        cond_node_t* operand = parse_cond_primary(p);
+        cond_node_t* node = operand ? new_cond(p, COND_NOT) : NULL;
+        if (node) node->left = operand;
+        return node;
+    }
+    if (p->type == TOK_LPAREN) {
+        next_cond_token(p);
+        cond_node_t* inner = parse_cond_or(p);
+        if (inner == NULL) return NULL;
+        if (p->type != TOK_RPAREN) {
+            expect_more(p);
+            return NULL;
+        }
+        next_cond_token(p);
+        return inner;
+    }
+    if (!at_cond_word(p)) {
+        expect_more(p);
+        return NULL;
+    }
+
+    char* first = p->word;
+    int first_quoted = p->quoted;
+    next_cond_token(p);
+
+    // -f file (unless the "operator" is really the left side of a test)
+    if (!first_quoted && is_unary_test(first) && at_cond_word(p) && cond_operator(p) == NULL) {
+        cond_node_t* node = new_cond(p, COND_UNARY);
+        if (node == NULL) return NULL;
+        node->test = first;
+        node->words[0] = p->word;
+        next_cond_token(p);
+        return node;
+    }
+
+    const char* op = cond_operator(p);
+    if (op == NULL) {
+        cond_node_t* node = new_cond(p, COND_WORD);
+        if (node) node->words[0] = first;
+        return node;
+    }
+    next_cond_token(p);
+    if (!at_cond_word(p)) {
+        expect_more(p);
+        return NULL;
+    }
+    cond_node_t* node = new_cond(p, COND_BINARY);
+    if (node == NULL) return NULL;
+    node->test = op;
+    node->words[0] = first;
+    node->words[1] = p->word;
+    next_cond_token(p);
+    return node;
+}
+
+static cond_node_t* parse_cond_and(parser_t* p) {
+    cond_node_t* left = parse_cond_primary(p);
+    while (left != NULL && p->type == TOK_AND_IF) {
+        next_cond_token(p);
+        cond_node_t* right = parse_cond_primary(p);
+        cond_node_t* node = right ? new_cond(p, COND_AND) : NULL;
+        if (node == NULL) return NULL;
+        node->left = left;
+        node->right = right;
+        left = node;
+    }
+    return left;
+}
+
+static cond_node_t* parse_cond_or(parser_t* p) {
+    cond_node_t* left = parse_cond_and(p);
+    while (left != NULL && p->type == TOK_OR_IF) {
+        next_cond_token(p);
+        cond_node_t* right = parse_cond_and(p);
+        cond_node_t* node = right ? new_cond(p, COND_OR) : NULL;
+        if (node == NULL) return NULL;
+        node->left = left;
+        node->right = right;
+        left = node;
+    }
+    return left;
+}
+
+// [[ expression ]], entered at the '[['
+static node_t* parse_cond_command(parser_t* p) {
+    node_t* node = new_node(p, NODE_COND);
+    if (node == NULL) return NULL;
+    next_cond_token(p);
+
+    node->cond = parse_cond_or(p);
+    if (node->cond == NULL || !expect_word(p, "]]")) {
+        return NULL;
+    }
+    return node;
+}
+
+// Whether the current word is followed by "()", making it a function
+// definition
+static int at_function_definition(parser_t* p) {
+    if (p->type != TOK_WORD || p->quoted || !is_name(p->word) || is_reserved_word(p->word)) {
+        return 0;
+    }
+    const char* s = p->pos;
+    while (*s == ' ' || *s == '\t') s++;
+    if (*s != '(' || s[1] == '(') {
+        return 0;
+    }
+    s++;
+    while (*s == ' ' || *s == '\t') s++;
+    return *s == ')';
+}
+
+// Whether the current token starts a compound command
+static int at_compound_command(parser_t* p) {
+    return p->type == TOK_ARITH || at_word(p, "{") || at_word(p, "if") || at_word(p, "[[") ||
+           at_word(p, "while") || at_word(p, "until") || at_word(p, "for");
+}
+
+static node_t* parse_command(parser_t* p);
+
+// name() compound-command
+static node_t* parse_function(parser_t* p) {
+    node_t* node = new_node(p, NODE_FUNCTION);
+    if (node == NULL) return NULL;
+    node->func.name = p->word;
+    next_token(p); // (
+    next_token(p); // )
+    next_token(p);
+    while (p->type == TOK_NEWLINE) {
+        next_token(p);
+    }
+    if (!at_compound_command(p)) {
+        expect_more(p);
+        return NULL;
+    }
+    node->func.body = parse_command(p);
+    return node->func.body ? node : NULL;
+}
+
+// Redirections after a compound command apply to all of it
+static node_t* parse_compound_redirections(parser_t* p, node_t* node) {
+    if (node == NULL) {
+        return NULL;
+    }
+    redir_t** tail = &node->redirs;
+    while (at_redirection(p)) {
+        if (parse_redirection(p, &tail) < 0) {
+            return NULL;
+        }
+    }
+    return node;
+}
+
+static node_t* parse_compound(parser_t* p) {
+    if (p->type == TOK_ARITH) {
+        return parse_arith_command(p);
+    }
+    if (at_function_definition(p)) {
+        return parse_function(p);
+    }
+    if (p->type == TOK_WORD && !p->quoted) {
+        if (strcmp(p->word, "if") == 0) {
+            return parse_if(p);
+        }
+        if (strcmp(p->word, "while") == 0) {
+            return parse_while(p, NODE_WHILE);
+        }
+        if (strcmp(p->word, "until") == 0) {
+            return parse_while(p, NODE_UNTIL);
+        }
+        if (strcmp(p->word, "for") == 0) {
+            return parse_for(p);
+        }
+        if (strcmp(p->word, "[[") == 0) {
+            return parse_cond_command(p);
+        }
+        if (strcmp(p->word, "{") == 0) {
+            return parse_group(p);
+        }
+    }
+    return NULL;
+}
+
+static node_t* parse_command(parser_t* p) {
+    if (at_compound_command(p) || at_function_definition(p)) {
+        node_t* node = parse_compound(p);
+        if (node == NULL || node->type == NODE_FUNCTION) {
+            return node;
+        }
+        return parse_compound_redirections(p, node);
+    }
+    if (p->type == TOK_WORD && !p->quoted && is_reserved_word(p->word)) {
+        syntax_error(p);
+        return NULL;
+    }
+    return parse_simple(p);
+}
+
+static node_t* parse_pipeline(parser_t* p) {
+    node_t* first = parse_command(p);
+    if (first == NULL || p->type != TOK_PIPE) {
+        return first;
+    }
+
+    node_t* node = new_node(p, NODE_PIPELINE);
+    int cap = 0;
+    if (node == NULL ||
+        push_item(p, &node->list.items, &node->list.count, &cap, first) < 0) {
+        return NULL;
+    }
+    while (p->type == TOK_PIPE) {
+        next_token(p);
+        while (p->type == TOK_NEWLINE) {
+            next_token(p);
+        }
+        node_t* stage = parse_command(p);
+        if (stage == NULL ||
+            push_item(p, &node->list.items, &node->list.count, &cap, stage) < 0) {
+            return NULL;
+        }
+    }
+    return node;
+}
+
+// Pipelines joined with && and ||. They group from the left, so
+// a || b && c is (a || b) && c.
+static node_t* parse_and_or(parser_t* p) {
+    node_t* left = parse_pipeline(p);
+    while (left != NULL && (p->type == TOK_AND_IF || p->type == TOK_OR_IF)) {
+        node_t* node = new_node(p, p->type == TOK_AND_IF ? NODE_AND : NODE_OR);
+        if (node == NULL) return NULL;
+        next_token(p);
+        while (p->type == TOK_NEWLINE) {
+            next_token(p);
+        }
+        node->pair.left = left;
+        node->pair.right = parse_pipeline(p);
+        if (node->pair.right == NULL) {
+            return NULL;
+        }
+        left = node;
+    }
+    return left;
+}
+
+// Commands up to the end of input or one of the stop words (which is
+// left as the current token)
+static node_t* parse_list(parser_t* p, const char** stop) {
+    node_t* list = new_node(p, NODE_LIST);
+    int cap = 0;
+    if (list == NULL) return NULL;
+
+    while (1) {
+        while (p->type == TOK_NEWLINE) {
+            next_token(p);
+        }
+        if (p->type == TOK_EOF || p->type == TOK_RPAREN || at_stop_word(p, stop)) {
+            break;
+        }
+
+        node_t* item = parse_and_or(p);
+        if (item == NULL ||
+            push_item(p, &list->list.items, &list->list.count, &cap, item) < 0) {
+            return NULL;
+        }
+
+        if (p->type == TOK_AMP) {
+            item->background = 1;
+            next_token(p);
+        } else if (p->type == TOK_SEMI || p->type == TOK_NEWLINE) {
+            next_token(p);
+        } else if (p->type != TOK_EOF && !at_stop_word(p, stop)) {
+            syntax_error(p);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+// Parse an input (one or more lines) into ast. Returns PARSE_OK,
+// PARSE_ERROR after reporting a syntax error, or PARSE_INCOMPLETE if the
+// input stops inside a quote or compound command. The ast must be
+// zero-initialized before its first use.
+int parse_input(const char* input, ast_t* ast) {
+    if (input == NULL || ast == NULL) {
+        return PARSE_ERROR;
+    }
+
+    arena_reset(&ast->arena);
+    ast->root = NULL;
+
+    parser_t p = {0};
+    p.pos = input;
+    p.arena = &ast->arena;
+    next_token(&p);
+
+    node_t* root = parse_list(&p, NULL);
+    if (root != NULL && p.type != TOK_EOF) {
+        syntax_error(&p);
+    }
+    if (p.incomplete) {
+        return PARSE_INCOMPLETE;
+    }
+    if (root == NULL || p.error) {
+        return PARSE_ERROR;
+    }
+
+    if (root->list.count == 0) {
+        root = NULL; // Blank or comment-only input
+    } else if (root->list.count == 1 && !root->list.items[0]->background) {
+        root = root->list.items[0];
+    }
+    ast->root = root;
+    return PARSE_OK;
+}
+
+// Free the tree. Everything lives in the arena, so this is a single reset
+// that keeps the arena's chunks for the next parse.
+void free_ast(ast_t* ast) {
+    if (ast == NULL) return;
+
+    arena_reset(&ast->arena);
+    ast->root = NULL;
+}
+
+// Free the tree and give its arena memory back to the system
+void release_ast(ast_t* ast) {
+    if (ast == NULL) return;
+
+    free_ast(ast);
+    arena_release(&ast->arena);
+}
+
+// Copy a string into arena (NULL stays NULL). *failed is set when out of
+// memory.
+static char* copy_string(const char* str, arena_t* arena, int* failed) {
+    if (str == NULL) {
+        return NULL;
     }
+    char* copy = arena_strndup(arena, str, strlen(str));
+    if (copy == NULL) *failed = 1;
+    return copy;
+}
 
-    // Terminate the last command's argument list
-    if (arg_index > 0) {
-        pipeline->commands[cmd_index].args[arg_index] = NULL;
+// Copy a NULL-terminated word vector into arena
+static char** copy_words(char** words, int count, arena_t* arena, int* failed) {
+    if (words == NULL) {
+        return NULL;
+    }
+    char** copy = arena_alloc(arena, (count + 1) * sizeof(char*));
+    if (copy == NULL) {
+        *failed = 1;
+        return NULL;
+    }
+    for (int i = 0; i < count; i++) {
+        copy[i] = copy_string(words[i], arena, failed);
+    }
+    copy[count] = NULL;
+    return copy;
+}
+
+static cond_node_t* copy_cond(const cond_node_t* cond, arena_t* arena, int* failed) {
+    if (cond == NULL || *failed) {
+        return NULL;
+    }
+    cond_node_t* copy = arena_alloc(arena, sizeof(cond_node_t));
+    if (copy == NULL) {
+        *failed = 1;
+        return NULL;
     }
-    
-    pipeline->num_commands = cmd_index + 1;
-    
-    // Free tokens
-    for (int j = 0; j < token_count; j++) free(tokens[j]);
-    
-    return pipeline->num_commands;
+    *copy = *cond;
+    copy->test = copy_string(cond->test, arena, failed);
+    copy->words[0] = copy_string(cond->words[0], arena, failed);
+    copy->words[1] = copy_string(cond->words[1], arena, failed);
+    copy->left = copy_cond(cond->left, arena, failed);
+    copy->right = copy_cond(cond->right, arena, failed);
+    return copy;
 }
 
-// Free memory allocated for pipeline
-void free_pipeline(pipeline_t* pipeline) {
-    if (pipeline == NULL) return;
-    
-    for (int i = 0; i < pipeline->num_commands; i++) {
-        command_t* cmd = &pipeline->commands[i];
-        
-        if (cmd->input_file) {
-            free(cmd->input_file);
-            cmd->input_file = NULL;
+static arith_node_t* copy_arith(const arith_node_t* expr, arena_t* arena, int* failed) {
+    arith_node_t* copy = arith_copy(expr, arena);
+    if (expr != NULL && copy == NULL) *failed = 1;
+    return copy;
+}
+
+static redir_t* copy_redirs(const redir_t* redir, arena_t* arena, int* failed) {
+    if (redir == NULL || *failed) {
+        return NULL;
+    }
+    redir_t* copy = arena_alloc(arena, sizeof(redir_t));
+    if (copy == NULL) {
+        *failed = 1;
+        return NULL;
+    }
+    *copy = *redir;
+    copy->target = copy_string(redir->target, arena, failed);
+    copy->next = copy_redirs(redir->next, arena, failed);
+    return copy;
+}
+
+static node_t* copy_subtree(const node_t* node, arena_t* arena, int* failed) {
+    if (node == NULL || *failed) {
+        return NULL;
+    }
+    node_t* copy = arena_alloc(arena, sizeof(node_t));
+    if (copy == NULL) {
+        *failed = 1;
+        return NULL;
+    }
+    *copy = *node;
+    copy->redirs = copy_redirs(node->redirs, arena, failed);
+
+    switch (node->type) {
+        case NODE_COMMAND:
+            copy->cmd.words = copy_words(node->cmd.words, node->cmd.num_words, arena, failed);
+            break;
+        case NODE_PIPELINE:
+        case NODE_LIST:
+        case NODE_GROUP:
+            copy->list.items = arena_alloc(arena, (node->list.count + 1) * sizeof(node_t*));
+            if (copy->list.items == NULL) {
+                *failed = 1;
+                break;
+            }
+            for (int i = 0; i < node->list.count; i++) {
+                copy->list.items[i] = copy_subtree(node->list.items[i], arena, failed);
+            }
+            break;
+        case NODE_IF:
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            copy->branch.cond = copy_subtree(node->branch.cond, arena, failed);
+            copy->branch.body = copy_subtree(node->branch.body, arena, failed);
+            copy->branch.else_part = copy_subtree(node->branch.else_part, arena, failed);
+            break;
+        case NODE_FOR:
+            copy->loop.var = copy_string(node->loop.var, arena, failed);
+            copy->loop.words = copy_words(node->loop.words, node->loop.num_words, arena, failed);
+            copy->loop.body = copy_subtree(node->loop.body, arena, failed);
+            break;
+        case NODE_ARITH_FOR:
+        case NODE_ARITH:
+            copy->arith.init = copy_arith(node->arith.init, arena, failed);
+            copy->arith.cond = copy_arith(node->arith.cond, arena, failed);
+            copy->arith.step = copy_arith(node->arith.step, arena, failed);
+            copy->arith.body = copy_subtree(node->arith.body, arena, failed);
+            break;
+        case NODE_FUNCTION:
+            copy->func.name = copy_string(node->func.name, arena, failed);
+            copy->func.body = copy_subtree(node->func.body, arena, failed);
+            break;
+        case NODE_COND:
+            copy->cond = copy_cond(node->cond, arena, failed);
+            break;
+        case NODE_AND:
+        case NODE_OR:
+            copy->pair.left = copy_subtree(node->pair.left, arena, failed);
+            copy->pair.right = copy_subtree(node->pair.right, arena, failed);
+            break;
+    }
+    return copy;
+}
+
+// Deep-copy a subtree into another arena, so it can outlive the input it
+// was parsed from (function bodies). Returns NULL if out of memory.
+node_t* copy_node(const node_t* node, arena_t* arena) {
+    int failed = 0;
+    node_t* copy = copy_subtree(node, arena, &failed);
+    return failed ? NULL : copy;
+}
+
+// Rebuild a printable command line from expanded commands (for job
+// listings). Commands are joined with | when piped. Returns a malloc'd
+// string.
+char* command_to_string(command_t* cmds, int count) {
+    size_t len = 1;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; cmds[i].args[j] != NULL; j++) {
+            len += strlen(cmds[i].args[j]) + 1;
         }
-        if (cmd->output_file) {
-            free(cmd->output_file);
-            cmd->output_file = NULL;
+        len += 3;
+    }
+
+    char* str = malloc(len);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    char* out = str;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; cmds[i].args[j] != NULL; j++) {
+            if (out != str) *out++ = ' ';
+            size_t arg_len = strlen(cmds[i].args[j]);
+            memcpy(out, cmds[i].args[j], arg_len);
+            out += arg_len;
         }
-        
-        for (int j = 0; j < MAXARGS && cmd->args[j] != NULL; j++) {
-            free(cmd->args[j]);
-            cmd->args[j] = NULL;
+        if (i < count - 1) {
+            memcpy(out, " |", 2);
+            out += 2;
         }
     }
-    pipeline->num_commands = 0;
+    *out = '\0';
+    return str;
 }
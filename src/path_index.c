@@ -0,0 +1,281 @@
+#include "shell.h"
+#include <stdint.h>
+#include <dirent.h>
+#include <limits.h>
+
+// Index of the executables on $PATH for command completion. Names live in
+// a prefix trie whose children are kept in byte order, so a walk below the
+// node for the typed prefix yields matches already sorted. The index is
+// built on the first completion. After that only directories whose mtime
+// (or identity, for relative entries) changed are rescanned.
+
+typedef struct {
+    uint32_t first_child;    // 0 = none (the root is never a child)
+    uint32_t next_sibling;   // Next child of the same parent, higher byte
+    uint16_t refs;           // Directories providing this exact name
+    unsigned char ch;
+} name_node_t;
+
+// A $PATH directory and the names it contributed
+typedef struct {
+    char* dir;
+    struct timespec mtime;
+    dev_t dev;
+    ino_t ino;
+    int exists;
+    char** names;
+    int name_count;
+} index_dir_t;
+
+static name_node_t* nodes = NULL;
+static uint32_t node_count = 0;
+static uint32_t node_cap = 0;
+
+static index_dir_t* dirs = NULL;
+static int dir_count = 0;
+static char* indexed_path = NULL;   // $PATH the index was built from
+
+// Find or create the child of node for ch, keeping siblings sorted
+static uint32_t node_child(uint32_t node, unsigned char ch, int create) {
+    uint32_t* link = &nodes[node].first_child;
+    while (*link != 0 && nodes[*link].ch < ch) {
+        link = &nodes[*link].next_sibling;
+    }
+    if (*link != 0 && nodes[*link].ch == ch) {
+        return *link;
+    }
+    if (!create) {
+        return 0;
+    }
+
+    if (node_count == node_cap) {
+        uint32_t cap = node_cap ? node_cap * 2 : 1024;
+        name_node_t* grown = realloc(nodes, cap * sizeof(name_node_t));
+        if (grown == NULL) {
+            perror("realloc failed");
+            return 0;
+        }
+        // link pointed into the old array
+        size_t offset = (char*)link - (char*)nodes;
+        nodes = grown;
+        node_cap = cap;
+        link = (uint32_t*)((char*)nodes + offset);
+    }
+    uint32_t child = node_count++;
+    nodes[child].first_child = 0;
+    nodes[child].refs = 0;
+    nodes[child].ch = ch;
+    nodes[child].next_sibling = *link;
+    *link = child;
+    return child;
+}
+
+// Node for name, or 0 if it is not in the trie
+static uint32_t find_node(const char* name, int create) {
+    uint32_t node = 0;
+    for (const char* p = name; *p; p++) {
+        node = node_child(node, (unsigned char)*p, create);
+        if (node == 0) return 0;
+    }
+    return node;
+}
+
+static void add_name(const char* name) {
+    uint32_t node = find_node(name, 1);
+    if (node != 0) nodes[node].refs++;
+}
+
+static void remove_name(const char* name) {
+    uint32_t node = find_node(name, 0);
+    if (node != 0 && nodes[node].refs > 0) nodes[node].refs--;
+}
+
+// Forget the names a directory contributed
+static void clear_dir(index_dir_t* d) {
+    for (int i = 0; i < d->name_count; i++) {
+        remove_name(d->names[i]);
+        free(d->names[i]);
+    }
+    free(d->names);
+    d->names = NULL;
+    d->name_count = 0;
+}
+
+// Read the executables in a directory into the trie
+static void scan_dir(index_dir_t* d) {
+    struct stat st;
+    d->exists = stat(d->dir, &st) == 0 && S_ISDIR(st.st_mode);
+    if (!d->exists) {
+        return;
+    }
+    d->mtime = st.st_mtim;
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+
+    DIR* dp = opendir(d->dir);
+    if (dp == NULL) {
+        return;
+    }
+    int cap = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dp)) != NULL) {
+        if (ent->d_name[0] == '.' || ent->d_type == DT_DIR) {
+            continue;
+        }
+        // Symlinks and unknown types need a stat to rule out directories
+        if (ent->d_type != DT_REG) {
+            if (fstatat(dirfd(dp), ent->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+        }
+        if (faccessat(dirfd(dp), ent->d_name, X_OK, 0) < 0) {
+            continue;
+        }
+
+        if (d->name_count == cap) {
+            cap = cap ? cap * 2 : 64;
+            char** grown = realloc(d->names, cap * sizeof(char*));
+            if (grown == NULL) {
+                perror("realloc failed");
+                break;
+            }
+            d->names = grown;
+        }
+        char* name = strdup(ent->d_name);
+        if (name == NULL) break;
+        d->names[d->name_count++] = name;
+        add_name(name);
+    }
+    closedir(dp);
+}
+
+// Drop the whole index (PATH changed)
+static void reset_index() {
+    for (int i = 0; i < dir_count; i++) {
+        clear_dir(&dirs[i]);
+        free(dirs[i].dir);
+    }
+    free(dirs);
+    dirs = NULL;
+    dir_count = 0;
+    free(nodes);
+    nodes = NULL;
+    node_count = node_cap = 0;
+    free(indexed_path);
+    indexed_path = NULL;
+}
+
+// Split PATH and scan every directory
+static void build_index(const char* path) {
+    indexed_path = strdup(path);
+    node_cap = 1024;
+    nodes = calloc(node_cap, sizeof(name_node_t));
+    if (indexed_path == NULL || nodes == NULL) {
+        perror("calloc failed");
+        reset_index();
+        return;
+    }
+    node_count = 1; // Root
+
+    int count = 1;
+    for (const char* p = path; *p; p++) {
+        if (*p == ':') count++;
+    }
+    dirs = calloc(count, sizeof(index_dir_t));
+    if (dirs == NULL) {
+        return;
+    }
+
+    const char* start = path;
+    while (1) {
+        const char* end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        index_dir_t* d = &dirs[dir_count++];
+        d->dir = len ? strndup(start, len) : strdup(".");
+        if (d->dir != NULL) {
+            scan_dir(d);
+        }
+        if (end == NULL) break;
+        start = end + 1;
+    }
+}
+
+// Make the index match the current PATH and directory contents
+void path_index_refresh() {
+    const char* path = get_variable("PATH");
+    if (path == NULL) {
+        path = "/usr/local/bin:/usr/bin:/bin";
+    }
+    if (indexed_path != NULL && strcmp(indexed_path, path) != 0) {
+        reset_index();
+    }
+    if (indexed_path == NULL) {
+        build_index(path);
+        return;
+    }
+
+    for (int i = 0; i < dir_count; i++) {
+        index_dir_t* d = &dirs[i];
+        if (d->dir == NULL) continue;
+
+        struct stat st;
+        int exists = stat(d->dir, &st) == 0 && S_ISDIR(st.st_mode);
+        if (exists == d->exists && (!exists ||
+            (st.st_mtim.tv_sec == d->mtime.tv_sec &&
+             st.st_mtim.tv_nsec == d->mtime.tv_nsec &&
+             st.st_dev == d->dev && st.st_ino == d->ino))) {
+            continue;
+        }
+        clear_dir(d);
+        scan_dir(d);
+    }
+}
+
+// Append the names below node (spelled so far in buf) to the list
+static void collect(uint32_t node, char* buf, size_t len, size_t cap,
+                    char*** list, int* count, int* list_cap) {
+    if (nodes[node].refs > 0) {
+        if (*count == *list_cap) {
+            *list_cap = *list_cap ? *list_cap * 2 : 64;
+            char** grown = realloc(*list, *list_cap * sizeof(char*));
+            if (grown == NULL) return;
+            *list = grown;
+        }
+        char* name = strndup(buf, len);
+        if (name != NULL) (*list)[(*count)++] = name;
+    }
+    if (len + 1 >= cap) {
+        return; // Longer than any file name can be
+    }
+    for (uint32_t c = nodes[node].first_child; c != 0; c = nodes[c].next_sibling) {
+        buf[len] = nodes[c].ch;
+        collect(c, buf, len + 1, cap, list, count, list_cap);
+    }
+}
+
+// Executables on $PATH starting with prefix, sorted and without
+// duplicates. Returns a malloc'd array of count malloc'd names.
+char** path_index_matches(const char* prefix, int* count) {
+    char** list = NULL;
+    int list_cap = 0;
+    *count = 0;
+
+    path_index_refresh();
+    if (nodes == NULL) {
+        return NULL;
+    }
+
+    size_t len = strlen(prefix);
+    if (len >= NAME_MAX) {
+        return NULL;
+    }
+    uint32_t node = len ? find_node(prefix, 0) : 0;
+    if (len && node == 0) {
+        return NULL;
+    }
+
+    char buf[NAME_MAX + 1];
+    memcpy(buf, prefix, len);
+    collect(node, buf, len, sizeof(buf), &list, count, &list_cap);
+    return list;
+}
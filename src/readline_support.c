@@ -1,53 +1,37 @@
 #include "shell.h"
 
-// Custom completion function for Readline
+// Custom completion function for Readline: builtins first, then every
+// executable on $PATH (readline sorts the combined list)
 char* command_generator(const char* text, int state) {
-    static int list_index, len;
+    static char** matches = NULL;
+    static int match_count, match_index, builtin_index;
+    static size_t len;
     const char* name;
-    
-    // List of built-in commands for completion
-    static const char* builtin_commands[] = {
-        "cd", "exit", "help", "history", "jobs", NULL
-    };
-    
-    // Common system commands for completion
-    static const char* common_commands[] = {
-        "ls", "pwd", "whoami", "echo", "cat", "grep", "mkdir", "rmdir",
-        "cp", "mv", "rm", "chmod", "ps", "kill", "find", "which", NULL
-    };
 
     if (!state) {
-        list_index = 0;
+        // Names not handed to readline last time are still ours
+        for (int i = match_index; i < match_count; i++) {
+            free(matches[i]);
+        }
+        free(matches);
+        matches = path_index_matches(text, &match_count);
+        match_index = 0;
+        builtin_index = 0;
         len = strlen(text);
     }
-    
-    // First, try to complete with built-in commands
-    while (builtin_commands[list_index] != NULL) {
-        name = builtin_commands[list_index];
-        list_index++;
+
+    while ((name = builtin_name(builtin_index)) != NULL) {
+        builtin_index++;
         if (strncmp(name, text, len) == 0) {
             return strdup(name);
         }
     }
-    
-    // Reset index for common commands
-    if (builtin_commands[list_index] == NULL) {
-        // Find where builtin_commands array ends
-        int i = 0;
-        while (builtin_commands[i] != NULL) i++;
-        list_index = i;
-    }
-    
-    // Then try common system commands
-    int common_start = list_index;
-    while (common_commands[list_index - common_start] != NULL) {
-        name = common_commands[list_index - common_start];
-        list_index++;
-        if (strncmp(name, text, len) == 0) {
-            return strdup(name);
-        }
+
+    // Readline takes ownership of each returned name
+    if (match_index < match_count) {
+        return matches[match_index++];
     }
-    
+
     // Finally, let Readline handle filename completion
     return NULL;
 }
@@ -73,15 +57,95 @@ char** custom_completion(const char* text, int start, int end) {
 
 // Readline-based command reader (replaces read_cmd)
 char* read_cmd_readline(const char* prompt) {
-    char* line = readline(prompt);
-    
-    if (line && *line) {
-        // Add non-empty lines to Readline's history
-        add_history(line);
+    // History lives in history.c; Readline keeps no copy of its own
+    return readline(prompt);
+}
+
+#ifdef USE_READLINE
+// Position while walking history with the arrow keys (0 = editing line)
+static int browse_pos = 0;
+static char* saved_line = NULL;
+
+// Show history entry n, or the line being edited for n past the end
+static void show_history_entry(int n) {
+    int count = history_count();
+    if (n > count) {
+        rl_replace_line(saved_line ? saved_line : "", 0);
+        browse_pos = 0;
+    } else {
+        size_t len;
+        const char* entry = history_entry(n, &len);
+        char* text = strndup(entry, len);
+        if (text == NULL) return;
+        rl_replace_line(text, 0);
+        free(text);
+        browse_pos = n;
     }
-    
-    return line;
+    rl_point = rl_end;
+}
+
+static int history_prev_key(int count, int key) {
+    (void)count;
+    (void)key;
+    int total = history_count();
+    if (total == 0 || browse_pos == 1) {
+        rl_ding();
+        return 0;
+    }
+    if (browse_pos == 0) {
+        free(saved_line);
+        saved_line = strdup(rl_line_buffer);
+        show_history_entry(total);
+    } else {
+        show_history_entry(browse_pos - 1);
+    }
+    return 0;
+}
+
+static int history_next_key(int count, int key) {
+    (void)count;
+    (void)key;
+    if (browse_pos == 0) {
+        rl_ding();
+        return 0;
+    }
+    show_history_entry(browse_pos + 1);
+    return 0;
+}
+
+// Ctrl-R: replace the line with the newest older command containing
+// the text typed so far; pressing it again goes further back
+static int history_search_key(int count, int key) {
+    static char* pattern = NULL;
+    (void)count;
+    (void)key;
+
+    if (rl_last_func != history_search_key || pattern == NULL) {
+        free(pattern);
+        pattern = strdup(rl_line_buffer);
+        if (pattern == NULL) return 0;
+        if (browse_pos == 0) {
+            free(saved_line);
+            saved_line = strdup(rl_line_buffer);
+        }
+    }
+
+    int before = browse_pos ? browse_pos : history_count() + 1;
+    int n = history_find(pattern, strlen(pattern), 1, before);
+    if (n == 0) {
+        rl_ding();
+        return 0;
+    }
+    show_history_entry(n);
+    return 0;
+}
+
+// Start each new line at the bottom of the history
+static int reset_history_browse() {
+    browse_pos = 0;
+    return 0;
 }
+#endif
 
 // Initialize Readline with our custom settings
 void initialize_readline() {
@@ -94,6 +158,18 @@ void initialize_readline() {
     // Tell Readline where to find completion matches
     rl_completion_query_items = 100;
     
+#ifdef USE_READLINE
+    // Walk history.c's store instead of Readline's own history list
+    rl_pre_input_hook = reset_history_browse;
+    rl_bind_keyseq("\\e[A", history_prev_key);
+    rl_bind_keyseq("\\eOA", history_prev_key);
+    rl_bind_keyseq("\\e[B", history_next_key);
+    rl_bind_keyseq("\\eOB", history_next_key);
+    rl_bind_key(CTRL('P'), history_prev_key);
+    rl_bind_key(CTRL('N'), history_next_key);
+    rl_bind_key(CTRL('R'), history_search_key);
+#endif
+
     // Note: rl_completion_ignore_case might not be available in all versions
     // We'll handle case sensitivity in our generator function instead
 }
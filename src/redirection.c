@@ -1,131 +1,378 @@
 #include "shell.h"
+#include <limits.h>
+#include <sys/mman.h>
 
-// Execute a single command with redirection
-int execute_redirection(command_t* cmd) {
-    if (cmd == NULL || cmd->args[0] == NULL) {
+// Redirections. The parser keeps them as a list on each node; before a
+// command runs the list is expanded, and here-documents are written to
+// anonymous memory files (memfd_create), so no temporary files are ever
+// made. External commands get their redirections as posix_spawn file
+// actions (see launcher.c) and forked stages apply them in the child;
+// the shell's own descriptors are only touched, and restored afterwards,
+// for built-ins, functions and compound commands that run in-process.
+
+// open() flags for a file redirection
+int redirection_flags(redir_type_t type) {
+    switch (type) {
+        case REDIR_INPUT:      return O_RDONLY;
+        case REDIR_OUTPUT:     return O_WRONLY | O_CREAT | O_TRUNC;
+        case REDIR_APPEND:     return O_WRONLY | O_CREAT | O_APPEND;
+        case REDIR_READ_WRITE: return O_RDWR | O_CREAT;
+        default:               return -1;
+    }
+}
+
+// Put text in an anonymous memory file and rewind it, ready to be read
+// as a here-document. Falls back to an unnamed O_TMPFILE where memfd is
+// not available. Returns the descriptor, or -1 after reporting an error.
+static int open_heredoc(const char* text, size_t len) {
+    int fd = memfd_create("heredoc", MFD_CLOEXEC);
+    if (fd < 0) {
+        fd = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    }
+    if (fd < 0) {
+        perror("here-document");
         return -1;
     }
 
-    // Handle built-in commands separately (they don't fork)
-    if (handle_builtin(cmd->args)) {
-        return 0;
+    while (len > 0) {
+        ssize_t n = write(fd, text, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("here-document");
+            close(fd);
+            return -1;
+        }
+        text += n;
+        len -= n;
     }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// Whether an expanded redirection owns its source descriptor
+static int owns_source(const redir_t* redir) {
+    return redir->type == REDIR_HEREDOC || redir->type == REDIR_HERESTRING;
+}
 
-    // Handle background execution
-    if (cmd->background) {
-        return execute_background(cmd);
+// Close the here-document files of expanded redirections
+void close_redirections(redir_t* redirs) {
+    for (redir_t* r = redirs; r != NULL; r = r->next) {
+        if (owns_source(r) && r->source_fd >= 0) {
+            close(r->source_fd);
+            r->source_fd = -1;
+        }
     }
+}
 
-    int stdin_backup = -1;
-    int stdout_backup = -1;
-    int input_fd = -1;
-    int output_fd = -1;
+// Expand the targets of raw redirections from the syntax tree into a
+// new list in arena. Here-documents and here-strings are opened here.
+// Returns -1 (after reporting it, and with nothing left open) on error.
+int expand_redirections(const redir_t* redirs, redir_t** out, arena_t* arena) {
+    *out = NULL;
+    redir_t** tail = out;
 
-    // Handle input redirection
-    if (cmd->input_file != NULL) {
-        stdin_backup = dup(STDIN_FILENO); // Backup original stdin
-        input_fd = open(cmd->input_file, O_RDONLY);
-        if (input_fd < 0) {
-            perror("open input file");
-            if (stdin_backup >= 0) close(stdin_backup);
+    for (const redir_t* raw = redirs; raw != NULL; raw = raw->next) {
+        redir_t* r = arena_alloc(arena, sizeof(redir_t));
+        if (r == NULL) {
+            close_redirections(*out);
             return -1;
         }
-        if (dup2(input_fd, STDIN_FILENO) < 0) {
-            perror("dup2 input");
-            close(input_fd);
-            if (stdin_backup >= 0) close(stdin_backup);
+        *r = *raw;
+        r->next = NULL;
+        r->source_fd = -1;
+        *tail = r;
+        tail = &r->next;
+
+        if (raw->type == REDIR_HEREDOC) {
+            r->target = raw->quoted ? raw->target : expand_heredoc(raw->target, arena);
+        } else {
+            r->target = expand_word_string(raw->target, arena);
+        }
+        if (r->target == NULL) {
+            close_redirections(*out);
             return -1;
         }
-        close(input_fd);
-    }
 
-    // Handle output redirection
-    if (cmd->output_file != NULL) {
-        stdout_backup = dup(STDOUT_FILENO); // Backup original stdout
-        output_fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (output_fd < 0) {
-            perror("open output file");
-            if (stdout_backup >= 0) close(stdout_backup);
-            if (stdin_backup >= 0) {
-                dup2(stdin_backup, STDIN_FILENO);
-                close(stdin_backup);
+        if (r->type == REDIR_HERESTRING) {
+            // The word becomes one line of input
+            size_t len = strlen(r->target);
+            char* line = arena_alloc(arena, len + 2);
+            if (line == NULL) {
+                close_redirections(*out);
+                return -1;
             }
+            memcpy(line, r->target, len);
+            memcpy(line + len, "\n", 2);
+            r->target = line;
+        }
+        if (owns_source(r)) {
+            r->source_fd = open_heredoc(r->target, strlen(r->target));
+            if (r->source_fd < 0) {
+                close_redirections(*out);
+                return -1;
+            }
+        } else if (r->type == REDIR_DUP && strcmp(r->target, "-") != 0) {
+            char* end;
+            long fd = strtol(r->target, &end, 10);
+            if (r->target[0] == '\0' || *end != '\0' || fd < 0 || fd > INT_MAX) {
+                fprintf(stderr, "%s: ambiguous redirect\n", r->target);
+                close_redirections(*out);
+                return -1;
+            }
+            r->source_fd = (int)fd;
+        }
+    }
+    return 0;
+}
+
+// Apply one expanded redirection to the current process
+static int apply_redirection(const redir_t* r) {
+    if (r->type == REDIR_DUP || owns_source(r)) {
+        if (r->source_fd < 0) {
+            close(r->fd);
+        } else if (r->source_fd != r->fd && dup2(r->source_fd, r->fd) < 0) {
+            fprintf(stderr, "%s: %s\n", r->target, strerror(errno));
             return -1;
         }
-        if (dup2(output_fd, STDOUT_FILENO) < 0) {
-            perror("dup2 output");
-            close(output_fd);
-            if (stdout_backup >= 0) close(stdout_backup);
-            if (stdin_backup >= 0) {
-                dup2(stdin_backup, STDIN_FILENO);
-                close(stdin_backup);
+        return 0;
+    }
+
+    int fd = open(r->target, redirection_flags(r->type), 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", r->target, strerror(errno));
+        return -1;
+    }
+    if (fd != r->fd) {
+        dup2(fd, r->fd);
+        close(fd);
+    }
+    return 0;
+}
+
+// Apply expanded redirections in order (in a forked child)
+int apply_redirections(const redir_t* redirs) {
+    for (const redir_t* r = redirs; r != NULL; r = r->next) {
+        if (apply_redirection(r) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Undo redirect_in_process(), newest change first
+void restore_redirections(saved_fd_t* saved) {
+    fflush(stdout);
+    for (saved_fd_t* s = saved; s != NULL; s = s->next) {
+        if (s->copy >= 0) {
+            dup2(s->copy, s->fd);
+            close(s->copy);
+        } else {
+            close(s->fd);
+        }
+    }
+}
+
+// Apply redirections for a built-in, function or compound command that
+// runs in the shell itself. Each descriptor is saved (once) in a list
+// from arena for restore_redirections(). Returns -1 (after reporting it,
+// and with everything restored) if a redirection failed.
+int redirect_in_process(const redir_t* redirs, saved_fd_t** saved, arena_t* arena) {
+    *saved = NULL;
+    fflush(stdout);
+
+    for (const redir_t* r = redirs; r != NULL; r = r->next) {
+        saved_fd_t* s = *saved;
+        while (s != NULL && s->fd != r->fd) s = s->next;
+        if (s == NULL) {
+            s = arena_alloc(arena, sizeof(saved_fd_t));
+            if (s == NULL) {
+                restore_redirections(*saved);
+                return -1;
             }
+            s->fd = r->fd;
+            s->copy = fcntl(r->fd, F_DUPFD_CLOEXEC, 10);
+            s->next = *saved;
+            *saved = s;
+        }
+        if (apply_redirection(r) < 0) {
+            restore_redirections(*saved);
             return -1;
         }
-        close(output_fd);
     }
+    return 0;
+}
+
+// Find and report the file redirection that made a spawn fail. The file
+// actions already ran in the child, so reopening (without truncating)
+// changes nothing. Returns 1 if one was reported.
+int report_redirection_error(const redir_t* redirs) {
+    for (const redir_t* r = redirs; r != NULL; r = r->next) {
+        int flags = redirection_flags(r->type);
+        if (flags < 0) {
+            continue;
+        }
+        int fd = open(r->target, (flags & ~O_TRUNC) | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", r->target, strerror(errno));
+            return 1;
+        }
+        close(fd);
+    }
+    return 0;
+}
 
-    // Execute the command
-    int status;
+// Start one command with in_fd / out_fd (-1 to inherit) as its stdin /
+// stdout, in process group pgid (0 = new group, -1 = the shell's).
+// other_fd is a pipe end the command must not hold (the read end of its
+// own output pipe), or -1. External commands are spawned by the launcher;
+// built-ins, functions and compound commands need the shell's own code,
+// so those fork. Returns the child's pid, or a negative value as
+// launch_command() does if it could not be started.
+pid_t start_process(command_t* cmd, int in_fd, int out_fd, int other_fd, pid_t pgid) {
+    function_t* fn = cmd->body == NULL ? find_function(cmd->args[0]) : NULL;
+    if (cmd->body == NULL && fn == NULL && !is_builtin_command(cmd->args)) {
+        return launch_command(cmd, in_fd, out_fd, pgid);
+    }
+
+    fflush(stdout);
     pid_t pid = fork();
-    
-    if (pid == 0) {
-        // Child process
-        execvp(cmd->args[0], cmd->args);
-        perror("execvp");
-        exit(1);
-    } else if (pid > 0) {
-        // Parent process
-        waitpid(pid, &status, 0);
-        
-        // Restore original file descriptors
-        if (stdin_backup >= 0) {
-            dup2(stdin_backup, STDIN_FILENO);
-            close(stdin_backup);
-        }
-        if (stdout_backup >= 0) {
-            dup2(stdout_backup, STDOUT_FILENO);
-            close(stdout_backup);
-        }
-        
-        return WEXITSTATUS(status);
-    } else {
+    if (pid < 0) {
         perror("fork");
         return -1;
     }
+    if (pid > 0) {
+        return pid;
+    }
+
+    if (pgid >= 0) {
+        setpgid(0, pgid);
+    }
+    if (job_control_enabled()) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+
+    if (in_fd >= 0) {
+        dup2(in_fd, STDIN_FILENO);
+    }
+    if (out_fd >= 0) {
+        dup2(out_fd, STDOUT_FILENO);
+    }
+
+    // This child never execs, so O_CLOEXEC does not close the pipe ends.
+    // Holding the read end of its own output pipe would keep the writer
+    // from ever getting SIGPIPE.
+    if (in_fd > STDERR_FILENO) close(in_fd);
+    if (out_fd > STDERR_FILENO) close(out_fd);
+    if (other_fd > STDERR_FILENO) close(other_fd);
+
+    // Explicit redirections take precedence over the pipe
+    if (apply_redirections(cmd->redirs) < 0) {
+        _exit(1);
+    }
+
+    int status = 0;
+    if (cmd->body != NULL) {
+        enter_subshell();
+        status = execute_compound(cmd->body);
+    } else {
+        for (int j = 0; cmd->assigns && cmd->assigns[j]; j++) {
+            putenv(cmd->assigns[j]);
+        }
+        if (fn != NULL) {
+            enter_subshell();
+            status = call_function(fn, cmd->argc, cmd->args);
+        } else {
+            status = handle_builtin(cmd->args);
+        }
+    }
+    fflush(stdout);
+    _exit(status);
 }
 
-// Execute a pipeline of commands (now handles sequential execution)
-int execute_pipeline(pipeline_t* pipeline) {
-    if (pipeline == NULL || pipeline->num_commands == 0) {
+// Run one command or a group of commands connected with pipes as a job.
+// Every stage is started up front (in one process group when job control
+// is on) so data streams between them, then all stages are waited for
+// together, or the job is left running in the background. Returns the
+// status of the rightmost failing stage (pipefail), or 0 if every stage
+// succeeded.
+int execute_piped_commands(command_t* cmds, int count) {
+    if (cmds == NULL || count <= 0) {
         return -1;
     }
 
-    // Execute commands sequentially (for semicolon-separated commands)
-    int result = 0;
-    for (int i = 0; i < pipeline->num_commands; i++) {
-        result = execute_single_command(&pipeline->commands[i]);
-        // Continue with next command even if one fails (like bash)
+    for (int i = 0; i < count; i++) {
+        if (cmds[i].body == NULL && cmds[i].args[0] == NULL) {
+            fprintf(stderr, "Syntax error: empty command in pipeline\n");
+            return -1;
+        }
     }
-    return result;
-}
 
-// Execute a single command (with or without redirection/background)
-int execute_single_command(command_t* cmd) {
-    if (cmd == NULL || cmd->args[0] == NULL) {
+    job_t* job = create_job(command_to_string(cmds, count), count);
+    if (job == NULL) {
+        fprintf(stderr, "Error: cannot track job\n");
         return -1;
     }
 
-    // Check if there's any redirection or background
-    if (cmd->input_file != NULL || cmd->output_file != NULL || cmd->background) {
-        return execute_redirection(cmd);
+    int job_control = job_control_enabled();
+    int prev_read = -1;
+    int started = 0;
+    int failed_status = 0;  // Of the rightmost stage that could not start
+
+    for (int i = 0; i < count; i++) {
+        int fds[2] = {-1, -1};
+
+        // O_CLOEXEC keeps unrelated pipe ends from leaking into other stages
+        if (i < count - 1 && pipe2(fds, O_CLOEXEC) < 0) {
+            perror("pipe");
+            failed_status = 1;
+            break;
+        }
+
+        // A stage that cannot start (not found, not executable, failed
+        // redirection) does not stop the others: its neighbours just see
+        // EOF or a closed pipe
+        pid_t pid = start_process(&cmds[i], prev_read, fds[1], fds[0],
+                                  job_control ? job->pgid : -1);
+        if (pid < 0) {
+            failed_status = pid == LAUNCH_REDIRECT_FAILED ? 1 : errno == ENOENT ? 127 : 126;
+            job_add_failed(job, failed_status);
+        } else {
+            // Parent process: also set the group here to avoid racing the child
+            job_add_process(job, pid);
+            if (job_control) {
+                setpgid(pid, job->pgid);
+            }
+            started++;
+        }
+
+        if (prev_read >= 0) close(prev_read);
+        if (fds[1] >= 0) close(fds[1]);
+        prev_read = fds[0];
+    }
+
+    if (prev_read >= 0) {
+        close(prev_read);
+    }
+
+    if (started == 0) {
+        remove_job(job);
+        return failed_status;
     }
+    int complete = job->num_procs == count;
 
-    // No redirection/background, use original execute function for built-in check
-    if (handle_builtin(cmd->args)) {
+    // Background job: announce it and return to the prompt
+    if (cmds[count - 1].background && complete) {
+        background_job(job);
         return 0;
     }
 
-    // Execute external command without redirection
-    return execute(cmd->args) == 0 ? 0 : -1;
+    int result = wait_for_job(job);
+    if (!complete && result == 0) {
+        result = failed_status;
+    }
+    return result;
 }
@@ -0,0 +1,396 @@
+#include "shell.h"
+#include <sys/mman.h>
+
+#define SCRIPT_BUFFER_SIZE (256 * 1024)  // Read size for streamed input
+#define STDIN_READ_SIZE 4096             // Read size for a script on stdin
+
+// Reusable copy of the current command, so running a script does not
+// allocate per line. A command that spans several lines (an open quote
+// or compound command) is collected here until it is complete.
+static char* line_buf = NULL;
+static size_t line_cap = 0;
+static size_t line_len = 0;
+
+// Cheap scan of a command collected over several lines. Re-parsing the
+// whole collection after every line makes long loop and function bodies
+// quadratic, so lines are only handed to the parser once the collected
+// text can be complete: no quote, compound command, ( or continuation
+// left open. The scan only counts; the parser still decides. If the
+// count says complete and the parser disagrees, the count is not trusted
+// for the rest of the command; the parse is also forced after a doubling
+// number of lines, so a miscount in either direction keeps the total
+// work linear.
+typedef struct {
+    int depth;               // Open if / while / until / for / {
+    int parens;              // Unclosed ( outside quotes ($(, ((, f())
+    char quote;              // Quote left open at the end of the line
+    int command_pos;         // The next word starts a command
+    int continued;           // Line ended with |, &&, || or a backslash
+    int escaped_newline;     // Line ended with a backslash
+    int heredoc;             // A here-document is involved: parse every line
+    int distrust;            // The count was wrong once: only forced parses
+    int forced;              // The current parse was forced
+    size_t waiting;          // Lines added since the last parse
+    size_t force_at;         // Parse anyway once this many lines wait
+} block_state_t;
+
+#define FORCE_PARSE_LINES 64
+
+static block_state_t block = { .command_pos = 1, .force_at = FORCE_PARSE_LINES };
+
+static void reset_block() {
+    memset(&block, 0, sizeof(block));
+    block.command_pos = 1;
+    block.force_at = FORCE_PARSE_LINES;
+}
+
+// Count what one word opens or closes (a reserved word only counts at
+// the start of a command)
+static void scan_word(const char* word, size_t len, int quoted) {
+    if (!block.command_pos || quoted) {
+        block.command_pos = 0;
+        return;
+    }
+#define IS(w) (len == sizeof(w) - 1 && memcmp(word, w, len) == 0)
+    if (IS("if") || IS("while") || IS("until") || IS("{")) {
+        block.depth++;
+    } else if (IS("for")) {
+        block.depth++;
+        block.command_pos = 0;
+    } else if (IS("fi") || IS("done") || IS("}")) {
+        block.depth--;
+        block.command_pos = 0;
+    } else if (!(IS("then") || IS("do") || IS("else") || IS("elif") || IS("!") ||
+                 memchr(word, '=', len) != NULL)) {
+        block.command_pos = 0;  // An ordinary command name (assignments keep the position)
+    }
+#undef IS
+}
+
+// Scan one line into the block state
+static void scan_line(const char* line, size_t len) {
+    const char* p = line;
+    const char* end = line + len;
+    int after_operator = 0;  // Last token was | && or ||
+    if (!block.escaped_newline) {
+        block.command_pos = 1;  // A newline ends a command
+    }
+    block.continued = 0;
+    block.escaped_newline = 0;
+
+    while (p < end) {
+        if (block.quote != 0) {
+            if (*p == '\\' && block.quote != '\'') {
+                p += 2;
+                continue;
+            }
+            if (*p == block.quote) block.quote = 0;
+            p++;
+            continue;
+        }
+
+        char c = *p;
+        if (c == ' ' || c == '\t') {
+            p++;
+        } else if (c == '#') {
+            break;  // Comment to the end of the line
+        } else if (c == ';' || c == '&' || c == '|') {
+            after_operator = c == '|' || (c == '&' && p + 1 < end && p[1] == '&');
+            p += (p + 1 < end && p[1] == c) ? 2 : 1;
+            block.command_pos = 1;
+        } else if (c == '(' || c == ')') {
+            block.parens += c == '(' ? 1 : -1;
+            block.command_pos = 1;
+            after_operator = 0;
+            p++;
+        } else if (c == '<' || c == '>') {
+            if (c == '<' && p + 2 < end && p[1] == '<' && p[2] != '<') {
+                block.heredoc = 1;
+            }
+            while (p < end && (*p == '<' || *p == '>' || *p == '&' || *p == '-')) p++;
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            while (p < end && strchr(" \t;&|()<>", *p) == NULL) p++;  // The target
+            after_operator = 0;
+        } else {
+            // A word, possibly opening a quote that runs past the line
+            const char* start = p;
+            int quoted = 0, substitution = 0;
+            while (p < end && strchr(" \t;&|()<>", *p) == NULL) {
+                if (*p == '\\') {
+                    quoted = 1;
+                    if (p + 1 == end) block.continued = block.escaped_newline = 1;
+                    p += 2;
+                } else if (*p == '\'' || *p == '"' || *p == '`') {
+                    quoted = 1;
+                    char q = *p++;
+                    while (p < end && *p != q) {
+                        p += (*p == '\\' && q != '\'') ? 2 : 1;
+                    }
+                    if (p >= end) {
+                        block.quote = q;
+                        return;
+                    }
+                    p++;
+                } else if (*p == '$' && p + 1 < end && p[1] == '(') {
+                    substitution = 1;  // The ( is counted like any other
+                    p++;
+                    break;
+                } else {
+                    p++;
+                }
+            }
+            if (p > end) p = end;
+            if (!substitution) {
+                scan_word(start, p - start, quoted);
+            }
+            after_operator = 0;
+        }
+    }
+    if (after_operator) {
+        block.continued = 1;
+    }
+}
+
+// Whether the collected lines should be handed to the parser now
+static int block_may_be_complete() {
+    if (block.heredoc) {
+        return 1;
+    }
+    block.forced = ++block.waiting >= block.force_at;
+    if (block.forced) {
+        block.force_at *= 2;
+        return 1;
+    }
+    return !block.distrust && block.quote == 0 && block.depth <= 0 && block.parens <= 0 &&
+           !block.continued;
+}
+
+// Run a single script line (comments and the #! line are skipped)
+static int run_line(const char* start, size_t len, int* status) {
+    if (len > 0 && start[len - 1] == '\r') {
+        len--;
+    }
+
+    const char* p = start;
+    while (p < start + len && (*p == ' ' || *p == '\t')) p++;
+    if (line_len == 0 && (p == start + len || *p == '#')) {
+        return 0;
+    }
+
+    size_t needed = line_len + len + 2;
+    if (needed > line_cap) {
+        size_t cap = line_cap ? line_cap : 256;
+        while (cap < needed) cap *= 2;
+        char* grown = realloc(line_buf, cap);
+        if (grown == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        line_buf = grown;
+        line_cap = cap;
+    }
+    if (line_len > 0) {
+        line_buf[line_len++] = '\n';
+    }
+    memcpy(line_buf + line_len, start, len);
+    line_len += len;
+    line_buf[line_len] = '\0';
+
+    scan_line(start, len);
+    if (!block_may_be_complete()) {
+        return 0;
+    }
+
+    // Reap finished background jobs (free unless a child changed state)
+    update_jobs();
+    if (execute_input(line_buf, status) != PARSE_INCOMPLETE) {
+        line_len = 0;
+        reset_block();
+    } else if (!block.heredoc && !block.forced) {
+        block.distrust = 1;  // The count said complete, the parser did not
+    }
+    return 0;
+}
+
+// End of input: a command still left open is a syntax error
+static void finish_input(int* status) {
+    if (line_len > 0 && execute_input(line_buf, status) == PARSE_INCOMPLETE) {
+        fprintf(stderr, "Syntax error: unexpected end of file\n");
+        *status = 2;
+    }
+    line_len = 0;
+    reset_block();
+}
+
+// Run every complete line in a buffer. Returns the number of bytes
+// consumed; a trailing partial line is left unless at_eof is set.
+static size_t run_buffer(const char* data, size_t len, int at_eof, int* status) {
+    size_t pos = 0;
+    while (pos < len) {
+        const char* nl = memchr(data + pos, '\n', len - pos);
+        if (nl == NULL && !at_eof) {
+            break;
+        }
+        size_t line_len = nl ? (size_t)(nl - (data + pos)) : len - pos;
+        if (run_line(data + pos, line_len, status) < 0) {
+            return len;
+        }
+        pos += line_len + (nl ? 1 : 0);
+    }
+    return pos;
+}
+
+// Run commands given with -c
+int run_command_string(const char* commands) {
+    int status = 0;
+    if (commands != NULL) {
+        run_buffer(commands, strlen(commands), 1, &status);
+        finish_input(&status);
+    }
+    return status;
+}
+
+// Read one line of a script on stdin into *buf without consuming input
+// past it, so commands of the script that read stdin get the rest. A
+// seekable input is read in blocks and the offset put back after the
+// line; a pipe is read a byte at a time, as other shells do. Returns the
+// line's length including its newline, 0 at the end, or -1 on error.
+static ssize_t read_stdin_line(char** buf, size_t* cap, int seekable) {
+    size_t len = 0;
+    while (1) {
+        if (*cap - len < STDIN_READ_SIZE) {
+            size_t new_cap = *cap ? *cap * 2 : STDIN_READ_SIZE * 2;
+            char* grown = realloc(*buf, new_cap);
+            if (grown == NULL) {
+                perror("realloc");
+                return -1;
+            }
+            *buf = grown;
+            *cap = new_cap;
+        }
+
+        ssize_t n = read(STDIN_FILENO, *buf + len, seekable ? STDIN_READ_SIZE : 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            return -1;
+        }
+        if (n == 0) {
+            return len;
+        }
+        char* nl = memchr(*buf + len, '\n', n);
+        if (nl != NULL) {
+            size_t end = nl - *buf + 1;
+            if (len + n > end) {
+                lseek(STDIN_FILENO, (off_t)end - (off_t)(len + n), SEEK_CUR);
+            }
+            return end;
+        }
+        len += n;
+    }
+}
+
+// Run a script read from stdin one line at a time
+static int run_script_stdin() {
+    int seekable = lseek(STDIN_FILENO, 0, SEEK_CUR) >= 0;
+    char* buf = NULL;
+    size_t cap = 0;
+    int status = 0;
+    ssize_t n;
+    while ((n = read_stdin_line(&buf, &cap, seekable)) > 0) {
+        run_buffer(buf, n, 1, &status);
+    }
+    free(buf);
+    finish_input(&status);
+    return status;
+}
+
+// Run a script from a descriptor that cannot be mapped (pipe, tty,
+// socket), reading it in large blocks. Stdin is shared with the script's
+// commands, so it is never read ahead.
+int run_script_fd(int fd) {
+    if (fd == STDIN_FILENO) {
+        return run_script_stdin();
+    }
+
+    size_t cap = SCRIPT_BUFFER_SIZE;
+    size_t used = 0;
+    int status = 0;
+    char* buf = malloc(cap);
+    if (buf == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    while (1) {
+        // A single line longer than the buffer grows it
+        if (used == cap) {
+            char* grown = realloc(buf, cap * 2);
+            if (grown == NULL) {
+                perror("realloc");
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+
+        ssize_t n = read(fd, buf + used, cap - used);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            break;
+        }
+        used += n;
+
+        size_t consumed = run_buffer(buf, used, n == 0, &status);
+        memmove(buf, buf + consumed, used - consumed);
+        used -= consumed;
+
+        if (n == 0) break;
+    }
+
+    free(buf);
+    finish_input(&status);
+    return status;
+}
+
+// Run a script file. Regular files are mapped and scanned in place.
+int run_script_file(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 127;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(fd);
+        return 126;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "%s: Is a directory\n", path);
+        close(fd);
+        return 126;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        int status = run_script_fd(fd);
+        close(fd);
+        return status;
+    }
+
+    char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    int status = 0;
+    run_buffer(data, st.st_size, 1, &status);
+    finish_input(&status);
+
+    munmap(data, st.st_size);
+    return status;
+}
@@ -2,11 +2,24 @@
 
 char* read_cmd(char* prompt, FILE* fp) {
     printf("%s", prompt);
-    char* cmdline = (char*) malloc(sizeof(char) * MAX_LEN);
+    size_t cap = 256;
+    char* cmdline = (char*) malloc(cap);
     int c, pos = 0;
 
+    if (cmdline == NULL) return NULL;
+
     while ((c = getc(fp)) != EOF) {
         if (c == '\n') break;
+        // Grow the buffer for long lines
+        if ((size_t)pos + 1 >= cap) {
+            char* grown = realloc(cmdline, cap * 2);
+            if (grown == NULL) {
+                free(cmdline);
+                return NULL;
+            }
+            cmdline = grown;
+            cap *= 2;
+        }
         cmdline[pos++] = c;
     }
 
@@ -19,44 +32,154 @@ char* read_cmd(char* prompt, FILE* fp) {
     return cmdline;
 }
 
-char** tokenize(char* cmdline) {
-    // Edge case: empty command line
-    if (cmdline == NULL || cmdline[0] == '\0' || cmdline[0] == '\n') {
-        return NULL;
+// Run a tree parse_input() returned, or record the failed parse in $?.
+// A blank or comment-only input runs nothing and leaves $? as it was.
+static void run_parsed(ast_t* tree, int parsed, int* status) {
+    if (parsed == PARSE_OK) {
+        if (tree->root == NULL) {
+            *status = get_last_status();
+            return;
+        }
+        *status = execute_node(tree->root);
+        if (*status < 0) *status = 1;
+    } else if (parsed == PARSE_ERROR) {
+        *status = 2;
+        set_last_status(*status);
+    }
+}
+
+// Parse text and run it. Returns PARSE_INCOMPLETE (running nothing) if
+// the text stops inside a quote or compound command, otherwise PARSE_OK
+// or PARSE_ERROR with the exit status stored in status.
+int execute_input(const char* text, int* status) {
+    // Reused across inputs so the parse arena recycles its chunks
+    static ast_t ast;
+    static int depth = 0;
+
+    // A nested call (e.g. from a builtin) must not reset the outer tree
+    ast_t nested = {0};
+    ast_t* tree = depth == 0 ? &ast : &nested;
+
+    int parsed = parse_input(text, tree);
+    depth++;
+    run_parsed(tree, parsed, status);
+    depth--;
+
+    if (tree == &ast) {
+        free_ast(tree);
+        glob_cache_reset();  // Directory listings last one command line
+    } else {
+        release_ast(tree);
+    }
+    return parsed;
+}
+
+// Append a continuation line to the history form of a command. Lines
+// are joined with "; " unless the text so far ends where a command is
+// still expected.
+static char* join_history_line(char* joined, const char* line) {
+    size_t len = strlen(joined);
+    while (len > 0 && (joined[len - 1] == ' ' || joined[len - 1] == '\t')) len--;
+
+    // Words after which the next line continues the same command
+    static const char* openers[] = { "then", "else", "do", "{", NULL };
+    const char* separator = len == 0 ? "" : "; ";
+    if (len > 0 && strchr("|;&", joined[len - 1]) != NULL) {
+        separator = " ";
+    }
+    for (int i = 0; openers[i] != NULL; i++) {
+        size_t n = strlen(openers[i]);
+        if (len >= n && strncmp(joined + len - n, openers[i], n) == 0 &&
+            (len == n || joined[len - n - 1] == ' ' || joined[len - n - 1] == ';')) {
+            separator = " ";
+            break;
+        }
     }
 
-    char** arglist = (char**)malloc(sizeof(char*) * (MAXARGS + 1));
-    for (int i = 0; i < MAXARGS + 1; i++) {
-        arglist[i] = (char*)malloc(sizeof(char) * ARGLEN);
-        bzero(arglist[i], ARGLEN);
+    char* result = malloc(len + strlen(separator) + strlen(line) + 1);
+    if (result != NULL) {
+        sprintf(result, "%.*s%s%s", (int)len, joined, separator, line);
     }
+    free(joined);
+    return result;
+}
 
-    char* cp = cmdline;
-    char* start;
-    int len;
-    int argnum = 0;
+// Run one interactive command line. History expansion is applied first
+// and the line is recorded in the history. If the line leaves a quote or
+// compound command open, more lines are read with the continuation
+// prompt. Returns the exit status of the last command.
+int process_command_line(const char* line, int interactive) {
+    const char* cmdline = line;
+    int status = 0;
 
-    while (*cp != '\0' && argnum < MAXARGS) {
-        while (*cp == ' ' || *cp == '\t') cp++; // Skip leading whitespace
-        
-        if (*cp == '\0') break; // Line was only whitespace
+    // Handle history expansion before adding to our internal history
+    if (interactive && is_history_command(cmdline)) {
+        char* expanded_cmd = expand_history_command(cmdline);
+        if (expanded_cmd == NULL) {
+            return 1;  // History expansion failed
+        }
+        cmdline = expanded_cmd;
+        printf("%s\n", cmdline);  // Show the expanded command
+    }
+
+    if (!interactive) {
+        execute_input(cmdline, &status);
+        return status;
+    }
 
-        start = cp;
-        len = 1;
-        while (*++cp != '\0' && !(*cp == ' ' || *cp == '\t')) {
-            len++;
+    // Reused across lines so the parse arena recycles its chunks
+    static ast_t ast;
+    char* text = strdup(cmdline);
+    char* history_text = strdup(cmdline);
+    if (text == NULL || history_text == NULL) {
+        free(text);
+        free(history_text);
+        return 1;
+    }
+
+    int parsed;
+    while ((parsed = parse_input(text, &ast)) == PARSE_INCOMPLETE) {
+        char* more = read_cmd_readline(CONTINUATION_PROMPT);
+        if (more == NULL) {
+            fprintf(stderr, "Syntax error: unexpected end of file\n");
+            parsed = PARSE_ERROR;
+            break;
+        }
+        size_t len = strlen(text);
+        char* grown = realloc(text, len + strlen(more) + 2);
+        if (grown == NULL) {
+            free(more);
+            status = 1;
+            break;
+        }
+        text = grown;
+        sprintf(text + len, "\n%s", more);
+        history_text = join_history_line(history_text, more);
+        free(more);
+        if (history_text == NULL) {
+            status = 1;
+            break;
         }
-        strncpy(arglist[argnum], start, len);
-        arglist[argnum][len] = '\0';
-        argnum++;
     }
 
-    if (argnum == 0) { // No arguments were parsed
-        for(int i = 0; i < MAXARGS + 1; i++) free(arglist[i]);
-        free(arglist);
-        return NULL;
+    // Add non-empty commands to our internal history (after expansion)
+    if (history_text != NULL && history_text[0] != '\0') {
+        add_to_history(history_text);
     }
+    free(history_text);
+    free(text);
 
-    arglist[argnum] = NULL;
-    return arglist;
+    if (parsed != PARSE_INCOMPLETE) {
+        catch_interrupts(1);
+        run_parsed(&ast, parsed, &status);
+        if (interrupt_pending()) {
+            status = 128 + SIGINT;
+            set_last_status(status);
+            printf("\n");
+        }
+        catch_interrupts(0);
+    }
+    free_ast(&ast);
+    glob_cache_reset();  // Directory listings last one command line
+    return status;
 }
@@ -0,0 +1,285 @@
+#include "shell.h"
+#include <sys/mman.h>
+
+// Command substitution: $(...) and `...`. The command text is parsed into
+// a tree kept per nesting level (so repeated substitutions do not call
+// malloc) and its output replaces the substitution, minus trailing
+// newlines.
+//
+// Where it cannot change the shell's state, the command runs without
+// forking the shell: stdout is pointed at an in-memory file while the
+// tree walker runs it, so output-only built-ins run in the shell itself
+// and external commands are spawned straight into the capture file.
+// Everything else (functions, cd, exit, assignments, lists, compound
+// commands) runs in a forked subshell whose output is read from a pipe.
+
+#define CAPTURE_CHUNK (64 * 1024)
+
+// Built-ins that only produce output, and so may run in-process
+static const char* pure_builtins[] = {
+    "echo", "printf", "pwd", "test", "[", "true", "false", ":",
+    "help", "set", "jobs", "history", NULL
+};
+
+// Parsed command and capture file of one nesting level
+typedef struct {
+    ast_t ast;
+    int capture_fd;          // memfd, or -1 until first needed
+} substitution_level_t;
+
+static substitution_level_t** levels = NULL;
+static int level_depth = 0;
+static int level_count = 0;
+
+// Substitutions run so far
+static unsigned long substitution_count = 0;
+
+static substitution_level_t* push_level() {
+    if (level_depth == level_count) {
+        substitution_level_t** grown =
+            realloc(levels, (level_count + 1) * sizeof(substitution_level_t*));
+        if (grown == NULL) {
+            perror("realloc failed");
+            return NULL;
+        }
+        levels = grown;
+        levels[level_count] = calloc(1, sizeof(substitution_level_t));
+        if (levels[level_count] == NULL) {
+            perror("calloc failed");
+            return NULL;
+        }
+        levels[level_count]->capture_fd = -1;
+        level_count++;
+    }
+    return levels[level_depth++];
+}
+
+static void pop_level() {
+    free_ast(&levels[--level_depth]->ast);
+}
+
+// Whether expanding a raw word could assign a variable (${x:=v},
+// $((i++))) or exit the shell (${x:?msg})
+static int word_may_change_state(const char* word) {
+    return strstr(word, "((") != NULL ||
+           (strstr(word, "${") != NULL && strpbrk(word, "=?") != NULL);
+}
+
+// Whether a simple command can run in the shell process: no assignments,
+// and a literal name that is an external command or a built-in that only
+// produces output. Functions can assign, cd or exit, so they fork.
+static int command_in_process(node_t* node) {
+    if (node->cmd.num_assigns > 0 || node->cmd.num_words == 0) {
+        return 0;
+    }
+    for (int i = 0; i < node->cmd.num_words; i++) {
+        if (word_may_change_state(node->cmd.words[i])) {
+            return 0;
+        }
+    }
+
+    const char* name = node->cmd.words[0];
+    if (strpbrk(name, "$`'\"\\") != NULL) {
+        return 0;  // Only known after expansion
+    }
+    if (find_function(name) != NULL) {
+        return 0;
+    }
+    char* args[] = { (char*)name, NULL };
+    if (!is_builtin_command(args)) {
+        return 1;
+    }
+    for (int i = 0; pure_builtins[i] != NULL; i++) {
+        if (strcmp(name, pure_builtins[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether the whole substitution can run in the shell process. Pipeline
+// stages run in children anyway, so only their words need checking.
+static int runs_in_process(node_t* root) {
+    if (root->background) {
+        return 0;
+    }
+    if (root->type == NODE_COMMAND) {
+        return command_in_process(root);
+    }
+    if (root->type != NODE_PIPELINE) {
+        return 0;
+    }
+    for (int i = 0; i < root->list.count; i++) {
+        node_t* stage = root->list.items[i];
+        if (stage->type != NODE_COMMAND) {
+            return 0;
+        }
+        for (int j = 0; j < stage->cmd.num_words; j++) {
+            if (word_may_change_state(stage->cmd.words[j])) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Append everything readable from fd to out. Returns 0, or -1 on a read
+// error (already reported).
+static int read_output(int fd, strbuf_t* out) {
+    char buffer[CAPTURE_CHUNK];
+    while (1) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("command substitution");
+            return -1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        strbuf_append(out, buffer, n);
+    }
+}
+
+// Run root with stdout on the level's memory file, then append what it
+// wrote to out
+static int capture_in_process(substitution_level_t* level, node_t* root, strbuf_t* out) {
+    if (level->capture_fd < 0) {
+        level->capture_fd = memfd_create("substitution", MFD_CLOEXEC);
+        if (level->capture_fd < 0) {
+            perror("memfd_create");
+            return -1;
+        }
+    } else if (ftruncate(level->capture_fd, 0) < 0) {
+        perror("command substitution");
+        return -1;
+    }
+    lseek(level->capture_fd, 0, SEEK_SET);
+
+    fflush(stdout);
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    if (dup2(level->capture_fd, STDOUT_FILENO) < 0) {
+        perror("dup2");
+        if (saved >= 0) close(saved);
+        return -1;
+    }
+    int status = execute_node(root);
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    } else {
+        close(STDOUT_FILENO);  // stdout was closed before
+    }
+
+    lseek(level->capture_fd, 0, SEEK_SET);
+    if (read_output(level->capture_fd, out) < 0) {
+        return -1;
+    }
+    return status;
+}
+
+// Run root in a forked subshell and append its output to out
+static int capture_in_subshell(node_t* root, strbuf_t* out) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        if (job_control_enabled()) {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            signal(SIGTSTP, SIG_IGN);  // Stays in the shell's process group
+            signal(SIGTTIN, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+        }
+        enter_subshell();
+        dup2(fds[1], STDOUT_FILENO);
+        int status = execute_node(root);
+        fflush(stdout);
+        _exit(status);
+    }
+
+    close(fds[1]);
+    int result = read_output(fds[0], out);
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (result < 0) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Run the len bytes of command text and append its output, without
+// trailing newlines, to out. Sets $? to the command's status. Returns 0,
+// or -1 if the command could not be parsed or run (already reported).
+int command_substitution(const char* text, size_t len, strbuf_t* out) {
+    substitution_level_t* level = push_level();
+    if (level == NULL) {
+        return -1;
+    }
+    substitution_count++;
+
+    // parse_input() needs a terminated string; the caller's arena outlives
+    // the tree
+    char* source = arena_alloc(out->arena, len + 1);
+    if (source == NULL) {
+        pop_level();
+        return -1;
+    }
+    memcpy(source, text, len);
+    source[len] = '\0';
+
+    int parsed = parse_input(source, &level->ast);
+    if (parsed != PARSE_OK) {
+        if (parsed == PARSE_INCOMPLETE) {
+            fprintf(stderr, "Syntax error: unexpected end of command substitution\n");
+        }
+        pop_level();
+        set_last_status(2);
+        return -1;
+    }
+
+    node_t* root = level->ast.root;
+    int status = 0;
+    if (root != NULL) {
+        size_t start = out->len;
+        status = runs_in_process(root) ? capture_in_process(level, root, out)
+                                       : capture_in_subshell(root, out);
+        if (status < 0 || out->data == NULL) {
+            pop_level();
+            set_last_status(1);
+            return -1;
+        }
+        while (out->len > start && out->data[out->len - 1] == '\n') {
+            out->len--;
+        }
+        out->data[out->len] = '\0';
+    }
+
+    pop_level();
+    set_last_status(status);
+    return 0;
+}
+
+// Number of command substitutions run so far, so a command can tell
+// whether its expansion ran any (and take $? from the last one)
+unsigned long command_substitutions() {
+    return substitution_count;
+}
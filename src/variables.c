@@ -1,33 +1,96 @@
 #include "shell.h"
 
-// Global variables array
-static variable_t variables[MAX_VARIABLES];
-static int variable_count = 0;
+#define VAR_TABLE_INITIAL 64  // Initial slot count (always a power of two)
+
+// Open-addressing hash table of shell variables (linear probing)
+static variable_t* variables = NULL;
+static size_t variable_capacity = 0;
+static size_t variable_count = 0;
+
+// Positional parameters of the running function (or script), and "$*"
+// built from them on demand
+static char** positional = NULL;
+static int positional_count = 0;
+static char* positional_joined = NULL;
+static size_t positional_joined_cap = 0;
+static int positional_joined_valid = 0;
+
+// Values hidden by `local`, restored when the function's scope ends.
+// Entries of the innermost scope start at scope_start.
+typedef struct {
+    char* name;
+    char* value;         // NULL if the variable was unset
+} saved_variable_t;
+
+static saved_variable_t* saved_variables = NULL;
+static int saved_count = 0;
+static int saved_cap = 0;
+static int scope_start = 0;
+static int scope_depth = 0;
+
+// FNV-1a hash of a name slice
+static unsigned int hash_var_name(const char* name, size_t len) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+// Find the slot holding name, or the empty slot where it would go
+static variable_t* find_slot(const char* name, size_t len, unsigned int hash) {
+    size_t mask = variable_capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        variable_t* slot = &variables[i];
+        if (slot->name == NULL) {
+            return slot;
+        }
+        if (slot->hash == hash && strncmp(slot->name, name, len) == 0 &&
+            slot->name[len] == '\0') {
+            return slot;
+        }
+    }
+}
+
+// Double the table once it is 70% full
+static int grow_table() {
+    size_t new_capacity = variable_capacity ? variable_capacity * 2 : VAR_TABLE_INITIAL;
+    variable_t* old = variables;
+    size_t old_capacity = variable_capacity;
+
+    variables = calloc(new_capacity, sizeof(variable_t));
+    if (variables == NULL) {
+        perror("calloc");
+        variables = old;
+        return -1;
+    }
+    variable_capacity = new_capacity;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].name != NULL) {
+            *find_slot(old[i].name, strlen(old[i].name), old[i].hash) = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
 
 // Initialize variables system
 void init_variables() {
-    variable_count = 0;
-    
-    // Set some default environment variables
-    char* home = getenv("HOME");
-    if (home) {
-        set_variable("HOME", home);
+    if (variables == NULL) {
+        grow_table();
     }
     
-    char* user = getenv("USER");
-    if (user) {
-        set_variable("USER", user);
-    }
-    
-    char* pwd = getenv("PWD");
-    if (pwd) {
-        set_variable("PWD", pwd);
+    // Import some default environment variables (they stay exported)
+    const char* imported[] = {"HOME", "USER", "PWD", "SHELL", NULL};
+    for (int i = 0; imported[i] != NULL; i++) {
+        char* value = getenv(imported[i]);
+        if (value) {
+            set_variable(imported[i], value);
+        }
     }
     
-    char* shell = getenv("SHELL");
-    if (shell) {
-        set_variable("SHELL", shell);
-    } else {
+    if (getenv("SHELL") == NULL) {
         set_variable("SHELL", "/bin/myshell");
     }
 }
@@ -35,47 +98,303 @@ void init_variables() {
 // Set a variable (create or update)
 void set_variable(const char* name, const char* value) {
     if (name == NULL || value == NULL) return;
-    
-    // Check if variable already exists
-    for (int i = 0; i < variable_count; i++) {
-        if (strcmp(variables[i].name, name) == 0) {
-            strncpy(variables[i].value, value, VAR_VALUE_LEN - 1);
-            variables[i].value[VAR_VALUE_LEN - 1] = '\0';
+
+    // Remembered command locations are only valid for the old PATH
+    if (strcmp(name, "PATH") == 0) {
+        hash_reset();
+    }
+
+    if ((variable_count + 1) * 10 > variable_capacity * 7 && grow_table() < 0) {
+        return;
+    }
+
+    size_t len = strlen(name);
+    unsigned int hash = hash_var_name(name, len);
+    variable_t* slot = find_slot(name, len, hash);
+
+    // Reuse the value's buffer when the new value fits, so a loop that
+    // keeps updating a variable does not malloc on every iteration
+    int is_new = slot->name == NULL;
+    size_t value_len = strlen(value);
+    char* buf = is_new ? NULL : slot->value;
+    size_t cap = is_new ? 0 : slot->value_cap;
+    if (value_len >= cap) {
+        cap = value_len < 16 ? 16 : value_len + 1;
+        buf = malloc(cap);
+        if (buf == NULL) {
+            perror("malloc");
             return;
         }
+        memcpy(buf, value, value_len + 1);
+        if (!is_new) free(slot->value);
+    } else {
+        memmove(buf, value, value_len + 1); // value may be the old value
     }
-    
-    // Create new variable if space available
-    if (variable_count < MAX_VARIABLES) {
-        strncpy(variables[variable_count].name, name, VAR_NAME_LEN - 1);
-        variables[variable_count].name[VAR_NAME_LEN - 1] = '\0';
-        
-        strncpy(variables[variable_count].value, value, VAR_VALUE_LEN - 1);
-        variables[variable_count].value[VAR_VALUE_LEN - 1] = '\0';
-        
+
+    if (is_new) {
+        slot->name = strdup(name);
+        if (slot->name == NULL) {
+            free(buf);
+            return;
+        }
+        slot->hash = hash;
+        // Variables inherited from the environment stay exported
+        slot->exported = getenv(name) != NULL;
         variable_count++;
-    } else {
-        fprintf(stderr, "Error: too many variables (max %d)\n", MAX_VARIABLES);
     }
+    slot->value = buf;
+    slot->value_cap = cap;
+
+    if (slot->exported) {
+        setenv(name, value, 1);
+    }
+}
+
+// Exit status of the last command, for $?
+static int last_status = 0;
+
+void set_last_status(int status) {
+    last_status = status;
+}
+
+int get_last_status() {
+    return last_status;
+}
+
+// Process id of the last background command, for $! (0 before any)
+static pid_t last_background = 0;
+
+void set_last_background(pid_t pid) {
+    last_background = pid;
+}
+
+// $1..$N, $#, $@ / $*, $? and $!, or NULL if name is not a special
+// parameter (or $! before any background command)
+static char* positional_parameter(const char* name, size_t len, int* special) {
+    *special = 1;
+    if (len == 1 && name[0] == '?') {
+        static char status_digits[16];
+        snprintf(status_digits, sizeof(status_digits), "%d", last_status);
+        return status_digits;
+    }
+    if (len == 1 && name[0] == '!') {
+        static char pid_digits[16];
+        if (last_background == 0) return NULL;
+        snprintf(pid_digits, sizeof(pid_digits), "%d", (int)last_background);
+        return pid_digits;
+    }
+    if (len == 1 && name[0] == '#') {
+        static char digits[16];
+        snprintf(digits, sizeof(digits), "%d", positional_count);
+        return digits;
+    }
+    if (len == 1 && (name[0] == '@' || name[0] == '*')) {
+        if (!positional_joined_valid) {
+            size_t total = 1;
+            for (int i = 0; i < positional_count; i++) {
+                total += strlen(positional[i]) + 1;
+            }
+            if (total > positional_joined_cap) {
+                char* grown = realloc(positional_joined, total);
+                if (grown == NULL) return NULL;
+                positional_joined = grown;
+                positional_joined_cap = total;
+            }
+            char* out = positional_joined;
+            for (int i = 0; i < positional_count; i++) {
+                if (i > 0) *out++ = ' ';
+                size_t n = strlen(positional[i]);
+                memcpy(out, positional[i], n);
+                out += n;
+            }
+            *out = '\0';
+            positional_joined_valid = 1;
+        }
+        return positional_joined;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] < '0' || name[i] > '9') {
+            *special = 0;
+            return NULL;
+        }
+        n = n * 10 + (name[i] - '0');
+        if (n > (size_t)positional_count) break;
+    }
+    if (len == 0 || n == 0) {
+        *special = 0;  // $0 and empty names are not positional
+        return NULL;
+    }
+    return n <= (size_t)positional_count ? positional[n - 1] : "";
+}
+
+// Get a variable's value by a name slice (no terminator needed)
+char* get_variable_n(const char* name, size_t len) {
+    if (name == NULL || variables == NULL) return NULL;
+
+    if (len > 0 && ((name[0] >= '0' && name[0] <= '9') || name[0] == '#' ||
+                    name[0] == '@' || name[0] == '*' || name[0] == '?' || name[0] == '!')) {
+        int special;
+        char* value = positional_parameter(name, len, &special);
+        if (special) return value;
+    }
+
+    variable_t* slot = find_slot(name, len, hash_var_name(name, len));
+    if (slot->name != NULL) {
+        return slot->value;
+    }
+
+    // Also check environment variables
+    char env_name[len + 1];
+    memcpy(env_name, name, len);
+    env_name[len] = '\0';
+    return getenv(env_name);
 }
 
 // Get a variable's value
 char* get_variable(const char* name) {
     if (name == NULL) return NULL;
-    
-    for (int i = 0; i < variable_count; i++) {
-        if (strcmp(variables[i].name, name) == 0) {
-            return variables[i].value;
+    return get_variable_n(name, strlen(name));
+}
+
+// Remove a variable from the shell and the environment. Returns 0, or -1
+// if it was not set.
+int unset_variable(const char* name) {
+    if (name == NULL || variables == NULL) return -1;
+
+    if (strcmp(name, "PATH") == 0) {
+        hash_reset();
+    }
+    int was_env = getenv(name) != NULL;
+    unsetenv(name);
+
+    size_t len = strlen(name);
+    variable_t* slot = find_slot(name, len, hash_var_name(name, len));
+    if (slot->name == NULL) {
+        return was_env ? 0 : -1;
+    }
+    free(slot->name);
+    free(slot->value);
+
+    // Shift later entries of the probe run back into the hole so lookups
+    // never stop early at it
+    size_t mask = variable_capacity - 1;
+    size_t hole = slot - variables;
+    for (size_t i = (hole + 1) & mask; variables[i].name != NULL; i = (i + 1) & mask) {
+        size_t home = variables[i].hash & mask;
+        int movable = hole <= i ? (home <= hole || home > i) : (home <= hole && home > i);
+        if (movable) {
+            variables[hole] = variables[i];
+            hole = i;
         }
     }
-    
-    // Also check environment variables
-    char* env_value = getenv(name);
-    if (env_value != NULL) {
-        return env_value;
+    memset(&variables[hole], 0, sizeof(variable_t));
+    variable_count--;
+    return 0;
+}
+
+// Replace the positional parameters, saving the current ones. args must
+// stay valid until restore_positional().
+void set_positional(char** args, int count, positional_t* saved) {
+    saved->args = positional;
+    saved->count = positional_count;
+    positional = args;
+    positional_count = count;
+    positional_joined_valid = 0;
+}
+
+// The current positional parameters. Returns their count.
+int get_positional(char*** args) {
+    *args = positional;
+    return positional_count;
+}
+
+void restore_positional(const positional_t* saved) {
+    positional = saved->args;
+    positional_count = saved->count;
+    positional_joined_valid = 0;
+}
+
+// Start a scope for `local` variables (a function call). Returns a token
+// for pop_variable_scope().
+int push_variable_scope() {
+    int token = scope_start;
+    scope_start = saved_count;
+    scope_depth++;
+    return token;
+}
+
+// End the innermost scope, restoring the variables it made local
+void pop_variable_scope(int token) {
+    while (saved_count > scope_start) {
+        saved_variable_t* saved = &saved_variables[--saved_count];
+        if (saved->value != NULL) {
+            set_variable(saved->name, saved->value);
+        } else {
+            unset_variable(saved->name);
+        }
+        free(saved->name);
+        free(saved->value);
     }
-    
-    return NULL;
+    scope_start = token;
+    scope_depth--;
+}
+
+// Make name local to the innermost scope: its current value comes back
+// when the scope ends. Returns -1 outside of any scope.
+int make_local(const char* name) {
+    if (scope_depth == 0) {
+        return -1;
+    }
+    for (int i = scope_start; i < saved_count; i++) {
+        if (strcmp(saved_variables[i].name, name) == 0) {
+            return 0; // Already local here
+        }
+    }
+
+    if (saved_count == saved_cap) {
+        int cap = saved_cap ? saved_cap * 2 : 16;
+        saved_variable_t* grown = realloc(saved_variables, cap * sizeof(saved_variable_t));
+        if (grown == NULL) {
+            perror("realloc");
+            return -1;
+        }
+        saved_variables = grown;
+        saved_cap = cap;
+    }
+
+    // Look the value up the way $name would, so a variable that so far
+    // only lives in the environment (PATH, HOME...) comes back too
+    const char* current = get_variable(name);
+    saved_variable_t* saved = &saved_variables[saved_count];
+    saved->name = strdup(name);
+    saved->value = current ? strdup(current) : NULL;
+    if (saved->name == NULL || (current && saved->value == NULL)) {
+        free(saved->name);
+        free(saved->value);
+        return -1;
+    }
+    saved_count++;
+    return 0;
+}
+
+// Mark a variable as exported so child processes see it. A name that is
+// not set yet is created empty, like in other shells.
+int export_variable(const char* name) {
+    if (name == NULL || variables == NULL) return -1;
+
+    size_t len = strlen(name);
+    variable_t* slot = find_slot(name, len, hash_var_name(name, len));
+    if (slot->name == NULL) {
+        char* env_value = getenv(name);
+        set_variable(name, env_value ? env_value : "");
+        slot = find_slot(name, len, hash_var_name(name, len));
+        if (slot->name == NULL) return -1;
+    }
+
+    slot->exported = 1;
+    return setenv(name, slot->value, 1);
 }
 
 // Check if a command line is a variable assignment
@@ -117,122 +436,29 @@ int is_variable_assignment(const char* cmdline) {
     return 1;
 }
 
-// Handle variable assignment
-int handle_variable_assignment(const char* cmdline) {
-    if (!is_variable_assignment(cmdline)) {
-        return 0;
-    }
-    
-    // Parse name and value
-    char* copy = strdup(cmdline);
-    if (copy == NULL) return 0;
-    
-    char* equal_sign = strchr(copy, '=');
-    
-    if (equal_sign == NULL) {
-        free(copy);
-        return 0;
-    }
-    
-    // Split into name and value
-    *equal_sign = '\0';
-    char* name = copy;
-    char* value = equal_sign + 1;
-    
-    // Trim whitespace from name
-    char* name_end = name + strlen(name) - 1;
-    while (name_end > name && (*name_end == ' ' || *name_end == '\t')) {
-        *name_end = '\0';
-        name_end--;
-    }
-    
-    // Trim leading whitespace from name
-    while (*name == ' ' || *name == '\t') {
-        name++;
-    }
-    
-    // Set the variable
-    set_variable(name, value);
-    
-    free(copy);
-    return 1;
-}
-
-// Expand variables in a string (replace $VAR with value)
-char* expand_variables(const char* str) {
-    if (str == NULL) return NULL;
-    
-    char* result = malloc(MAX_LEN);
-    if (result == NULL) return NULL;
-    result[0] = '\0';
-    
-    const char* ptr = str;
-    
-    while (*ptr != '\0') {
-        if (*ptr == '$') {
-            // Found a variable reference
-            ptr++; // Skip the '$'
-            
-            if (*ptr == '\0') {
-                // $ at end of string
-                strcat(result, "$");
-                break;
-            }
-            
-            // Extract variable name
-            char var_name[VAR_NAME_LEN] = "";
-            int name_len = 0;
-            
-            if (*ptr == '{') {
-                // ${VAR} syntax
-                ptr++; // Skip '{'
-                while (*ptr != '\0' && *ptr != '}' && name_len < VAR_NAME_LEN - 1) {
-                    var_name[name_len++] = *ptr++;
-                }
-                if (*ptr == '}') ptr++; // Skip '}'
-            } else {
-                // $VAR syntax
-                while ((*ptr >= 'a' && *ptr <= 'z') || 
-                       (*ptr >= 'A' && *ptr <= 'Z') || 
-                       (*ptr >= '0' && *ptr <= '9') || 
-                       *ptr == '_') {
-                    if (name_len < VAR_NAME_LEN - 1) {
-                        var_name[name_len++] = *ptr;
-                    }
-                    ptr++;
-                }
-            }
-            
-            var_name[name_len] = '\0';
-            
-            // Get variable value
-            char* var_value = get_variable(var_name);
-            if (var_value != NULL) {
-                strcat(result, var_value);
-            } else {
-                // If variable not found, keep the original reference
-                strcat(result, "$");
-                strcat(result, var_name);
-            }
-        } else {
-            // Regular character
-            int len = strlen(result);
-            if (len < MAX_LEN - 2) {
-                result[len] = *ptr;
-                result[len + 1] = '\0';
-            }
-            ptr++;
-        }
-    }
-    
-    return result;
+// Order variables by name for printing
+static int compare_variables(const void* a, const void* b) {
+    return strcmp((*(variable_t* const*)a)->name, (*(variable_t* const*)b)->name);
 }
 
 // Print all variables
 void print_variables() {
     printf("Shell variables:\n");
-    for (int i = 0; i < variable_count; i++) {
-        printf("  %s=%s\n", variables[i].name, variables[i].value);
+
+    variable_t** sorted = malloc((variable_count ? variable_count : 1) * sizeof(variable_t*));
+    if (sorted != NULL) {
+        size_t n = 0;
+        for (size_t i = 0; i < variable_capacity; i++) {
+            if (variables[i].name != NULL) {
+                sorted[n++] = &variables[i];
+            }
+        }
+        qsort(sorted, n, sizeof(variable_t*), compare_variables);
+        for (size_t i = 0; i < n; i++) {
+            printf("  %s%s=%s\n", sorted[i]->exported ? "(exported) " : "",
+                   sorted[i]->name, sorted[i]->value);
+        }
+        free(sorted);
     }
     
     // Also print some important environment variables